@@ -12,22 +12,69 @@
 #include "tools/Assert.hpp"
 #include "tools/Error.hpp"
 #include "tools/Log.hpp"
+#include "tools/Random.hpp"
 
+#include <boost/algorithm/string.hpp>
 #include <boost/thread.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <vector>
+
 namespace moose {
 namespace mredis {
 
 using namespace moose::tools;
 
+namespace {
+
+//! innermost ScopedTimeout of this thread
+thread_local const ScopedTimeout *t_scoped_timeout = nullptr;
+
+}
+
+ScopedTimeout::ScopedTimeout(const Duration &n_timeout) noexcept
+		: m_timeout{ n_timeout }
+		, m_outer{ t_scoped_timeout } {
+
+	t_scoped_timeout = this;
+}
+
+ScopedTimeout::~ScopedTimeout() noexcept {
+
+	MOOSE_ASSERT(t_scoped_timeout == this);
+
+	t_scoped_timeout = m_outer;
+}
+
+const Duration *ScopedTimeout::current() noexcept {
+
+	return t_scoped_timeout ? &t_scoped_timeout->m_timeout : nullptr;
+}
+
 struct AsyncClientMembers : public moose::tools::Pimplee {
 
 	AsyncClientMembers()
-			: m_io_context()
+			: m_io_context(nullptr)
+			, m_own_io_context()
 			, m_work()
-			, m_worker_thread()
+			, m_worker_threads()
 			, m_server()
-			, m_port(0) {
+			, m_port(0)
+			, m_protocol(RespVersion::RESP2)
+			, m_scatter_threshold(MRedisConnection::MREDIS_SCATTER_THRESHOLD)
+			, m_request_timeout(c_invalid_duration)
+			, m_max_requests(0)
+			, m_max_bytes(0)
+			, m_backpressure(Backpressure::Fail)
+			, m_flush_policy()
+			, m_resolve_ttl(std::chrono::seconds(MRedisConnection::MREDIS_RESOLVE_TTL))
+			, m_reconnect_policy()
+			, m_pool_size(1)
+			, m_key_affinity(false)
+			, m_next_connection(0) {
 	}
 
 	~AsyncClientMembers() noexcept {
@@ -35,111 +82,283 @@ struct AsyncClientMembers : public moose::tools::Pimplee {
 		// cleanup of io_service in AsyncClient d'tor
 	}
 
-	boost::asio::io_context                 m_io_context;        //!< may be owned by this or running outside
+	boost::asio::io_context                *m_io_context;        //!< may be owned by this or running outside
+	std::unique_ptr<boost::asio::io_context> m_own_io_context;   //!< empty if we run in someone else's
 	std::shared_ptr<boost::asio::io_context::work> m_work;
-	std::unique_ptr<boost::thread>          m_worker_thread;     //!< the only thread that runs our io_context. implicit strand
+	boost::thread_group                     m_worker_threads;    //!< run our own io_context. Every connection has its own strand
 
-	std::string                             m_server;            //!< server hostname if TCP
-	boost::uint16_t                         m_port;              //!< server port
+	std::string                             m_server;            //!< server hostname if TCP, socket path otherwise
+	boost::uint16_t                         m_port;              //!< server port. 0 means unix domain socket
 
-	std::unique_ptr<MRedisConnection>       m_main_connection;   //!< this connection handles every major command on a pushing line
+	std::vector<std::unique_ptr<MRedisConnection> >
+	                                        m_connections;       //!< pushing lines for every major command. The first one also carries RESP3 subscriptions
 	std::unique_ptr<MRedisPubsubConnection> m_pubsub_connection; //!< connection specific for pubsub messages
 	bool                                    m_connection_restart;//!< when child connections die, they may request reconnect on demand
 
+	RespVersion                             m_protocol;          //!< with RESP3 there is no pubsub connection
+	Callback                                m_push_handler;      //!< user's handler for pushes that aren't pubsub
+	std::size_t                             m_scatter_threshold; //!< values from this size on are not copied for sending
+	Duration                                m_request_timeout;   //!< requests fail when not answered in time
+	std::size_t                             m_max_requests;      //!< per connection, 0 for no limit
+	std::size_t                             m_max_bytes;         //!< per connection, 0 for no limit
+	Backpressure                            m_backpressure;      //!< what happens when a limit is reached
+	std::function<void()>                   m_yield;             //!< for Backpressure::Yield
+	FlushPolicy                             m_flush_policy;      //!< how connections batch their writes
+	Duration                                m_resolve_ttl;       //!< how long resolved addresses are used for reconnects
+	ReconnectPolicy                         m_reconnect_policy;  //!< pauses between reconnect attempts, when to fail fast
+	std::size_t                             m_pool_size;         //!< how many connections to open at connect
+	bool                                    m_key_affinity;      //!< requests for one key always take the same connection
+	std::atomic<std::size_t>                m_next_connection;   //!< where to start looking for the least busy connection
+
+	//! RESP3 only. Subscription ID to handler. We can have many handlers for one channel.
+	using SubscriptionMap = std::map<boost::uint64_t, MessageCallback>;
+	std::map<std::string, SubscriptionMap>  m_message_handlers;
+	
+	//! RESP3 only. Subscriptions waiting for the server to confirm them
+	std::multimap<std::string, std::shared_ptr<boost::promise<bool> > > m_pending_confirms;
+	boost::mutex                            m_message_handlers_lock;
+
+	//! @return the connection with the fewest requests waiting for an answer
+	MRedisConnection &connection() noexcept {
+
+		if (m_connections.size() == 1) {
+			return *m_connections.front();
+		}
+
+		// Start somewhere else every time, so equally busy connections take turns
+		const std::size_t start = m_next_connection.fetch_add(1, std::memory_order_relaxed);
+		MRedisConnection *best = nullptr;
+		std::size_t best_pending = 0;
+		for (std::size_t i = 0; i < m_connections.size(); ++i) {
+			MRedisConnection &candidate = *m_connections[(start + i) % m_connections.size()];
+			const std::size_t pending = candidate.pending();
+			if (!best || (pending < best_pending)) {
+				best = &candidate;
+				best_pending = pending;
+				if (!pending) {
+					break;
+				}
+			}
+		}
+
+		return *best;
+	}
+
+	//! @return with key affinity, always the same connection for that key. Otherwise the least busy
+	MRedisConnection &connection(const std::string &n_key) noexcept {
+
+		return connection(std::optional<std::size_t>(std::hash<std::string>()(n_key)));
+	}
+
+	//! generic commands bring the hash of their key, if they have one
+	MRedisConnection &connection(const std::optional<std::size_t> n_key_hash) noexcept {
+
+		if (!n_key_hash || !m_key_affinity || (m_connections.size() == 1)) {
+			return connection();
+		}
+
+		return *m_connections[*n_key_hash % m_connections.size()];
+	}
+
+	//! commands with many keys go where the first one would
+	MRedisConnection &connection(const std::vector<std::string> &n_keys) noexcept {
+
+		return n_keys.empty() ? connection() : connection(n_keys.front());
+	}
+
+	void start_worker_threads(const unsigned int n_io_threads) {
+
+		m_own_io_context.reset(new boost::asio::io_context());
+		m_io_context = m_own_io_context.get();
+		m_work.reset(new boost::asio::io_context::work(*m_io_context));
+		for (unsigned int i = 0; i < std::max(n_io_threads, 1u); ++i) {
+			m_worker_threads.create_thread([this] () { m_io_context->run(); });
+		}
+	}
+
+	//! execute n_function in the connection's strand and wait for it
+	void run_in_strand(MRedisConnection &n_connection, const std::function<void()> &n_function) noexcept {
+
+		// From a thread that runs the io_context we can't wait for it. There may be no other to run it.
+		// Neither if nobody runs it any more
+		if (m_io_context->get_executor().running_in_this_thread() || m_io_context->stopped()) {
+			n_function();
+			return;
+		}
+
+		try {
+			std::shared_ptr<boost::promise<void> > executed = std::make_shared<boost::promise<void> >();
+			boost::unique_future<void> done = executed->get_future();
+			boost::asio::post(n_connection.strand(), [&n_function, executed] {
+				n_function();
+				executed->set_value();
+			});
+			done.get();
+		} catch (const std::exception &sex) {
+			BOOST_LOG_SEV(logger(), warning) << "Could not run in connection's strand: " << sex.what();
+			n_function();
+		}
+	}
+
+	/*! stop in the connection's strand, so no handler of it runs at the same time in another io thread.
+		Then give the handlers the stop aborted a chance to run before the connection is deleted
+	 */
+	void stop_connection(MRedisConnection &n_connection) noexcept {
+
+		run_in_strand(n_connection, [&n_connection] { n_connection.stop(); });
+
+		if (m_own_io_context) {
+			m_io_context->poll();
+		} else {
+			// Someone else's handlers are none of our business. We just wait for ours
+			run_in_strand(n_connection, [] {});
+		}
+	}
+
+	//! stop and delete all pushing connections
+	void stop_connections() noexcept {
+
+		for (std::unique_ptr<MRedisConnection> &c : m_connections) {
+			stop_connection(*c);
+		}
+
+		m_connections.clear();
+	}
 };
 
 
 AsyncClient::AsyncClient() : moose::tools::Pimpled<AsyncClientMembers>() {
 
-	d().m_work.reset(new boost::asio::io_context::work(d().m_io_context));
-	d().m_worker_thread.reset(new boost::thread([&] () { d().m_io_context.run(); }));
+	d().m_server = "/run/redis.sock";
+	d().start_worker_threads(1);
 }
 
-AsyncClient::AsyncClient(const std::string &n_server, const boost::uint16_t n_port /*= 6379*/) {
+AsyncClient::AsyncClient(const std::string &n_server, const boost::uint16_t n_port /*= 6379*/, const unsigned int n_io_threads /*= 1*/) {
 
 	d().m_server = n_server;
 	d().m_port = n_port;
 
 	MOOSE_ASSERT((!d().m_server.empty()));
 	
-	d().m_work.reset(new boost::asio::io_context::work(d().m_io_context));
-	d().m_worker_thread.reset(new boost::thread([&] () { d().m_io_context.run(); }));
+	d().start_worker_threads(n_io_threads);
 
 	BOOST_LOG_SEV(logger(), normal) << "AsyncClient started";
 }
 
-AsyncClient::~AsyncClient() noexcept {
+AsyncClient::AsyncClient(boost::asio::io_context &n_io_context, const std::string &n_server, const boost::uint16_t n_port /*= 6379*/) {
+
+	d().m_server = n_server;
+	d().m_port = n_port;
+	d().m_io_context = &n_io_context;
+
+	MOOSE_ASSERT((!d().m_server.empty()));
+
+	BOOST_LOG_SEV(logger(), normal) << "AsyncClient started in external io_context";
+}
+
+AsyncClient::AsyncClient(const UnixSocket &n_socket, const unsigned int n_io_threads /*= 1*/) {
 
-	if (d().m_main_connection) {
+	d().m_server = n_socket.m_path;
 
-		// Stop will have 
-		d().m_main_connection->stop();
-		d().m_io_context.poll();
-		d().m_main_connection.reset();
+	MOOSE_ASSERT((!d().m_server.empty()));
+
+	d().start_worker_threads(n_io_threads);
+
+	BOOST_LOG_SEV(logger(), normal) << "AsyncClient started on " << d().m_server;
+}
+
+AsyncClient::AsyncClient(boost::asio::io_context &n_io_context, const UnixSocket &n_socket) {
+
+	d().m_server = n_socket.m_path;
+	d().m_io_context = &n_io_context;
+
+	MOOSE_ASSERT((!d().m_server.empty()));
+
+	BOOST_LOG_SEV(logger(), normal) << "AsyncClient started on " << d().m_server << " in external io_context";
+}
+
+AsyncClient::~AsyncClient() noexcept {
+
+	// Stop will have 
+	for (const std::unique_ptr<MRedisConnection> &c : d().m_connections) {
+		d().stop_connection(*c);
 	}
 
 	if (d().m_pubsub_connection) {
-		d().m_pubsub_connection->stop();
-		d().m_io_context.poll();
-		d().m_pubsub_connection.reset();
+		d().stop_connection(*d().m_pubsub_connection);
 	}
 
-	d().m_io_context.stop();
+	// An io_context that isn't ours keeps running
+	if (d().m_own_io_context) {
+		d().m_io_context->stop();
 
-	// wait for 
-	if (d().m_worker_thread) {
+		// wait for 
 		d().m_work.reset();
-		d().m_worker_thread->join();
-		d().m_worker_thread.reset();
+		d().m_worker_threads.join_all();
 	}
 
+	// Aborted handlers may have been running in our threads until now. They're done
+	d().m_connections.clear();
+	d().m_pubsub_connection.reset();
+
 	BOOST_LOG_SEV(logger(), normal) << "AsyncClient stopped";
 }
 
-void AsyncClient::connect() {
+void AsyncClient::connect(const RespVersion n_version /*= RespVersion::RESP2*/) {
 
-	if (d().m_main_connection) {
-		d().m_main_connection->stop();
-		d().m_io_context.poll();
-		d().m_main_connection.reset();
-	}
+	d().stop_connections();
 
 	if (d().m_pubsub_connection) {
-		d().m_pubsub_connection->stop();
-		d().m_io_context.poll();
+		d().stop_connection(*d().m_pubsub_connection);
 		d().m_pubsub_connection.reset();
 	}
 
-	MOOSE_ASSERT(!d().m_main_connection);
+	MOOSE_ASSERT(d().m_connections.empty());
 	MOOSE_ASSERT(!d().m_pubsub_connection);
 
-	d().m_main_connection.reset(new MRedisConnection(*this));
-	d().m_main_connection->connect(d().m_server, d().m_port);
+	d().m_protocol = n_version;
+	create_connections();
+
+	// All of them are up and warm before we return
+	for (std::unique_ptr<MRedisConnection> &c : d().m_connections) {
+		c->connect(d().m_server, d().m_port, n_version);
+	}
+
+	// RESP3 can mix pushes with responses, so we don't need a second connection for pubsub
+	if (n_version == RespVersion::RESP3) {
+		return;
+	}
 
 	d().m_pubsub_connection.reset(new MRedisPubsubConnection(*this));
 	d().m_pubsub_connection->connect(d().m_server, d().m_port);
 }
 
-boost::shared_future<bool> AsyncClient::async_connect() {
+boost::shared_future<bool> AsyncClient::async_connect(const RespVersion n_version /*= RespVersion::RESP2*/) {
 
-	if (d().m_main_connection) {
-		d().m_main_connection->stop();
-		d().m_io_context.poll();
-		d().m_main_connection.reset();
-	}
+	d().stop_connections();
 
 	if (d().m_pubsub_connection) {
-		d().m_pubsub_connection->stop();
-		d().m_io_context.poll();
+		d().stop_connection(*d().m_pubsub_connection);
 		d().m_pubsub_connection.reset();
 	}
 
-	MOOSE_ASSERT(!d().m_main_connection);
+	MOOSE_ASSERT(d().m_connections.empty());
 	MOOSE_ASSERT(!d().m_pubsub_connection);
 
-	d().m_main_connection.reset(new MRedisConnection(*this));
+	d().m_protocol = n_version;
+	create_connections();
 	std::shared_ptr<boost::promise<bool> > promise(std::make_shared<boost::promise<bool> >());
-	d().m_main_connection->async_connect(d().m_server, d().m_port, promise);
+
+	// The future tells about the first one. The others hold back requests until they are connected
+	d().m_connections.front()->async_connect(d().m_server, d().m_port, promise, n_version);
+	for (std::size_t i = 1; i < d().m_connections.size(); ++i) {
+		d().m_connections[i]->async_connect(d().m_server, d().m_port, std::make_shared<boost::promise<bool> >(), n_version);
+	}
+
+	// RESP3 can mix pushes with responses, so we don't need a second connection for pubsub
+	if (n_version == RespVersion::RESP3) {
+		return promise->get_future();
+	}
 	
 	d().m_pubsub_connection.reset(new MRedisPubsubConnection(*this));
 	std::shared_ptr<boost::promise<bool> > promise1(std::make_shared<boost::promise<bool> >());
@@ -148,202 +367,380 @@ boost::shared_future<bool> AsyncClient::async_connect() {
 	return promise->get_future();
 }
 
+void AsyncClient::set_push_handler(Callback &&n_handler) noexcept {
+
+	d().m_push_handler = std::move(n_handler);
+}
+
+void AsyncClient::set_scatter_threshold(const std::size_t n_threshold) noexcept {
+
+	d().m_scatter_threshold = n_threshold;
+}
+
+void AsyncClient::set_request_timeout(const Duration &n_timeout) noexcept {
+
+	d().m_request_timeout = n_timeout;
+}
+
+void AsyncClient::set_backpressure(const std::size_t n_max_requests, const std::size_t n_max_bytes,
+                                   const Backpressure n_policy, std::function<void()> &&n_yield) noexcept {
+
+	d().m_max_requests = n_max_requests;
+	d().m_max_bytes = n_max_bytes;
+	d().m_backpressure = n_policy;
+	d().m_yield = std::move(n_yield);
+}
+
+void AsyncClient::set_flush_policy(const FlushPolicy &n_policy) noexcept {
+
+	d().m_flush_policy = n_policy;
+}
+
+void AsyncClient::set_resolve_ttl(const Duration &n_ttl) noexcept {
+
+	d().m_resolve_ttl = n_ttl;
+}
+
+void AsyncClient::set_reconnect_policy(const ReconnectPolicy &n_policy) noexcept {
+
+	d().m_reconnect_policy = n_policy;
+}
+
+std::size_t AsyncClient::pending() noexcept {
+
+	std::size_t pending = 0;
+	for (const std::unique_ptr<MRedisConnection> &c : d().m_connections) {
+		pending += c->pending();
+	}
+
+	return pending;
+}
+
+std::size_t AsyncClient::queued_bytes() noexcept {
+
+	std::size_t bytes = 0;
+	for (const std::unique_ptr<MRedisConnection> &c : d().m_connections) {
+		bytes += c->queued_bytes();
+	}
+
+	return bytes;
+}
+
+void AsyncClient::set_connections(const std::size_t n_connections) noexcept {
+
+	MOOSE_ASSERT(n_connections > 0);
+
+	d().m_pool_size = std::max<std::size_t>(n_connections, 1);
+}
+
+void AsyncClient::set_key_affinity(const bool n_affinity) noexcept {
+
+	d().m_key_affinity = n_affinity;
+}
+
+void AsyncClient::create_connections() {
+
+	for (std::size_t i = 0; i < d().m_pool_size; ++i) {
+		std::unique_ptr<MRedisConnection> c{ new MRedisConnection(*this) };
+		c->set_scatter_threshold(d().m_scatter_threshold);
+		c->set_request_timeout(d().m_request_timeout);
+		c->set_backpressure(d().m_max_requests, d().m_max_bytes, d().m_backpressure, std::function<void()>(d().m_yield));
+		c->set_flush_policy(d().m_flush_policy);
+		c->set_resolve_ttl(d().m_resolve_ttl);
+		c->set_reconnect_policy(d().m_reconnect_policy);
+
+		// Subscriptions are confirmed on the first one but client tracking may come in on any
+		if (d().m_protocol == RespVersion::RESP3) {
+			c->set_push_handler([this](const RedisMessage &n_push) { this->handle_push(n_push); });
+		}
+
+		// The first one holds the subscriptions. They have to be renewed when it reconnects
+		if ((d().m_protocol == RespVersion::RESP3) && (i == 0)) {
+			c->set_resubscribe_handler([this] {
+				std::vector<std::string> channels;
+				boost::unique_lock<boost::mutex> slock(d().m_message_handlers_lock);
+				for (const std::map<std::string, AsyncClientMembers::SubscriptionMap>::value_type &channel : d().m_message_handlers) {
+					channels.push_back(channel.first);
+				}
+				return channels;
+			});
+		}
+
+		d().m_connections.push_back(std::move(c));
+	}
+}
+
+void AsyncClient::send_command(const std::optional<std::size_t> n_key, std::function<void(CommandBuffer &n_out)> &&n_prepare, Callback &&n_callback) noexcept {
+
+	MOOSE_ASSERT(!d().m_connections.empty());
+
+	d().connection(n_key).send(std::move(n_prepare), std::move(n_callback));
+}
+
+void AsyncClient::send_command(const std::optional<std::size_t> n_key, std::function<void(CommandBuffer &n_out)> &&n_prepare, ReplyCallback &&n_callback) noexcept {
+
+	MOOSE_ASSERT(!d().m_connections.empty());
+
+	d().connection(n_key).send(std::move(n_prepare), std::move(n_callback));
+}
+
+future_response AsyncClient::send_command(const std::optional<std::size_t> n_key, std::function<void(CommandBuffer &n_out)> &&n_prepare) noexcept {
+
+	MOOSE_ASSERT(!d().m_connections.empty());
+
+	return d().connection(n_key).send(std::move(n_prepare))->get_future();
+}
+
 void AsyncClient::time(Callback &&n_callback) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_time(n_os); }
+	d().connection().send(
+			[=](CommandBuffer &n_out) { format_time(n_out); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::time() noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_time(n_os); })->get_future();
+	return d().connection().send([=](CommandBuffer &n_out) { format_time(n_out); })->get_future();
 }
 
 void AsyncClient::get(const std::string &n_key, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
+	MOOSE_ASSERT(!n_key.empty());
+
+	d().connection(n_key).send(
+			[=](CommandBuffer &n_out) { format_get(n_out, n_key); }
+			, std::move(n_callback));
+}
+
+void AsyncClient::get(const std::string &n_key, ReplyCallback &&n_callback) noexcept {
+
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_key.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_get(n_os, n_key); }
+	d().connection(n_key).send(
+			[=](CommandBuffer &n_out) { format_get(n_out, n_key); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::get(const std::string &n_key) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_key.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_get(n_os, n_key); })->get_future();
+	return d().connection(n_key).send([=](CommandBuffer &n_out) { format_get(n_out, n_key); })->get_future();
 }
 
 void AsyncClient::mget(const std::vector<std::string> &n_keys, Callback &&n_callback) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
+	MOOSE_ASSERT(!n_keys.empty());
+
+	d().connection(n_keys).send(
+			[=](CommandBuffer &n_out) { format_mget(n_out, n_keys); }
+			, std::move(n_callback));
+}
+
+void AsyncClient::mget(const std::vector<std::string> &n_keys, ReplyCallback &&n_callback) noexcept {
+	
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_keys.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_mget(n_os, n_keys); }
+	d().connection(n_keys).send(
+			[=](CommandBuffer &n_out) { format_mget(n_out, n_keys); }
 			, std::move(n_callback));
 }
 
+void AsyncClient::mget(const std::vector<std::string> &n_keys, ReplyStream &&n_stream) noexcept {
+	
+	MOOSE_ASSERT(!d().m_connections.empty());
+	MOOSE_ASSERT(!n_keys.empty());
+
+	d().connection(n_keys).send(
+			[=](CommandBuffer &n_out) { format_mget(n_out, n_keys); }
+			, std::move(n_stream));
+}
+
 future_response AsyncClient::mget(const std::vector<std::string> &n_keys) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_keys.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_mget(n_os, n_keys); })->get_future();
+	return d().connection(n_keys).send([=](CommandBuffer &n_out) { format_mget(n_out, n_keys); })->get_future();
 }
 
-void AsyncClient::set(const std::string &n_key, const std::string &n_value, Callback &&n_callback,
+void AsyncClient::set(const std::string &n_key, std::string n_value, Callback &&n_callback,
 		const Duration &n_expire_time /* = Duration::max() */, const SetCondition n_condition /* = SetCondition::NONE*/) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
 	if (n_key.empty()) {
 		BOOST_THROW_EXCEPTION(redis_error() << error_message("Key cannot be empty"));
 	}
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_set(n_os, n_key, n_value, n_expire_time, n_condition); }
+	d().connection(n_key).send(
+			[n_key, value = std::move(n_value), n_expire_time, n_condition](CommandBuffer &n_out) {
+				format_set(n_out, n_key, value, n_expire_time, n_condition);
+			}
 			, std::move(n_callback));
 }
 
-future_response AsyncClient::set(const std::string &n_key, const std::string &n_value,
+future_response AsyncClient::set(const std::string &n_key, std::string n_value,
 		const Duration &n_expire_time /* = c_invalid_duration */, const SetCondition n_condition /* = SetCondition::NONE*/) noexcept {
 
 	if (n_key.empty()) {
 		BOOST_THROW_EXCEPTION(redis_error() << error_message("Key cannot be empty"));
 	}
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_set(n_os, n_key, n_value, n_expire_time, n_condition); })->get_future();
+	return d().connection(n_key).send([n_key, value = std::move(n_value), n_expire_time, n_condition](CommandBuffer &n_out) {
+			format_set(n_out, n_key, value, n_expire_time, n_condition);
+		})->get_future();
 }
 
 void AsyncClient::expire(const std::string &n_key, const Duration &n_expire_time, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
 	if (n_key.empty()) {
 		BOOST_THROW_EXCEPTION(redis_error() << error_message("Key cannot be empty"));
 	}
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_expire(n_os, n_key, n_expire_time); }
+	d().connection(n_key).send(
+			[=](CommandBuffer &n_out) { format_expire(n_out, n_key, n_expire_time); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::expire(const std::string &n_key, const Duration &n_expire_time) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	
 	if (n_key.empty()) {
 		BOOST_THROW_EXCEPTION(redis_error() << error_message("Key cannot be empty"));
 	}
 
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_expire(n_os, n_key, n_expire_time); })->get_future();
+	return d().connection(n_key).send([=](CommandBuffer &n_out) { format_expire(n_out, n_key, n_expire_time); })->get_future();
 }
 
 void AsyncClient::del(const std::string &n_key, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
 	if (n_key.empty()) {
 		BOOST_THROW_EXCEPTION(redis_error() << error_message("Key cannot be empty"));
 	}
 
-	d().m_main_connection->send(
-			[=] (std::ostream &n_os) { format_del(n_os, n_key); }
+	d().connection(n_key).send(
+			[=] (CommandBuffer &n_out) { format_del(n_out, n_key); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::del(const std::string &n_key) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
 	if (n_key.empty()) {
 		BOOST_THROW_EXCEPTION(redis_error() << error_message("Key cannot be empty"));
 	}
 
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) { format_del(n_os, n_key); })->get_future();
+	return d().connection(n_key).send([=] (CommandBuffer &n_out) { format_del(n_out, n_key); })->get_future();
 }
 
 void AsyncClient::exists(const std::string &n_key, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	
 	if (n_key.empty()) {
 		BOOST_THROW_EXCEPTION(redis_error() << error_message("Key cannot be empty"));
 	}
 
 
-	d().m_main_connection->send(
-			[=] (std::ostream &n_os) { format_exists(n_os, n_key); }
+	d().connection(n_key).send(
+			[=] (CommandBuffer &n_out) { format_exists(n_out, n_key); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::exists(const std::string &n_key) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	
 	if (n_key.empty()) {
 		BOOST_THROW_EXCEPTION(redis_error() << error_message("Key cannot be empty"));
 	}
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) { format_exists(n_os, n_key); })->get_future();
+	return d().connection(n_key).send([=] (CommandBuffer &n_out) { format_exists(n_out, n_key); })->get_future();
 }
 
 void AsyncClient::incr(const std::string &n_key, Callback &&n_callback) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
+	MOOSE_ASSERT(!n_key.empty());
+
+	d().connection(n_key).send(
+			[=](CommandBuffer &n_out) { format_incr(n_out, n_key); }
+			, std::move(n_callback));
+}
+
+void AsyncClient::incr(const std::string &n_key, ReplyCallback &&n_callback) noexcept {
+	
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_key.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_incr(n_os, n_key); }
+	d().connection(n_key).send(
+			[=](CommandBuffer &n_out) { format_incr(n_out, n_key); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::incr(const std::string &n_key) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_key.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_incr(n_os, n_key); })->get_future();
+	return d().connection(n_key).send([=](CommandBuffer &n_out) { format_incr(n_out, n_key); })->get_future();
 }
 
 void AsyncClient::decr(const std::string &n_key, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
+	MOOSE_ASSERT(!n_key.empty());
+
+	d().connection(n_key).send(
+			[=](CommandBuffer &n_out) { format_decr(n_out, n_key); }
+			, std::move(n_callback));
+}
+
+void AsyncClient::decr(const std::string &n_key, ReplyCallback &&n_callback) noexcept {
+
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_key.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_decr(n_os, n_key); }
+	d().connection(n_key).send(
+			[=](CommandBuffer &n_out) { format_decr(n_out, n_key); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::decr(const std::string &n_key) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_key.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_decr(n_os, n_key); })->get_future();
+	return d().connection(n_key).send([=](CommandBuffer &n_out) { format_decr(n_out, n_key); })->get_future();
 }
 
 void AsyncClient::hincrby(const std::string &n_hash_name, const std::string &n_field_name,
 		const boost::int64_t n_increment_by, Callback &&n_callback /*= Callback()*/) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_hincrby(n_os, n_hash_name, n_field_name, n_increment_by); }
+	d().connection(n_hash_name).send(
+			[=](CommandBuffer &n_out) { format_hincrby(n_out, n_hash_name, n_field_name, n_increment_by); }
 			, std::move(n_callback));
 }
 
@@ -353,353 +750,470 @@ future_response AsyncClient::hincrby(const std::string &n_hash_name, const std::
 	// only accepts copyable handlers. Meaning I have to use some kind of pointer type
 	// and unique_ptr also doesn't work. Making shared_ptr the only option
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_hincrby(n_os, n_hash_name, n_field_name, n_increment_by); })->get_future();
+	return d().connection(n_hash_name).send([=](CommandBuffer &n_out) { format_hincrby(n_out, n_hash_name, n_field_name, n_increment_by); })->get_future();
 }
 
 void AsyncClient::hget(const std::string &n_hash_name, const std::string &n_field_name, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_hget(n_os, n_hash_name, n_field_name); }
+	d().connection(n_hash_name).send(
+			[=](CommandBuffer &n_out) { format_hget(n_out, n_hash_name, n_field_name); }
+			, std::move(n_callback));
+}
+
+void AsyncClient::hget(const std::string &n_hash_name, const std::string &n_field_name, ReplyCallback &&n_callback) noexcept {
+
+	MOOSE_ASSERT(!d().m_connections.empty());
+
+	d().connection(n_hash_name).send(
+			[=](CommandBuffer &n_out) { format_hget(n_out, n_hash_name, n_field_name); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::hget(const std::string &n_hash_name, const std::string &n_field_name) noexcept {
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_hget(n_os, n_hash_name, n_field_name); })->get_future();
+	return d().connection(n_hash_name).send([=](CommandBuffer &n_out) { format_hget(n_out, n_hash_name, n_field_name); })->get_future();
 }
 
-void AsyncClient::hset(const std::string &n_hash_name, const std::string &n_field_name, const std::string &n_value, Callback &&n_callback) noexcept {
+void AsyncClient::hset(const std::string &n_hash_name, const std::string &n_field_name, std::string n_value, Callback &&n_callback) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_hash_name.empty());
 	MOOSE_ASSERT(!n_field_name.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_hset(n_os, n_hash_name, n_field_name, n_value); }
+	d().connection(n_hash_name).send(
+			[n_hash_name, n_field_name, value = std::move(n_value)](CommandBuffer &n_out) {
+				format_hset(n_out, n_hash_name, n_field_name, value);
+			}
 			, std::move(n_callback));
 }
 
-future_response AsyncClient::hset(const std::string &n_hash_name, const std::string &n_field_name, const std::string &n_value) noexcept {
+future_response AsyncClient::hset(const std::string &n_hash_name, const std::string &n_field_name, std::string n_value) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_hash_name.empty());
 	MOOSE_ASSERT(!n_field_name.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_hset(n_os, n_hash_name, n_field_name, n_value); })->get_future();
+	return d().connection(n_hash_name).send([n_hash_name, n_field_name, value = std::move(n_value)](CommandBuffer &n_out) {
+			format_hset(n_out, n_hash_name, n_field_name, value);
+		})->get_future();
 }
 
 void AsyncClient::hlen(const std::string &n_hash_name, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_hash_name.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_hlen(n_os, n_hash_name); }
+	d().connection(n_hash_name).send(
+			[=](CommandBuffer &n_out) { format_hlen(n_out, n_hash_name); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::hlen(const std::string &n_hash_name) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_hash_name.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_hlen(n_os, n_hash_name); })->get_future();
+	return d().connection(n_hash_name).send([=](CommandBuffer &n_out) { format_hlen(n_out, n_hash_name); })->get_future();
 }
 
 void AsyncClient::hdel(const std::string &n_hash_name, const std::string &n_field_name, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_hash_name.empty());
 	MOOSE_ASSERT(!n_field_name.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_hdel(n_os, n_hash_name, n_field_name); }
+	d().connection(n_hash_name).send(
+			[=](CommandBuffer &n_out) { format_hdel(n_out, n_hash_name, n_field_name); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::hdel(const std::string &n_hash_name, const std::string &n_field_name) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_hash_name.empty());
 	MOOSE_ASSERT(!n_field_name.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_hdel(n_os, n_hash_name, n_field_name); })->get_future();
+	return d().connection(n_hash_name).send([=](CommandBuffer &n_out) { format_hdel(n_out, n_hash_name, n_field_name); })->get_future();
 }
 
 void AsyncClient::hgetall(const std::string &n_hash_name, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
+	MOOSE_ASSERT(!n_hash_name.empty());
+
+	d().connection(n_hash_name).send(
+			[=](CommandBuffer &n_out) { format_hgetall(n_out, n_hash_name); }
+			, std::move(n_callback));
+}
+
+void AsyncClient::hgetall(const std::string &n_hash_name, ReplyCallback &&n_callback) noexcept {
+
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_hash_name.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_hgetall(n_os, n_hash_name); }
+	d().connection(n_hash_name).send(
+			[=](CommandBuffer &n_out) { format_hgetall(n_out, n_hash_name); }
 			, std::move(n_callback));
 }
 
+void AsyncClient::hgetall(const std::string &n_hash_name, ReplyStream &&n_stream) noexcept {
+
+	MOOSE_ASSERT(!d().m_connections.empty());
+	MOOSE_ASSERT(!n_hash_name.empty());
+
+	d().connection(n_hash_name).send(
+			[=](CommandBuffer &n_out) { format_hgetall(n_out, n_hash_name); }
+			, std::move(n_stream));
+}
+
 future_response AsyncClient::hgetall(const std::string &n_hash_name) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_hash_name.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_hgetall(n_os, n_hash_name); })->get_future();
+	return d().connection(n_hash_name).send([=](CommandBuffer &n_out) { format_hgetall(n_out, n_hash_name); })->get_future();
 }
 
 void AsyncClient::lpush(const std::string &n_list_name, const std::string &n_value, Callback &&n_callback) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_list_name.empty());
 	MOOSE_ASSERT(!n_value.empty());
 
-	d().m_main_connection->send(
-			[=] (std::ostream &n_os) { format_lpush(n_os, n_list_name, n_value); }
+	d().connection(n_list_name).send(
+			[=] (CommandBuffer &n_out) { format_lpush(n_out, n_list_name, n_value); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::lpush(const std::string &n_list_name, const std::string &n_value) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_list_name.empty());
 	MOOSE_ASSERT(!n_value.empty());
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) { format_lpush(n_os, n_list_name, n_value); })->get_future();
+	return d().connection(n_list_name).send([=] (CommandBuffer &n_out) { format_lpush(n_out, n_list_name, n_value); })->get_future();
 }
 
 void AsyncClient::rpush(const std::string &n_list_name, const std::string &n_value, Callback &&n_callback) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_list_name.empty());
 	MOOSE_ASSERT(!n_value.empty());
 
-	d().m_main_connection->send(
-			[=] (std::ostream &n_os) { format_rpush(n_os, n_list_name, n_value); }
+	d().connection(n_list_name).send(
+			[=] (CommandBuffer &n_out) { format_rpush(n_out, n_list_name, n_value); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::rpush(const std::string &n_list_name, const std::string &n_value) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT(!n_list_name.empty());
 	MOOSE_ASSERT(!n_value.empty());
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) { format_rpush(n_os, n_list_name, n_value); })->get_future();
+	return d().connection(n_list_name).send([=] (CommandBuffer &n_out) { format_rpush(n_out, n_list_name, n_value); })->get_future();
 }
 
 void AsyncClient::sadd(const std::string &n_set_name, const std::string &n_value, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_sadd(n_os, n_set_name, n_value); }
+	d().connection(n_set_name).send(
+			[=](CommandBuffer &n_out) { format_sadd(n_out, n_set_name, n_value); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::sadd(const std::string &n_set_name, const std::string &n_value) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_sadd(n_os, n_set_name, n_value); })->get_future();
+	return d().connection(n_set_name).send([=](CommandBuffer &n_out) { format_sadd(n_out, n_set_name, n_value); })->get_future();
 }
 
 void AsyncClient::scard(const std::string &n_set_name, Callback &&n_callback) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_scard(n_os, n_set_name); }
+	d().connection(n_set_name).send(
+			[=](CommandBuffer &n_out) { format_scard(n_out, n_set_name); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::scard(const std::string &n_set_name) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_scard(n_os, n_set_name); })->get_future();
+	return d().connection(n_set_name).send([=](CommandBuffer &n_out) { format_scard(n_out, n_set_name); })->get_future();
 }
 
 void AsyncClient::srem(const std::string &n_set_name, const std::string &n_value, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_srem(n_os, n_set_name, n_value); }
+	d().connection(n_set_name).send(
+			[=](CommandBuffer &n_out) { format_srem(n_out, n_set_name, n_value); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::srem(const std::string &n_set_name, const std::string &n_value) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_srem(n_os, n_set_name, n_value); })->get_future();
+	return d().connection(n_set_name).send([=](CommandBuffer &n_out) { format_srem(n_out, n_set_name, n_value); })->get_future();
 }
 
 void AsyncClient::srandmember(const std::string &n_set_name, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_srandmember(n_os, n_set_name); }
+	d().connection(n_set_name).send(
+			[=](CommandBuffer &n_out) { format_srandmember(n_out, n_set_name); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::srandmember(const std::string &n_set_name) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_srandmember(n_os, n_set_name); })->get_future();
+	return d().connection(n_set_name).send([=](CommandBuffer &n_out) { format_srandmember(n_out, n_set_name); })->get_future();
 }
 
 void AsyncClient::smembers(const std::string &n_set_name, Callback &&n_callback) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
+
+	d().connection(n_set_name).send(
+			[=](CommandBuffer &n_out) { format_smembers(n_out, n_set_name); }
+			, std::move(n_callback));
+}
+
+void AsyncClient::smembers(const std::string &n_set_name, ReplyStream &&n_stream) noexcept {
+	
+	MOOSE_ASSERT(!d().m_connections.empty());
+
+	d().connection(n_set_name).send(
+			[=](CommandBuffer &n_out) { format_smembers(n_out, n_set_name); }
+			, std::move(n_stream));
+}
+
+void AsyncClient::smembers(const std::string &n_set_name, ReplyCallback &&n_callback) noexcept {
+	
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_smembers(n_os, n_set_name); }
+	d().connection(n_set_name).send(
+			[=](CommandBuffer &n_out) { format_smembers(n_out, n_set_name); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::smembers(const std::string &n_set_name) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_smembers(n_os, n_set_name); })->get_future();
+	return d().connection(n_set_name).send([=](CommandBuffer &n_out) { format_smembers(n_out, n_set_name); })->get_future();
 }
 
 void AsyncClient::eval(const std::string &n_script, Callback &&n_callback) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-			[=] (std::ostream &n_os) { format_eval(n_os, n_script, std::vector<std::string>(), std::vector<std::string>()); }
+	d().connection().send(
+			[=] (CommandBuffer &n_out) { format_eval(n_out, n_script, std::vector<std::string>(), std::vector<std::string>()); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::eval(const std::string &n_script) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) {
-		format_eval(n_os, n_script, std::vector<std::string>(), std::vector<std::string>()); })->get_future();
+	return d().connection().send([=] (CommandBuffer &n_out) {
+		format_eval(n_out, n_script, std::vector<std::string>(), std::vector<std::string>()); })->get_future();
 }
 
 void AsyncClient::eval(const std::string &n_script, const std::vector<std::string> &n_args, Callback &&n_callback) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
 	std::vector<std::string> keys;
 
-	d().m_main_connection->send(
-			[=] (std::ostream &n_os) { format_eval(n_os, n_script, keys, n_args); }
+	d().connection().send(
+			[=] (CommandBuffer &n_out) { format_eval(n_out, n_script, keys, n_args); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::eval(const std::string &n_script, const std::vector<std::string> &n_args) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
 	std::vector<std::string> keys;
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) { format_eval(n_os, n_script, keys, n_args); })->get_future();
+	return d().connection().send([=] (CommandBuffer &n_out) { format_eval(n_out, n_script, keys, n_args); })->get_future();
 }
 
 void AsyncClient::eval(const std::string &n_script, const std::vector<std::string> &n_keys,
 		const std::vector<std::string> &n_args, Callback &&n_callback) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-			[=] (std::ostream &n_os) { format_eval(n_os, n_script, n_keys, n_args); }
+	d().connection(n_keys).send(
+			[=] (CommandBuffer &n_out) { format_eval(n_out, n_script, n_keys, n_args); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::eval(const std::string &n_script, const std::vector<std::string> &n_keys,
 		const std::vector<std::string> &n_args) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) { format_eval(n_os, n_script, n_keys, n_args); })->get_future();
+	return d().connection(n_keys).send([=] (CommandBuffer &n_out) { format_eval(n_out, n_script, n_keys, n_args); })->get_future();
 }
 
 void AsyncClient::evalsha(const std::string &n_sha, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT_MSG(!n_sha.empty(), "Must not give empty hash into svalsha()");
 
-	d().m_main_connection->send(
-	        [=] (std::ostream &n_os) { format_evalsha(n_os, n_sha, std::vector<std::string>(), std::vector<std::string>()); }
+	d().connection().send(
+	        [=] (CommandBuffer &n_out) { format_evalsha(n_out, n_sha, std::vector<std::string>(), std::vector<std::string>()); }
 	        , std::move(n_callback));
 }
 
 future_response AsyncClient::evalsha(const std::string &n_sha) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT_MSG(!n_sha.empty(), "Must not give empty hash into svalsha()");
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) {
-		format_evalsha(n_os, n_sha, std::vector<std::string>(), std::vector<std::string>()); })->get_future();
+	return d().connection().send([=] (CommandBuffer &n_out) {
+		format_evalsha(n_out, n_sha, std::vector<std::string>(), std::vector<std::string>()); })->get_future();
 }
 
 void AsyncClient::evalsha(const std::string &n_sha, const std::vector<std::string> &n_args, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT_MSG(!n_sha.empty(), "Must not give empty hash into svalsha()");
 
 	std::vector<std::string> keys;
 
-	d().m_main_connection->send(
-	        [=] (std::ostream &n_os) { format_evalsha(n_os, n_sha, keys, n_args); }
+	d().connection().send(
+	        [=] (CommandBuffer &n_out) { format_evalsha(n_out, n_sha, keys, n_args); }
 	        , std::move(n_callback));
 }
 
 future_response AsyncClient::evalsha(const std::string &n_sha, const std::vector<std::string> &n_args) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT_MSG(!n_sha.empty(), "Must not give empty hash into svalsha()");
 
 	std::vector<std::string> keys;
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) { format_evalsha(n_os, n_sha, keys, n_args); })->get_future();
+	return d().connection().send([=] (CommandBuffer &n_out) { format_evalsha(n_out, n_sha, keys, n_args); })->get_future();
 }
 
 void AsyncClient::evalsha(const std::string &n_sha, const std::vector<std::string> &n_keys,
         const std::vector<std::string> &n_args, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT_MSG(!n_sha.empty(), "Must not give empty hash into svalsha()");
 
-	d().m_main_connection->send(
-	        [=] (std::ostream &n_os) { format_evalsha(n_os, n_sha, n_keys, n_args); }
+	d().connection(n_keys).send(
+	        [=] (CommandBuffer &n_out) { format_evalsha(n_out, n_sha, n_keys, n_args); }
 	        , std::move(n_callback));
 }
 
 future_response AsyncClient::evalsha(const std::string &n_sha, const std::vector<std::string> &n_keys,
         const std::vector<std::string> &n_args) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 	MOOSE_ASSERT_MSG(!n_sha.empty(), "Must not give empty hash into svalsha()");
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) { format_evalsha(n_os, n_sha, n_keys, n_args); })->get_future();
+	return d().connection(n_keys).send([=] (CommandBuffer &n_out) { format_evalsha(n_out, n_sha, n_keys, n_args); })->get_future();
 }
 
 void AsyncClient::script_load(const std::string &n_script, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-	        [=] (std::ostream &n_os) { format_script_load(n_os, n_script); }
+	d().connection().send(
+	        [=] (CommandBuffer &n_out) { format_script_load(n_out, n_script); }
 	        , std::move(n_callback));
 }
 
 future_response AsyncClient::script_load(const std::string &n_script) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) { format_script_load(n_os, n_script); })->get_future();
+	return d().connection().send([=] (CommandBuffer &n_out) { format_script_load(n_out, n_script); })->get_future();
 }
 
 boost::uint64_t AsyncClient::subscribe(const std::string &n_channel_name, MessageCallback &&n_callback) {
 
+	if (d().m_protocol == RespVersion::RESP3) {
+		MOOSE_ASSERT(!d().m_connections.empty());
+
+		boost::uint64_t id = 0;
+		std::shared_ptr<boost::promise<bool> > confirmed(std::make_shared<boost::promise<bool> >());
+		boost::unique_future<bool> retval = confirmed->get_future();
+
+		{
+			boost::unique_lock<boost::mutex> slock(d().m_message_handlers_lock);
+			
+			// find a random ID that isn't used yet
+			bool duplicate;
+			do {
+				id = tools::urand();
+				duplicate = false;
+				for (const std::map<std::string, AsyncClientMembers::SubscriptionMap>::value_type &channel : d().m_message_handlers) {
+					if (channel.second.count(id)) {
+						duplicate = true;
+						break;
+					}
+				}
+			} while (duplicate || (id == 0));
+
+			d().m_message_handlers[n_channel_name][id] = std::move(n_callback);
+			d().m_pending_confirms.emplace(n_channel_name, confirmed);
+		}
+
+		// The server confirms by push, not by response. Hence no callback
+		d().m_connections.front()->send_no_reply([=](CommandBuffer &n_out) { format_subscribe(n_out, n_channel_name); });
+
+		if (retval.wait_for(boost::chrono::seconds(MRedisConnection::MREDIS_READ_TIMEOUT)) != boost::future_status::ready) {
+			bool last_handler = false;
+			{
+				boost::unique_lock<boost::mutex> slock(d().m_message_handlers_lock);
+				const std::map<std::string, AsyncClientMembers::SubscriptionMap>::iterator channel = d().m_message_handlers.find(n_channel_name);
+				if (channel != d().m_message_handlers.end()) {
+					channel->second.erase(id);
+					if (channel->second.empty()) {
+						d().m_message_handlers.erase(channel);
+						last_handler = true;
+					}
+				}
+
+				const auto confirms = d().m_pending_confirms.equal_range(n_channel_name);
+				for (auto i = confirms.first; i != confirms.second; ++i) {
+					if (i->second == confirmed) {
+						d().m_pending_confirms.erase(i);
+						break;
+					}
+				}
+			}
+
+			// The confirmation may be late. Nobody would take the messages that follow it
+			if (last_handler) {
+				d().m_connections.front()->send_no_reply([=](CommandBuffer &n_out) { format_unsubscribe(n_out, n_channel_name); });
+			}
+
+			BOOST_THROW_EXCEPTION(redis_error()
+					<< error_message("Subscription was not confirmed in time")
+					<< error_argument(n_channel_name));
+		}
+
+		BOOST_LOG_SEV(logger(), normal) << "Subscribed to channel '" << n_channel_name << "' with id " << id;
+		return id;
+	}
+
 	MOOSE_ASSERT(d().m_pubsub_connection);
 
 	boost::uint64_t id = 0;
@@ -722,6 +1236,42 @@ boost::uint64_t AsyncClient::subscribe(const std::string &n_channel_name, Messag
 
 void AsyncClient::unsubscribe(const boost::uint64_t n_subscription) noexcept {
 
+	if (d().m_protocol == RespVersion::RESP3) {
+		MOOSE_ASSERT(!d().m_connections.empty());
+
+		std::string channel_name;
+		bool last_handler = false;
+
+		{
+			boost::unique_lock<boost::mutex> slock(d().m_message_handlers_lock);
+			for (std::map<std::string, AsyncClientMembers::SubscriptionMap>::value_type &channel : d().m_message_handlers) {
+				if (channel.second.erase(n_subscription)) {
+					channel_name = channel.first;
+					last_handler = channel.second.empty();
+					break;
+				}
+			}
+
+			if (last_handler) {
+				d().m_message_handlers.erase(channel_name);
+			}
+		}
+
+		if (channel_name.empty()) {
+			BOOST_LOG_SEV(logger(), warning) << "Could not un-subscribe id " << n_subscription << ", not found";
+			return;
+		}
+
+		// Other handlers still listen to that channel
+		if (!last_handler) {
+			return;
+		}
+
+		BOOST_LOG_SEV(logger(), normal) << "Unsubscribing from " << channel_name;
+		d().m_connections.front()->send_no_reply([=](CommandBuffer &n_out) { format_unsubscribe(n_out, channel_name); });
+		return;
+	}
+
 	MOOSE_ASSERT(d().m_pubsub_connection);
 
 	try {
@@ -739,38 +1289,100 @@ void AsyncClient::unsubscribe(const boost::uint64_t n_subscription) noexcept {
 
 future_response AsyncClient::publish(const std::string &n_channel_name, const std::string &n_message) noexcept {
 	
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=] (std::ostream &n_os) { format_publish(n_os, n_channel_name, n_message); })->get_future();
+	return d().connection().send([=] (CommandBuffer &n_out) { format_publish(n_out, n_channel_name, n_message); })->get_future();
 }
 
 void AsyncClient::debug_sleep(const boost::int64_t n_seconds, Callback &&n_callback) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	d().m_main_connection->send(
-			[=](std::ostream &n_os) { format_debug_sleep(n_os, n_seconds); }
+	d().connection().send(
+			[=](CommandBuffer &n_out) { format_debug_sleep(n_out, n_seconds); }
 			, std::move(n_callback));
 }
 
 future_response AsyncClient::debug_sleep(const boost::int64_t n_seconds) noexcept {
 
-	MOOSE_ASSERT(d().m_main_connection);
+	MOOSE_ASSERT(!d().m_connections.empty());
 
-	return d().m_main_connection->send([=](std::ostream &n_os) { format_debug_sleep(n_os, n_seconds); })->get_future();
+	return d().connection().send([=](CommandBuffer &n_out) { format_debug_sleep(n_out, n_seconds); })->get_future();
 }
 
 boost::asio::io_context &AsyncClient::io_context() noexcept {
 
-	return d().m_io_context;
+	return *d().m_io_context;
+}
+
+void AsyncClient::handle_push(const RedisMessage &n_push) {
+
+	const RedisPush &push = boost::get<RedisPush>(n_push);
+
+	// pubsub pushes look like [kind, channel, payload]
+	if ((push.m_elements.size() == 3) && is_string(push.m_elements[0]) && is_string(push.m_elements[1])) {
+
+		const std::string &kind = boost::get<std::string>(push.m_elements[0]);
+		const std::string &channel_name = boost::get<std::string>(push.m_elements[1]);
+
+		if (boost::algorithm::equals(kind, "message") && is_string(push.m_elements[2])) {
+			const std::string &message = boost::get<std::string>(push.m_elements[2]);
+
+			boost::unique_lock<boost::mutex> slock(d().m_message_handlers_lock);
+			const std::map<std::string, AsyncClientMembers::SubscriptionMap>::const_iterator channel = d().m_message_handlers.find(channel_name);
+			if (channel != d().m_message_handlers.cend()) {
+				// One that throws must not keep the message from the others
+				for (const AsyncClientMembers::SubscriptionMap::value_type &handler : channel->second) {
+					try {
+						handler.second(message);
+					} catch (const std::exception &sex) {
+						BOOST_LOG_SEV(logger(), error) << "Subscribed (no-throw) handler for channel '" << channel_name
+							<< "' threw an exception: " << sex.what();
+					} catch (...) {
+						BOOST_LOG_SEV(logger(), error) << "Subscribed (no-throw) handler for channel '" << channel_name
+							<< "' threw an unknown exception";
+					}
+				}
+			}
+			return;
+		}
+
+		if (boost::algorithm::equals(kind, "subscribe")) {
+			// This confirms everyone who waits for this channel. MREDIS_WAKEUP has nobody waiting
+			boost::unique_lock<boost::mutex> slock(d().m_message_handlers_lock);
+			const auto confirms = d().m_pending_confirms.equal_range(channel_name);
+			for (auto i = confirms.first; i != confirms.second; ++i) {
+				i->second->set_value(true);
+			}
+			d().m_pending_confirms.erase(confirms.first, confirms.second);
+			return;
+		}
+
+		if (boost::algorithm::equals(kind, "unsubscribe")) {
+			return;
+		}
+	}
+
+	if (d().m_push_handler) {
+		try {
+			d().m_push_handler(n_push);
+		} catch (const std::exception &sex) {
+			BOOST_LOG_SEV(logger(), error) << "Push (no-throw) handler threw an exception: " << sex.what();
+		} catch (...) {
+			BOOST_LOG_SEV(logger(), error) << "Push (no-throw) handler threw an unknown exception";
+		}
+	}
 }
 
 void AsyncClient::release_connection(MRedisConnection *n_connection) noexcept {
 
-	if (d().m_main_connection.get() == n_connection) {
+	const std::vector<std::unique_ptr<MRedisConnection> >::const_iterator pooled = std::find_if(d().m_connections.cbegin(), d().m_connections.cend(),
+			[n_connection](const std::unique_ptr<MRedisConnection> &n_pooled) { return n_pooled.get() == n_connection; });
+
+	if (pooled != d().m_connections.cend()) {
 
-		BOOST_LOG_SEV(logger(), warning) << "Main server connection notified it is not working anymore";
-		d().m_main_connection.reset();
+		// Other threads may be picking it right now. It stays in the pool and reconnects when used again
+		BOOST_LOG_SEV(logger(), warning) << "Server connection notified it is not working anymore";
 
 		// I thought about re-connecting right away but decided to do it on demand.
 		// Reason is that whatever caused the connection to drop is very likely still the case,
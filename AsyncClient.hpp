@@ -8,13 +8,21 @@
 #include "FwdDeclarations.hpp"
 #include "MRedisResult.hpp"
 #include "MRedisTypes.hpp"
+#include "RespTape.hpp"
+#include "RespWriter.hpp"
+#include "ReplyDecoder.hpp"
 
 #include "tools/Pimpled.hpp"
 
 #include <boost/cstdint.hpp>
 #include <boost/asio/io_context.hpp>
 
+#include <functional>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 namespace moose {
@@ -22,6 +30,33 @@ namespace mredis {
 
 struct AsyncClientMembers;
 
+/*! @brief requests this thread makes while this lives time out n_timeout after they were
+	made, instead of after the client's request timeout. c_invalid_duration means never.
+	Nest them, the innermost counts.
+
+	@code
+	ScopedTimeout deadline(std::chrono::milliseconds(20));
+	future_response value = client.get("key");
+	@endcode
+
+	@see AsyncClient::set_request_timeout()
+ */
+class ScopedTimeout {
+
+	public:
+		MREDIS_API explicit ScopedTimeout(const Duration &n_timeout) noexcept;
+		ScopedTimeout(const ScopedTimeout &) = delete;
+		ScopedTimeout &operator=(const ScopedTimeout &) = delete;
+		MREDIS_API ~ScopedTimeout() noexcept;
+
+		//! @return the innermost timeout of this thread, nullptr if there is none
+		MREDIS_API static const Duration *current() noexcept;
+
+	private:
+		const Duration        m_timeout;
+		const ScopedTimeout  *m_outer;
+};
+
 /*! @brief simple async Redis client.
 	And yes, I know. Classes that are described as "simple" generally turn out to be
 	not simple at all or broken or both. Let's call it 'incomplete' instead 
@@ -31,22 +66,42 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 
 	public:
 		
-		//! use local unix domain socket
-		//! @note not implemented
+		//! use local unix domain socket at /run/redis.sock, where redis.conf suggests it
 		MREDIS_API AsyncClient();
 
 		/*! use IP to do TCP connect
+			@param n_io_threads how many threads run the connections. Each connection is only ever 
+				handled by one of them at a time, so more than one only helps with set_connections()
 			@note asserts on empty server
 		 */
-		MREDIS_API AsyncClient(const std::string &n_server, const boost::uint16_t n_port = 6379);
+		MREDIS_API AsyncClient(const std::string &n_server, const boost::uint16_t n_port = 6379, const unsigned int n_io_threads = 1);
+
+		/*! use IP to do TCP connect in an io_context you own and run. No threads of our own,
+			callbacks are executed in whichever of yours runs the io_context
+			@note keep it running until the client is destroyed. connect() blocks until it ran the
+				connect handlers, don't call it from within. Use async_connect() there
+			@note asserts on empty server
+		 */
+		MREDIS_API AsyncClient(boost::asio::io_context &n_io_context, const std::string &n_server, const boost::uint16_t n_port = 6379);
+
+		/*! use a unix domain socket. Cheaper than TCP over loopback when redis runs on the same host.
+			Pipelining, pubsub and reconnects work the same
+			@param n_io_threads see TCP constructor
+			@note asserts on empty path. Connect fails on platforms without unix domain sockets
+		 */
+		MREDIS_API explicit AsyncClient(const UnixSocket &n_socket, const unsigned int n_io_threads = 1);
+
+		//! unix domain socket in an io_context you own and run. See TCP constructor
+		MREDIS_API AsyncClient(boost::asio::io_context &n_io_context, const UnixSocket &n_socket);
 
 		MREDIS_API virtual ~AsyncClient() noexcept;
 
 		/*! @brief sync connect and block until connected
 			@note if already connected, will re-connect
-			@throw network_error on cannot resolve host name or connection timeout
+			@param n_version with RESP3, HELLO 3 is sent and pubsub runs over the main connection
+			@throw network_error on cannot resolve host name or connection timeout or if the server can't do RESP3
 		 */
-		MREDIS_API void connect();
+		MREDIS_API void connect(const RespVersion n_version = RespVersion::RESP2);
 
 		/*! @brief start async connect, return immediately
 			Once connected, returned future will turn true for OK or false for not OK
@@ -54,9 +109,97 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 
 			will not throw but the resulting future will, if connection timed out
 
+			@param n_version with RESP3, HELLO 3 is sent and pubsub runs over the main connection
+
 			@throw network_error on cannot resolve host name or connection timeout
 		 */
-		MREDIS_API boost::shared_future<bool> async_connect();
+		MREDIS_API boost::shared_future<bool> async_connect(const RespVersion n_version = RespVersion::RESP2);
+
+		/*! @brief get RESP3 push messages that are not pubsub messages, like client tracking invalidations
+			@note set before connect. Only RESP3 connections receive them
+			@param n_handler must be no-throw, will not be executed in caller's thread.
+				With more than one io thread and connection it may be called concurrently
+		 */
+		MREDIS_API void set_push_handler(Callback &&n_handler) noexcept;
+
+		/*! @brief values of at least n_threshold bytes are not copied into the send buffer
+				but written from where they are. 0 copies everything, other values below
+				c_min_reference_size are raised to it.
+			@note set before connect. Default is MRedisConnection::MREDIS_SCATTER_THRESHOLD
+		 */
+		MREDIS_API void set_scatter_threshold(const std::size_t n_threshold) noexcept;
+
+		/*! @brief open n_connections to the server instead of one
+			Every request goes to the connection with the fewest requests waiting for an answer,
+			so one slow command doesn't hold up all the others. All of them are opened at connect.
+			Requests are only executed in the order they were made if they go through the
+			same connection. See set_key_affinity() if you need that.
+			@note set before connect. Default is 1
+		 */
+		MREDIS_API void set_connections(const std::size_t n_connections) noexcept;
+
+		/*! @brief requests for the same key always go through the same connection
+			and are executed in the order they were made. Commands with many keys go by the first.
+			Generic commands go by their first argument unless it's a number.
+			Commands without a key are still balanced.
+			@note set before connect. Off by default
+		 */
+		MREDIS_API void set_key_affinity(const bool n_affinity) noexcept;
+
+		/*! @brief every request that isn't answered n_timeout after it was made fails with
+			a redis_error. The connection stays up, the answer is dropped when it comes.
+			Requests that didn't go out yet are not sent anymore. Only a server that doesn't
+			answer requests without a deadline for MREDIS_READ_TIMEOUT seconds is reconnected to.
+			Use a ScopedTimeout to give single requests another one.
+			@note set before connect. Default is c_invalid_duration, which means none
+		 */
+		MREDIS_API void set_request_timeout(const Duration &n_timeout) noexcept;
+
+		/*! @brief limit what may wait on each connection, so a stalled server doesn't have 
+				requests pile up without end. When a limit is reached, n_policy decides
+			@param n_max_requests queued or waiting for an answer. 0 for no limit
+			@param n_max_bytes of commands not written yet. 0 for no limit
+			@param n_policy fail the request, block the caller or yield until there is room.
+				Requests made in callbacks are always let through
+			@param n_yield with Backpressure::Yield, called until there is room. 
+				Like boost::this_fiber::yield. Without one it blocks like Backpressure::Block
+			@note set before connect. No limits by default
+		 */
+		MREDIS_API void set_backpressure(const std::size_t n_max_requests, 
+		                                 const std::size_t n_max_bytes = 0,
+		                                 const Backpressure n_policy = Backpressure::Fail,
+		                                 std::function<void()> &&n_yield = std::function<void()>()) noexcept;
+
+		/*! @brief how each connection batches its writes. Linger a little to have more
+				commands go out in one write, at the cost of latency. Adaptive lingers only 
+				while the server has earlier requests to answer, which costs nothing when
+				it is idle. Also sets TCP_NODELAY and the send buffer size
+			@note set before connect. By default, writes go out as soon as the last is done
+		 */
+		MREDIS_API void set_flush_policy(const FlushPolicy &n_policy) noexcept;
+
+		/*! @brief host names are looked up without blocking any thread. Reconnects use the
+				addresses of the last lookup for n_ttl and only look it up again after that,
+				or when they can't connect to them.
+			@note set before connect. Default is 60 seconds
+		 */
+		MREDIS_API void set_resolve_ttl(const Duration &n_ttl) noexcept;
+
+		/*! @brief a connection that lost its server tries again after pauses that double up to
+				a maximum, randomly shortened so not all clients come back at once. When it can't
+				get through in time, its circuit opens: requests fail right away instead of waiting
+				while the attempts go on. See ReconnectPolicy
+			@note set before connect
+		 */
+		MREDIS_API void set_reconnect_policy(const ReconnectPolicy &n_policy) noexcept;
+
+		/*! @brief requests made that are not answered yet, on all connections.
+			May be outdated by the time you look but good enough to shed load
+		 */
+		MREDIS_API std::size_t pending() noexcept;
+
+		//! bytes of commands not written yet, on all connections. See pending()
+		MREDIS_API std::size_t queued_bytes() noexcept;
 
 
 		/*! @defgroup basic functions
@@ -72,6 +215,14 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 		 */
 		MREDIS_API void get(const std::string &n_key, Callback &&n_callback) noexcept;
 
+		/*! @brief most basic get, zero-copy
+			@param n_key assert on empty
+			@param n_callback gets a reply pointing into the receive buffer, must be no-throw, 
+				will not be executed in caller's thread
+			@see https://redis.io/commands/get
+		 */
+		MREDIS_API void get(const std::string &n_key, ReplyCallback &&n_callback) noexcept;
+
 		/*! @brief most basic get
 			@param n_key assert on empty
 			@returns future which will hold response, may also hold exception
@@ -86,6 +237,22 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 		 */
 		MREDIS_API void mget(const std::vector<std::string> &n_keys, Callback &&n_callback) noexcept;
 
+		/*! @brief basic bulk get, zero-copy
+			@param n_keys assert on empty
+			@param n_callback gets a reply pointing into the receive buffer, must be no-throw, 
+				will not be executed in caller's thread
+			@see https://redis.io/commands/mget
+		 */
+		MREDIS_API void mget(const std::vector<std::string> &n_keys, ReplyCallback &&n_callback) noexcept;
+
+		/*! @brief basic bulk get, element by element
+			@param n_keys assert on empty
+			@param n_stream gets the values one by one as they come in, must be no-throw, 
+				will not be executed in caller's thread
+			@see https://redis.io/commands/mget
+		 */
+		MREDIS_API void mget(const std::vector<std::string> &n_keys, ReplyStream &&n_stream) noexcept;
+
 		/*! @brief basic bulk get
 			@param n_keys assert on empty
 			@returns future which will holds an array of strings or nil values, may also hold exception
@@ -95,28 +262,28 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 
 		/*! @brief set with a vengeance
 			@param n_key assert on empty
-			@param n_value may be binary
+			@param n_value may be binary. Move large values in, they are sent from where they are
 			@param n_callback must be no-throw, will not be executed in caller's thread
 			@param n_expire_time will only be set if not c_invalid_duration. Uses second precision to not fool around
 			@param n_condition optional set condition
 			@see https://redis.io/commands/set
 		*/
 		MREDIS_API void set(const std::string &n_key,
-		                    const std::string &n_value,
+		                    std::string n_value,
 		                    Callback &&n_callback, 
 		                    const Duration &n_expire_time = c_invalid_duration,
 		                    const SetCondition n_condition = SetCondition::NONE) noexcept;
 
 		/*! @brief set with a vengeance
 			@param n_key throw on empty
-			@param n_value may be binary
+			@param n_value may be binary. Move large values in, they are sent from where they are
 			@param n_expire_time will only be set if not c_invalid_duration. Uses second precision to not fool around
 			@param n_condition optional set condition
 			@returns future which will hold response, may also hold exception
 			@see https://redis.io/commands/set
 		*/
 		MREDIS_API future_response set(const std::string &n_key,
-		                               const std::string &n_value,
+		                               std::string n_value,
 		                               const Duration &n_expire_time = c_invalid_duration,
 		                               const SetCondition n_condition = SetCondition::NONE) noexcept;
 
@@ -172,6 +339,13 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 		 */
 		MREDIS_API void incr(const std::string &n_key, Callback &&n_callback) noexcept;
 
+		/*! @brief field increment by 1, zero-copy
+			@param n_key assert on empty
+			@param n_callback must be no-throw, will not be executed in caller's thread
+			@see https://redis.io/commands/incr
+		 */
+		MREDIS_API void incr(const std::string &n_key, ReplyCallback &&n_callback) noexcept;
+
 		/*! @brief field increment by 1
 			@param n_key assert on empty
 			@returns future which will hold response, may also hold exception
@@ -186,6 +360,13 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 		 */
 		MREDIS_API void decr(const std::string &n_key, Callback &&n_callback) noexcept;
 
+		/*! @brief field decrement by 1, zero-copy
+			@param n_key assert on empty
+			@param n_callback must be no-throw, will not be executed in caller's thread
+			@see https://redis.io/commands/decr
+		 */
+		MREDIS_API void decr(const std::string &n_key, ReplyCallback &&n_callback) noexcept;
+
 		/*! @brief field decrement by 1
 			@param n_key assert on empty
 			@returns future which will hold response, may also hold exception
@@ -230,6 +411,17 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 		MREDIS_API void hget(const std::string &n_hash_name,
 		                        const std::string &n_field_name,
 		                        Callback &&n_callback) noexcept;
+
+		/*! @brief hash map field get, zero-copy
+			@param n_hash_name assert on empty
+			@param n_field_name 
+			@param n_callback gets a reply pointing into the receive buffer, must be no-throw, 
+				will not be executed in caller's thread
+			@see https://redis.io/commands/hget
+		*/
+		MREDIS_API void hget(const std::string &n_hash_name,
+		                        const std::string &n_field_name,
+		                        ReplyCallback &&n_callback) noexcept;
 	
 		/*! @brief hash map field get
 			@param n_hash_name assert on empty
@@ -243,25 +435,25 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 		/*! @brief hash map field setter
 			@param n_hash_name assert on empty
 			@param n_field_name assert on empty
-			@param n_value whatever you want to set as value
+			@param n_value whatever you want to set as value. Move large values in
 			@param n_callback must be no-throw, will not be executed in caller's thread
 			@see https://redis.io/commands/hset
 		 */
 		MREDIS_API void hset(const std::string &n_hash_name,
 		                        const std::string &n_field_name,
-		                        const std::string &n_value,
+		                        std::string n_value,
 		                        Callback &&n_callback) noexcept;
 
 		/*! @brief hash map field setter
 			@param n_hash_name assert on empty
 			@param n_field_nameassert on empty
-			@param n_value whatever you want to set as value
+			@param n_value whatever you want to set as value. Move large values in
 			@returns future which will hold response, may also hold exception
 			@see https://redis.io/commands/hset
 		 */
 		MREDIS_API future_response hset(const std::string &n_hash_name,
 		                        const std::string &n_field_name,
-		                        const std::string &n_value) noexcept;
+		                        std::string n_value) noexcept;
 
 		/*! @brief get the number of items in a hash
 			@param n_hash_name assert on empty
@@ -303,6 +495,22 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 		 */
 		MREDIS_API void hgetall(const std::string &n_hash_name, Callback &&n_callback) noexcept;
 
+		/*! @brief get all members of a hash map, zero-copy
+			@param n_hash_name assert on empty
+			@param n_callback gets a reply pointing into the receive buffer, must be no-throw, 
+				will not be executed in caller's thread
+			@see https://redis.io/commands/hgetall
+		 */
+		MREDIS_API void hgetall(const std::string &n_hash_name, ReplyCallback &&n_callback) noexcept;
+
+		/*! @brief get all members of a hash map, element by element
+			@param n_hash_name assert on empty
+			@param n_stream gets fields and values alternating as they come in, must be no-throw, 
+				will not be executed in caller's thread
+			@see https://redis.io/commands/hgetall
+		 */
+		MREDIS_API void hgetall(const std::string &n_hash_name, ReplyStream &&n_stream) noexcept;
+
 		/*! @brief get all members of a hash map
 			@param n_hash_name assert on empty
 			@returns future with an array twice the size of the hash, each member is followed by its value
@@ -438,6 +646,23 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 		 */
 		MREDIS_API void smembers(const std::string &n_set_name,	Callback &&n_callback) noexcept;
 
+		/*! @brief get all members of a set, element by element
+			Use this for large sets, they never have to be in memory as a whole
+			@param n_set_name the name of your set
+			@param n_stream gets the members one by one as they come in, must be no-throw, 
+				will not be executed in caller's thread
+			@see https://redis.io/commands/smembers
+		 */
+		MREDIS_API void smembers(const std::string &n_set_name, ReplyStream &&n_stream) noexcept;
+
+		/*! @brief get all members of a set, zero-copy
+			@param n_set_name the name of your set
+			@param n_callback gets a reply pointing into the receive buffer, must be no-throw, 
+				will not be executed in caller's thread
+			@see https://redis.io/commands/smembers
+		 */
+		MREDIS_API void smembers(const std::string &n_set_name, ReplyCallback &&n_callback) noexcept;
+
 		/*! @brief get all members of a set
 			@param n_set_name the name of your set
 
@@ -577,6 +802,134 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 		/*! @} */
 
 
+		/*! @defgroup typed functions
+			The reply is decoded right into the type you ask for, like
+			get<std::optional<std::string>>("key") or hgetall<std::map<std::string, int>>("hash").
+			See ReplyDecoder.hpp for the types that work.
+			The future holds a redis_error if the server returned one or the reply doesn't fit.
+			They all assert when connect wasn't called.
+			@{
+		*/
+
+		//! @see https://redis.io/commands/get
+		template <typename T>
+		boost::unique_future<T> get(const std::string &n_key) noexcept {
+
+			std::shared_ptr<boost::promise<T> > promise = std::make_shared<boost::promise<T> >();
+			get(n_key, decoding_responder(promise));
+			return promise->get_future();
+		}
+
+		//! @see https://redis.io/commands/mget
+		template <typename T>
+		boost::unique_future<T> mget(const std::vector<std::string> &n_keys) noexcept {
+
+			std::shared_ptr<boost::promise<T> > promise = std::make_shared<boost::promise<T> >();
+			mget(n_keys, decoding_responder(promise));
+			return promise->get_future();
+		}
+
+		//! @see https://redis.io/commands/incr
+		template <typename T>
+		boost::unique_future<T> incr(const std::string &n_key) noexcept {
+
+			std::shared_ptr<boost::promise<T> > promise = std::make_shared<boost::promise<T> >();
+			incr(n_key, decoding_responder(promise));
+			return promise->get_future();
+		}
+
+		//! @see https://redis.io/commands/decr
+		template <typename T>
+		boost::unique_future<T> decr(const std::string &n_key) noexcept {
+
+			std::shared_ptr<boost::promise<T> > promise = std::make_shared<boost::promise<T> >();
+			decr(n_key, decoding_responder(promise));
+			return promise->get_future();
+		}
+
+		//! @see https://redis.io/commands/hget
+		template <typename T>
+		boost::unique_future<T> hget(const std::string &n_hash_name, const std::string &n_field_name) noexcept {
+
+			std::shared_ptr<boost::promise<T> > promise = std::make_shared<boost::promise<T> >();
+			hget(n_hash_name, n_field_name, decoding_responder(promise));
+			return promise->get_future();
+		}
+
+		//! @see https://redis.io/commands/hgetall
+		template <typename T>
+		boost::unique_future<T> hgetall(const std::string &n_hash_name) noexcept {
+
+			std::shared_ptr<boost::promise<T> > promise = std::make_shared<boost::promise<T> >();
+			hgetall(n_hash_name, decoding_responder(promise));
+			return promise->get_future();
+		}
+
+		//! @see https://redis.io/commands/smembers
+		template <typename T>
+		boost::unique_future<T> smembers(const std::string &n_set_name) noexcept {
+
+			std::shared_ptr<boost::promise<T> > promise = std::make_shared<boost::promise<T> >();
+			smembers(n_set_name, decoding_responder(promise));
+			return promise->get_future();
+		}
+
+		/*! @} */
+
+
+		/*! @defgroup generic commands
+			Any command with any arguments, for everything there is no function for.
+			Arguments can be strings, string views, integers and floating point numbers.
+			They are written the same way the built-in commands are, the array header and
+			the name's length being computed at compile time.
+
+			client.command("ZADD", "scores", 1.5, "me") or
+			client.command<boost::int64_t>("ZCARD", "scores")
+
+			With key affinity the first argument is taken for the key, which it is for most commands.
+
+			@param n_name the command. Must be a string literal
+			They all assert when connect wasn't called.
+			@{
+		*/
+
+		//! @param n_callback must be no-throw, will not be executed in caller's thread
+		template <std::size_t N, typename... Args>
+		void command(Callback &&n_callback, const char (&n_name)[N], Args &&...n_arguments) noexcept {
+
+			const std::optional<std::size_t> key = command_key(n_arguments...);
+			send_command(key, prepare_command(n_name, std::forward<Args>(n_arguments)...), std::move(n_callback));
+		}
+
+		//! @param n_callback gets a zero-copy reply. Must be no-throw, will not be executed in caller's thread
+		template <std::size_t N, typename... Args>
+		void command(ReplyCallback &&n_callback, const char (&n_name)[N], Args &&...n_arguments) noexcept {
+
+			const std::optional<std::size_t> key = command_key(n_arguments...);
+			send_command(key, prepare_command(n_name, std::forward<Args>(n_arguments)...), std::move(n_callback));
+		}
+
+		//! @returns future which will hold response, may also hold exception
+		template <std::size_t N, typename... Args>
+		future_response command(const char (&n_name)[N], Args &&...n_arguments) noexcept {
+
+			const std::optional<std::size_t> key = command_key(n_arguments...);
+			return send_command(key, prepare_command(n_name, std::forward<Args>(n_arguments)...));
+		}
+
+		//! @returns future with the reply decoded into T, @see typed functions
+		template <typename T, std::size_t N, typename... Args>
+		boost::unique_future<T> command(const char (&n_name)[N], Args &&...n_arguments) noexcept {
+
+			std::shared_ptr<boost::promise<T> > promise = std::make_shared<boost::promise<T> >();
+			const std::optional<std::size_t> key = command_key(n_arguments...);
+			send_command(key, prepare_command(n_name, std::forward<Args>(n_arguments)...), decoding_responder(promise));
+			return promise->get_future();
+		}
+
+		/*! @} */
+
+
 		/*! @defgroup pub/sub functions
 			Subcribe to channels and publish messages upon them
 			@{
@@ -653,6 +1006,44 @@ class AsyncClient : private moose::tools::Pimpled<AsyncClientMembers> {
 
 		boost::asio::io_context &io_context() noexcept;
 
+		//! the arguments are kept in the function until it is written
+		template <std::size_t N, typename... Args>
+		static std::function<void(CommandBuffer &n_out)> prepare_command(const char (&n_name)[N], Args &&...n_arguments) {
+
+			return [name = &n_name, arguments = std::tuple<stored_argument_t<Args>...>(std::forward<Args>(n_arguments)...)](CommandBuffer &n_out) {
+				std::apply([&n_out, name](const auto &...n_stored) { format_command(n_out, *name, n_stored...); }, arguments);
+			};
+		}
+
+		/*! @brief what generic commands are routed by with key affinity. Taken before the arguments are moved
+			@return the hash of the first argument, as std::hash<std::string> has it. Nothing if it's a number
+		 */
+		template <typename First, typename... Rest>
+		static std::optional<std::size_t> command_key(const First &n_first, const Rest &...) noexcept {
+
+			if constexpr (std::is_arithmetic_v<std::decay_t<First> >) {
+				return std::nullopt;
+			} else {
+				return std::hash<std::string_view>()(std::string_view(n_first));
+			}
+		}
+
+		static std::optional<std::size_t> command_key() noexcept {
+
+			return std::nullopt;
+		}
+
+		//! what generic commands go through
+		MREDIS_API void send_command(const std::optional<std::size_t> n_key, std::function<void(CommandBuffer &n_out)> &&n_prepare, Callback &&n_callback) noexcept;
+		MREDIS_API void send_command(const std::optional<std::size_t> n_key, std::function<void(CommandBuffer &n_out)> &&n_prepare, ReplyCallback &&n_callback) noexcept;
+		MREDIS_API future_response send_command(const std::optional<std::size_t> n_key, std::function<void(CommandBuffer &n_out)> &&n_prepare) noexcept;
+
+		//! fill the pool with unconnected connections, as configured
+		void create_connections();
+
+		//! RESP3 connections hand out of band messages in here. Dispatches pubsub, forwards the rest
+		void handle_push(const RedisMessage &n_push);
+
 		/*! owned connections call this to notify the client object about their sudden demise
 			we shall release the pointer and try to reconnect
 
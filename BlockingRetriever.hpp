@@ -33,9 +33,17 @@ class BlockingRetriever {
 		BlockingRetriever(const BlockingRetriever &) = delete;
 
 		/*! @brief initialize a new getter for one-time usage
-			@param n_timeout wait for this long before exception is returned 
+			@param n_timeout wait for this many seconds before exception is returned 
 		 */
 		BlockingRetriever(const unsigned int n_timeout = 3)
+				: BlockingRetriever(Duration(std::chrono::seconds(n_timeout))) {
+		}
+
+		/*! @brief initialize a new getter for one-time usage
+			@param n_timeout wait for this long before exception is returned. 
+				Only the wait, use a ScopedTimeout to have the request fail as well
+		 */
+		explicit BlockingRetriever(const Duration &n_timeout)
 				: m_timeout{ n_timeout }
 				, m_promise{ std::make_shared < boost::promise< std::optional<Retval> > >() }
 				, m_used{ false } {
@@ -54,7 +62,7 @@ class BlockingRetriever {
 			boost::unique_future< std::optional<Retval> > future_value = m_promise->get_future();
 
 			// Now I think this wait_for would imply a yield... Meaning that other fiber will take over while this one waits
-			if (future_value.wait_for(boost::chrono::seconds(m_timeout)) == boost::future_status::timeout) {
+			if (future_value.wait_for(boost::chrono::microseconds(std::chrono::duration_cast<std::chrono::microseconds>(m_timeout).count())) == boost::future_status::timeout) {
 				m_used.store(true);
 				BOOST_THROW_EXCEPTION(redis_error() << error_message("Timeout getting redis value"));
 			}
@@ -78,7 +86,7 @@ class BlockingRetriever {
 #endif
 
 	private:
-		const unsigned int     m_timeout;
+		const Duration         m_timeout;
 		std::shared_ptr< boost::promise< std::optional<Retval> > > m_promise;
 		std::atomic<bool>      m_used;  //!< to prevent double usage of this object, set to true after use
 };
@@ -32,9 +32,17 @@ class FiberRetriever {
 		FiberRetriever(const FiberRetriever &) = delete;
 
 		/*! @brief initialize a new getter for one-time usage
-			@param n_timeout wait for this long before exception is returned 
+			@param n_timeout wait for this many seconds before exception is returned 
 		 */
 		FiberRetriever(const unsigned int n_timeout = 3)
+				: FiberRetriever(Duration(std::chrono::seconds(n_timeout))) {
+		}
+
+		/*! @brief initialize a new getter for one-time usage
+			@param n_timeout wait for this long before exception is returned. 
+				Only the wait, use a ScopedTimeout to have the request fail as well
+		 */
+		explicit FiberRetriever(const Duration &n_timeout)
 				: m_timeout{ n_timeout }
 				, m_promise{ std::make_shared<boost::fibers::promise< std::optional<Retval> > >() }
 				, m_used{ false } {
@@ -53,7 +61,7 @@ class FiberRetriever {
 			boost::fibers::future< std::optional<Retval> > future_value = m_promise->get_future();
 
 			// Now I think this wait_for would imply a yield... Meaning that other fiber will take over while this one waits
-			if (future_value.wait_for(std::chrono::seconds(m_timeout)) == boost::fibers::future_status::timeout) {
+			if (future_value.wait_for(m_timeout) == boost::fibers::future_status::timeout) {
 				m_used.store(true);
 				BOOST_THROW_EXCEPTION(redis_error() << error_message("Timeout getting redis value"));
 			}
@@ -81,7 +89,7 @@ class FiberRetriever {
 #endif
 
 	private:
-		const unsigned int     m_timeout;
+		const Duration         m_timeout;
 		std::shared_ptr< boost::fibers::promise< std::optional<Retval> > > m_promise;
 		std::atomic<bool>      m_used;  //!< to prevent double usage of this object, set to true after use
 };
@@ -7,107 +7,117 @@
 #include "MRedisConfig.hpp"
 #include "MRedisResult.hpp"
 #include "MRedisTypes.hpp"
+#include "RespWriter.hpp"
 
-#include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace moose {
 namespace mredis {
 
-/*! @defgroup generators to write commands onto the stream
-	Everything that takes stream ptrs asserts when they are null
+/*! @defgroup generators to write commands into the send buffer
 	@{
 */
 
+/*! @brief commands that only read. Sending one of them twice does no harm, 
+		so they can go again when the connection was lost before the answer came
+	@param n_command name of the command, case doesn't matter
+ */
+MREDIS_API bool is_idempotent(const std::string_view &n_command) noexcept;
+
 //! write a ping into the stream
-MREDIS_API void format_ping(std::ostream &n_os);
+MREDIS_API void format_ping(CommandBuffer &n_out);
+
+//! switch protocol version
+//! @return map with server properties in RESP3, error if the server can't do it
+MREDIS_API void format_hello(CommandBuffer &n_out, const RespVersion n_version);
 
 //! ask for the time
 //! @return array with secs and microsecs 
-MREDIS_API void format_time(std::ostream &n_os);
+MREDIS_API void format_time(CommandBuffer &n_out);
 
 //! tell the connection to sleep for a bit
 //! @return array with "OK" and seconds 
-MREDIS_API void format_debug_sleep(std::ostream &n_os, const boost::int64_t n_seconds);
+MREDIS_API void format_debug_sleep(CommandBuffer &n_out, const boost::int64_t n_seconds);
 
 //! @return bulk string or nil
-MREDIS_API void format_get(std::ostream &n_os, const std::string &n_key);
+MREDIS_API void format_get(CommandBuffer &n_out, const std::string &n_key);
 
 //! @return array with values (as string) or nil (on not found)
-MREDIS_API void format_mget(std::ostream &n_os, const std::vector<std::string> &n_keys);
+MREDIS_API void format_mget(CommandBuffer &n_out, const std::vector<std::string> &n_keys);
 
 //! @return integer
-MREDIS_API void format_set(std::ostream &n_os, const std::string &n_key, const std::string &n_value,
+MREDIS_API void format_set(CommandBuffer &n_out, const std::string &n_key, const std::string &n_value,
 			const Duration &n_expire_time, const SetCondition n_condition);
 
 //! @return integer
-MREDIS_API void format_expire(std::ostream &n_os, const std::string &n_key, const Duration &n_expire_time);
+MREDIS_API void format_expire(CommandBuffer &n_out, const std::string &n_key, const Duration &n_expire_time);
 
 //! @return int (1)
-MREDIS_API void format_del(std::ostream &n_os, const std::string &n_key);
+MREDIS_API void format_del(CommandBuffer &n_out, const std::string &n_key);
 
 //! @return int (0 or 1)
-MREDIS_API void format_exists(std::ostream &n_os, const std::string &n_key);
+MREDIS_API void format_exists(CommandBuffer &n_out, const std::string &n_key);
 
 //! @return integer
-MREDIS_API void format_incr(std::ostream &n_os, const std::string &n_key);
+MREDIS_API void format_incr(CommandBuffer &n_out, const std::string &n_key);
 
 //! @return integer
-MREDIS_API void format_decr(std::ostream &n_os, const std::string &n_key);
+MREDIS_API void format_decr(CommandBuffer &n_out, const std::string &n_key);
 
 //! @return integer
-MREDIS_API void format_hincrby(std::ostream &n_os, const std::string &n_hash_name, const std::string &n_field_name, const boost::int64_t n_incr_by);
+MREDIS_API void format_hincrby(CommandBuffer &n_out, const std::string &n_hash_name, const std::string &n_field_name, const boost::int64_t n_incr_by);
 
 //! @return string or nil
-MREDIS_API void format_hget(std::ostream &n_os, const std::string &n_hash_name, const std::string &n_field_name);
+MREDIS_API void format_hget(CommandBuffer &n_out, const std::string &n_hash_name, const std::string &n_field_name);
 
 //! @return integer
-MREDIS_API void format_hset(std::ostream &n_os, const std::string &n_hash_name, const std::string &n_field_name, const std::string &n_value);
+MREDIS_API void format_hset(CommandBuffer &n_out, const std::string &n_hash_name, const std::string &n_field_name, const std::string &n_value);
 
 //! @return integer
-MREDIS_API void format_hlen(std::ostream &n_os, const std::string &n_hash_name);
+MREDIS_API void format_hlen(CommandBuffer &n_out, const std::string &n_hash_name);
 
 //! @return integer
-MREDIS_API void format_hdel(std::ostream &n_os, const std::string &n_hash_name, const std::string &n_field_name);
+MREDIS_API void format_hdel(CommandBuffer &n_out, const std::string &n_hash_name, const std::string &n_field_name);
 
 //! @return array
-MREDIS_API void format_hgetall(std::ostream &n_os, const std::string &n_hash_name);
+MREDIS_API void format_hgetall(CommandBuffer &n_out, const std::string &n_hash_name);
 
 //! @return integer
-MREDIS_API void format_lpush(std::ostream &n_os, const std::string &n_list_name, const std::string &n_value);
+MREDIS_API void format_lpush(CommandBuffer &n_out, const std::string &n_list_name, const std::string &n_value);
 
 //! @return integer
-MREDIS_API void format_rpush(std::ostream &n_os, const std::string &n_list_name, const std::string &n_value);
+MREDIS_API void format_rpush(CommandBuffer &n_out, const std::string &n_list_name, const std::string &n_value);
 
 //! @return integer
-MREDIS_API void format_sadd(std::ostream &n_os, const std::string &n_set_name, const std::string &n_value);
+MREDIS_API void format_sadd(CommandBuffer &n_out, const std::string &n_set_name, const std::string &n_value);
 
 //! @return integer
-MREDIS_API void format_scard(std::ostream &n_os, const std::string &n_set_name);
+MREDIS_API void format_scard(CommandBuffer &n_out, const std::string &n_set_name);
 
 //! @return integer
-MREDIS_API void format_srem(std::ostream &n_os, const std::string &n_set_name, const std::string &n_value);
+MREDIS_API void format_srem(CommandBuffer &n_out, const std::string &n_set_name, const std::string &n_value);
 
 //! @return string
-MREDIS_API void format_srandmember(std::ostream &n_os, const std::string &n_set_name);
+MREDIS_API void format_srandmember(CommandBuffer &n_out, const std::string &n_set_name);
 
 //! @return array
-MREDIS_API void format_smembers(std::ostream &n_os, const std::string &n_set_name);
+MREDIS_API void format_smembers(CommandBuffer &n_out, const std::string &n_set_name);
 
 //! @return whatever the script returns
-MREDIS_API void format_eval(std::ostream &n_os, const std::string &n_script, const std::vector<std::string> &n_keys, const std::vector<std::string> &n_args);
+MREDIS_API void format_eval(CommandBuffer &n_out, const std::string &n_script, const std::vector<std::string> &n_keys, const std::vector<std::string> &n_args);
 
 //! @return whatever the script returns
-MREDIS_API void format_evalsha(std::ostream &n_os, const std::string &n_sha, const std::vector<std::string> &n_keys, const std::vector<std::string> &n_args);
+MREDIS_API void format_evalsha(CommandBuffer &n_out, const std::string &n_sha, const std::vector<std::string> &n_keys, const std::vector<std::string> &n_args);
 
 //! @return string with hash
-MREDIS_API void format_script_load(std::ostream &n_os, const std::string &n_script);
+MREDIS_API void format_script_load(CommandBuffer &n_out, const std::string &n_script);
 
 //! will always subscribe to MREDIS_WAKEUP as well to get a dummy message in order to interrupt dormant pubsub connections
-MREDIS_API void format_subscribe(std::ostream &n_os, const std::string &n_channel_name);
-MREDIS_API void format_unsubscribe(std::ostream &n_os, const std::string &n_channel_name);
-MREDIS_API void format_publish(std::ostream &n_os, const std::string &n_channel_name, const std::string &n_message);
+MREDIS_API void format_subscribe(CommandBuffer &n_out, const std::string &n_channel_name);
+MREDIS_API void format_unsubscribe(CommandBuffer &n_out, const std::string &n_channel_name);
+MREDIS_API void format_publish(CommandBuffer &n_out, const std::string &n_channel_name, const std::string &n_message);
 
 /*! @} */
 
@@ -14,6 +14,11 @@
 #include <boost/variant.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/minmax.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 
 namespace moose {
 namespace mredis {
@@ -23,24 +28,89 @@ using namespace moose::tools;
 namespace asio = boost::asio;
 namespace ip = asio::ip;
 
+namespace {
+
+//! hand an error to whoever waits for the response to this request
+void abort_request(const mrequest &n_request, const std::string &n_message) {
+
+	redis_error err;
+	err.set_server_message(n_message);
+	if (n_request.m_stream) {
+		if (n_request.m_stream->m_element) {
+			n_request.m_stream->m_element(err);
+		}
+		if (n_request.m_stream->m_done) {
+			n_request.m_stream->m_done();
+		}
+	} else if (n_request.m_reply_callback) {
+		n_request.m_reply_callback(RedisReply::from_message(err));
+	} else if (n_request.m_callback) {
+		n_request.m_callback(err);
+	}
+}
+
+//! callers write their commands into this, each in their own thread
+thread_local CommandBuffer t_command_buffer;
+
+}
+
 MRedisConnection::MRedisConnection(AsyncClient &n_parent)
 		: m_parent{ n_parent }
-		, m_socket{ n_parent.io_context() }
+		, m_server_port{ 0 }
+		, m_protocol{ RespVersion::RESP2 }
+		, m_strand{ asio::make_strand(n_parent.io_context()) }
+		, m_socket{ m_strand }
 	
-		, m_send_streambuf{ }
+		, m_scatter_threshold{ MREDIS_SCATTER_THRESHOLD }
+		, m_request_timeout{ c_invalid_duration }
+		, m_send_buffer{ }
+		, m_send_batches{ }
+		, m_send_filling{ 0 }
 		, m_send_buffer_busy{ false }
-		, m_send_retry_timer{ n_parent.io_context() }
-		, m_send_timeout{ n_parent.io_context() }
-
-		, m_receive_streambuf{ }
+		, m_flush_policy{ }
+		, m_linger_timer{ m_strand }
+		, m_lingering{ false }
+		, m_send_retry_timer{ m_strand }
+		, m_send_timeout{ m_strand }
+
+		, m_slab_pool{ SlabPool::create(MREDIS_RECEIVE_SLAB_SIZE) }
+		, m_receive_slab{ }
+		, m_receive_parsed{ 0 }
+		, m_receive_filled{ 0 }
+		, m_response_parser{ }
+		, m_reply_parser{ }
+		, m_stream_parser{ }
 		, m_receive_buffer_busy{ false }
-		, m_receive_retry_timer{ n_parent.io_context() }
-		, m_receive_timeout{ n_parent.io_context() }
-
-		, m_connect_timeout{ n_parent.io_context() }
-		
-		
-		, m_status{ Status::Disconnected } {
+		, m_receive_timeout{ m_strand }
+
+		, m_connect_timeout{ m_strand }
+		, m_reconnect_timer{ m_strand }
+		, m_reconnect_deadline{ }
+		, m_reconnect_policy{ }
+		, m_reconnect_attempts{ 0 }
+		, m_random{ std::random_device{}() }
+		, m_circuit_open{ false }
+		, m_resolver{ m_strand }
+		, m_endpoints{ }
+		, m_endpoints_expiry{ }
+		, m_resolve_ttl{ std::chrono::seconds(MREDIS_RESOLVE_TTL) }
+
+		, m_deadlines{ std::chrono::microseconds(MREDIS_DEADLINE_RESOLUTION) }
+		, m_deadline_timer{ m_strand }
+		, m_deadline_timer_armed{ false }
+
+		, m_status{ Status::Disconnected }
+		, m_pending{ 0 }
+		, m_queued_bytes{ 0 }
+		, m_max_requests{ 0 }
+		, m_max_bytes{ 0 }
+		, m_backpressure{ Backpressure::Fail }
+		, m_yield{ }
+		, m_room_mutex{ }
+		, m_room{ }
+		, m_room_waiters{ 0 }
+		, m_stopped{ false }
+		, m_generation{ 0 } {
 
 }
 
@@ -48,13 +118,14 @@ MRedisConnection::~MRedisConnection() noexcept {
 
 }
 
-void MRedisConnection::connect(const std::string &n_server, const boost::uint16_t n_port) {
+void MRedisConnection::connect(const std::string &n_server, const boost::uint16_t n_port, const RespVersion n_version) {
 
 	BOOST_LOG_FUNCTION();
-	BOOST_LOG_SEV(logger(), debug) << "Connecting to TCP redis server on " << n_server << ":" << n_port;
+	BOOST_LOG_SEV(logger(), debug) << "Connecting to redis server on " << n_server << ":" << n_port;
 
 	m_server_name = n_server;
 	m_server_port = n_port;
+	m_protocol = n_version;
 
 	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
@@ -65,20 +136,12 @@ void MRedisConnection::connect(const std::string &n_server, const boost::uint16_
 	// Initially start the timeout handlers.
 	m_connect_timeout.async_wait([this](const boost::system::error_code &n_error) { this->check_connect_deadline(n_error); });
 
-	ip::tcp::resolver resolver(m_parent.io_context());
-	ip::tcp::resolver::query query(n_server, boost::lexical_cast<std::string>(n_port), ip::tcp::resolver::query::numeric_service);
-	ip::tcp::resolver::results_type resolved_endpoints = resolver.resolve(query);
-	if (resolved_endpoints.empty()) {
-		m_connect_timeout.cancel();
-		BOOST_THROW_EXCEPTION(network_error() << error_message("Cannot resolve host name") << error_argument(n_server));
-	}
-
 	// I believe connect() should be sync so I catch the result in here.
 	promised_response_ptr promise{ std::make_shared<promised_response>() };
 	future_response res = promise->get_future(); 
 
-	asio::async_connect(m_socket, resolved_endpoints,
-		[this, promise, n_server](const boost::system::error_code &n_errc, const ip::tcp::endpoint &n_endpoint) {
+	const auto on_connect =
+		[this, promise, n_server](const boost::system::error_code &n_errc, const asio::generic::stream_protocol::endpoint &n_endpoint) {
 
 			// cancel the connection timeout
 			m_connect_timeout.cancel();
@@ -106,25 +169,27 @@ void MRedisConnection::connect(const std::string &n_server, const boost::uint16_
 				return;
 			}
 
+			apply_socket_options();
+
 			// send a ping to say hello. Only one ping though, Vassily
-			{
-#ifdef _WIN32
-				std::ostream os(&m_send_streambuf, std::ostream::binary);
-#else
-				std::ostream os(&m_send_streambuf);
-#endif
-				format_ping(os);
+			// RESP3 has to be negotiated, which also tells us if the server is there
+			if (m_protocol == RespVersion::RESP3) {
+				format_hello(m_send_buffer, m_protocol);
+			} else {
+				format_ping(m_send_buffer);
 			}
 
 			// put a wait handler into the 
-			m_outstanding.emplace_back([promise] (const RedisMessage &n_response) {
+			++m_pending;
+			m_outstanding.push_back(mrequest{ nullptr, [promise] (const RedisMessage &n_response) {
 				promise->set_value(n_response);
-			});
+			} });
 
-			// send the content of the streambuf to redis
-			asio::async_write(m_socket, m_send_streambuf,
+			// send the content of the buffer to redis
+			asio::async_write(m_socket, m_send_buffer.buffers(),
 				[this](const boost::system::error_code n_errc, const std::size_t n_bytes_sent) {
 
+					m_send_buffer.clear();
 					if (handle_error(n_errc, "sending ping to server")) {
 						stop();
 						return;
@@ -135,6 +200,19 @@ void MRedisConnection::connect(const std::string &n_server, const boost::uint16_
 // #no_timeouts disabled
 		//			m_read_timeout.async_wait([this](const boost::system::error_code &n_error) { this->check_read_deadline(n_error); });
 			});
+	};
+
+	// The lookup runs in asio's resolver thread, the timeout above covers it as well
+	resolve([this, promise, n_server, on_connect](const boost::system::error_code &n_errc, const Endpoints &n_endpoints) {
+
+		if (n_errc || n_endpoints.empty()) {
+			m_connect_timeout.cancel();
+			promise->set_exception(network_error() << error_message("Cannot resolve host name") 
+					<< error_argument(n_server) << error_code(n_errc));
+			return;
+		}
+
+		asio::async_connect(m_socket, n_endpoints, on_connect);
 	});
 
 	// Wait for slightly longer than the actual timeout would be, so the deadline timer can kill the connection,
@@ -149,13 +227,18 @@ void MRedisConnection::connect(const std::string &n_server, const boost::uint16_
 	// And wait for the callback to call the future. This will throw on connection or read timeout
 	RedisMessage r = res.get();
 
-	if (!is_string(r)) {
+	if (m_protocol == RespVersion::RESP3) {
+		if (!is_map(r)) {
+			BOOST_LOG_SEV(logger(), error) << "Server did not accept HELLO 3";
+			stop();
+			BOOST_THROW_EXCEPTION(network_error() << error_message("Server does not support RESP3")
+					<< error_argument(is_error(r) ? boost::get<redis_error>(r).server_message() : std::string("unexpected response")));
+		}
+	} else if (!is_string(r)) {
 		BOOST_LOG_SEV(logger(), error) << "Server did not pong";
 		stop();
 		BOOST_THROW_EXCEPTION(network_error() << error_message("Server did not respond to ping"));
-	}
-
-	if (!boost::algorithm::equals(boost::get<std::string>(r), "PONG")) {
+	} else if (!boost::algorithm::equals(boost::get<std::string>(r), "PONG")) {
 		BOOST_LOG_SEV(logger(), error) << "Server did not pong";
 		stop();
 		BOOST_THROW_EXCEPTION(network_error() << error_message("Server did not respond to ping with PONG"));
@@ -167,12 +250,20 @@ void MRedisConnection::connect(const std::string &n_server, const boost::uint16_
 	const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
 	BOOST_LOG_SEV(logger(), normal) << "Connected to redis in " << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms";
+
+	// Requests may have come in while we were connecting
+	asio::post(m_strand, [this] { this->send_outstanding_requests(); });
 }
 
-void MRedisConnection::async_connect(const std::string &n_server, const boost::uint16_t n_port, std::shared_ptr<boost::promise<bool> > n_ret) {
+void MRedisConnection::async_connect(const std::string &n_server, const boost::uint16_t n_port, std::shared_ptr<boost::promise<bool> > n_ret,
+		const RespVersion n_version) {
 	
 	BOOST_LOG_FUNCTION();
-	BOOST_LOG_SEV(logger(), debug) << "Async connecting to TCP redis server on " << n_server << ":" << n_port;
+	BOOST_LOG_SEV(logger(), debug) << "Async connecting to redis server on " << n_server << ":" << n_port;
+
+	m_server_name = n_server;
+	m_server_port = n_port;
+	m_protocol = n_version;
 
 	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
@@ -181,16 +272,8 @@ void MRedisConnection::async_connect(const std::string &n_server, const boost::u
 
 	m_status = Status::Connecting;
 
-	ip::tcp::resolver resolver(m_parent.io_context());
-	ip::tcp::resolver::query query(n_server, boost::lexical_cast<std::string>(n_port), ip::tcp::resolver::query::numeric_service);
-	ip::tcp::resolver::results_type resolved_endpoints = resolver.resolve(query);
-	if (resolved_endpoints.empty()) {
-		n_ret->set_exception(redis_error() << error_message("Cannot resolve host name") << error_argument(n_server));
-		return;
-	}
-
-	asio::async_connect(m_socket, resolved_endpoints,
-		[this, n_ret, n_server, start](const boost::system::error_code &n_errc, const ip::tcp::endpoint &n_endpoint) {
+	const auto on_connect =
+		[this, n_ret, n_server, start](const boost::system::error_code &n_errc, const asio::generic::stream_protocol::endpoint &n_endpoint) {
 
 			// cancel the connection timeout
 			m_connect_timeout.cancel();
@@ -216,21 +299,31 @@ void MRedisConnection::async_connect(const std::string &n_server, const boost::u
 				return;
 			}
 
+			apply_socket_options();
+
 			// send a ping to say hello. Only one ping though, Vassily
-			{
-				std::ostream os(&m_send_streambuf);
-				format_ping(os);
+			// RESP3 has to be negotiated, which also tells us if the server is there
+			if (m_protocol == RespVersion::RESP3) {
+				format_hello(m_send_buffer, m_protocol);
+			} else {
+				format_ping(m_send_buffer);
 			}
 
 			// Put a callback into the expected responses queue to know what we do when ping returns
-			m_outstanding.emplace_back([this, n_ret, start](const RedisMessage &n_response) {
+			++m_pending;
+			m_outstanding.push_back(mrequest{ nullptr, [this, n_ret, start](const RedisMessage &n_response) {
 
 				if (is_error(n_response)) {
 					n_ret->set_exception(boost::get<redis_error>(n_response));
 					return;
 				}
 
-				if (!is_string(n_response) || !boost::algorithm::equals(boost::get<std::string>(n_response), "PONG")) {
+				if (m_protocol == RespVersion::RESP3) {
+					if (!is_map(n_response)) {
+						n_ret->set_exception(redis_error() << error_message("Server did not accept HELLO 3"));
+						return;
+					}
+				} else if (!is_string(n_response) || !boost::algorithm::equals(boost::get<std::string>(n_response), "PONG")) {
 					n_ret->set_exception(redis_error() << error_message("Server did not pong"));
 					return;
 				}
@@ -242,13 +335,17 @@ void MRedisConnection::async_connect(const std::string &n_server, const boost::u
 	
 				BOOST_LOG_SEV(logger(), normal) << "Connected to redis in " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms";
 				n_ret->set_value(true);
-			});
 
-			// send the content of the streambuf to redis
-			asio::async_write(m_socket, m_send_streambuf,
+				// Requests may have come in while we were connecting
+				send_outstanding_requests();
+			} });
+
+			// send the content of the buffer to redis
+			asio::async_write(m_socket, m_send_buffer.buffers(),
 				[this, n_ret](const boost::system::error_code n_errc, const std::size_t n_bytes_sent) {
 
-					if (handle_error(n_errc, "sending ping to server")) {
+					m_send_buffer.clear();
+					if (handle_error(n_errc, "sending hello to server")) {
 						stop();
 						
 						return;
@@ -259,6 +356,19 @@ void MRedisConnection::async_connect(const std::string &n_server, const boost::u
 // #no_timeouts disabled
 //					m_read_timeout.async_wait([this](const boost::system::error_code &n_error) { this->check_read_deadline(n_error); });
 			});
+	};
+
+	// Neither the caller nor the io thread waits for the lookup
+	resolve([this, n_ret, n_server, on_connect](const boost::system::error_code &n_errc, const Endpoints &n_endpoints) {
+
+		if (n_errc || n_endpoints.empty()) {
+			m_connect_timeout.cancel();
+			n_ret->set_exception(redis_error() << error_message("Cannot resolve host name") 
+					<< error_argument(n_server) << error_code(n_errc));
+			return;
+		}
+
+		asio::async_connect(m_socket, n_endpoints, on_connect);
 	});
 
 	// Initially start the timeout handlers. (Expiry already set)
@@ -269,7 +379,7 @@ void MRedisConnection::async_connect(const std::string &n_server, const boost::u
 void MRedisConnection::async_reconnect() {
 
 	BOOST_LOG_FUNCTION();
-	BOOST_LOG_SEV(logger(), debug) << "Reconnecting to TCP redis server on " << m_server_name;
+	BOOST_LOG_SEV(logger(), debug) << "Reconnecting to redis server on " << m_server_name;
 
 	// #moep delete me or assert when stuff works
 	if (m_status != Status::ShutdownReconnect) {
@@ -280,103 +390,224 @@ void MRedisConnection::async_reconnect() {
 	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
 	// Re-initialize the socket as I expect shutdown_reconnect() to leave it closed
-	m_socket = boost::asio::ip::tcp::socket{ m_parent.io_context() };
+	m_socket = asio::generic::stream_protocol::socket{ m_strand };
 
 	m_status = Status::Connecting;
 
-	ip::tcp::resolver resolver(m_parent.io_context());
-	ip::tcp::resolver::query query(m_server_name, std::to_string(m_server_port), ip::tcp::resolver::query::numeric_service);
-	ip::tcp::resolver::results_type resolved_endpoints = resolver.resolve(query);
-	if (resolved_endpoints.empty()) {
-		BOOST_LOG_SEV(logger(), warning) << "Could not resolve redis endpoints";
-		boost::system::error_code ignored_error;
-		m_socket.close(ignored_error);
-		m_status = Status::ShutdownReconnect;    // we have set our status to connecting earlier
-		asio::post(m_parent.io_context(), [this] { this->async_reconnect(); });
-		return;
-	}
-
-	// Set a deadline for the connect operation.
+	// Set a deadline for lookup and connect.
 	m_connect_timeout.expires_after(std::chrono::seconds(MREDIS_CONNECT_TIMEOUT));
 
 	// So, what is the plan? I am assuming I was called by send_outstanding, which means there's stuff
 	// to be sent but no connection to send it through.
-	// I will continuously try to reconnect until the connection succeeds. When it does, I hand back
-	// over to send_outstanding
-	asio::async_connect(m_socket, resolved_endpoints,
-		[this, start](const boost::system::error_code &n_errc, const ip::tcp::endpoint &n_endpoint) {
+	// I will keep trying to reconnect until it succeeds or the reconnect deadline has passed. 
+	// When it does, I hand back over to send_outstanding
+	const auto on_connect =
+		[this, start](const boost::system::error_code &n_errc, const asio::generic::stream_protocol::endpoint &n_endpoint) {
 
 			m_connect_timeout.cancel();
 
-			// If we encountered an error, we retry too but delete the socket first
-			if (n_errc) {
-				BOOST_LOG_SEV(logger(), warning) << "Could not reconnect to redis server on '" << n_endpoint << "': " << n_errc.message();
-				boost::system::error_code ignored_error;
-				m_socket.close(ignored_error);
-	
-				async_reconnect();
+			// stopped while we were at it
+			if (m_status != Status::Connecting) {
 				return;
 			}
 
-			// The async_connect() function automatically opens the socket at the start
-			// of the asynchronous operation. If the socket is closed at this time then
-			// the timeout handler must have run first.
-			if (!m_socket.is_open()) {
-				// This is a condition I don't really expect but feat as remains of earlier impl
-				BOOST_LOG_SEV(logger(), error) << "Could not reconnect to redis server: " << n_errc.message();
-				boost::system::error_code ignored_error;
-				m_socket.close(ignored_error);
-
-				async_reconnect();
+			// If we encountered an error, we retry. This includes the timeout closing the socket.
+			// The server may have moved, so the next attempt looks it up again
+			if (n_errc) {
+				BOOST_LOG_SEV(logger(), warning) << "Could not reconnect to redis server on '" << m_server_name << "': " << n_errc.message();
+				m_endpoints_expiry = TimePoint();
+				retry_reconnect();
 				return;
 			}
 
+			apply_socket_options();
 			m_status = Status::Pushing;
+			m_reconnect_attempts = 0;
+			if (m_circuit_open.exchange(false)) {
+				BOOST_LOG_SEV(logger(), normal) << "[Reconnect] Server is back, circuit closed";
+			}
 			const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
 			BOOST_LOG_SEV(logger(), normal) << "Reconnected to redis in " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms";
 
+			// The server forgot our subscriptions along with the old connection
+			if (m_resubscribe) {
+				resubscribe();
+			}
+
 			// Soooo, I suppose I'm connected to the same endpoint as before. No ping or anything
+			// except for RESP3. A new connection starts out in RESP2, so HELLO has to go out first
+			if (m_protocol == RespVersion::RESP3) {
+				mrequest hello{
+					nullptr,
+					[](const RedisMessage &n_response) {
+						if (!is_map(n_response)) {
+							BOOST_LOG_SEV(logger(), error) << "Server did not accept HELLO 3 after reconnect";
+						}
+					}
+				};
+				encode(hello, [](CommandBuffer &n_out) { format_hello(n_out, RespVersion::RESP3); });
+
+				// the reads we send again and whatever was queued in the meantime come after it
+				++m_pending;
+				m_queued_bytes += hello.m_command.size();
+				m_requests_not_sent.emplace_front(std::move(hello));
+			}
+
 			// I'll start send_outstanding, assuming that this is what we came here for
 			send_outstanding_requests();
+	};
 
+	// Endpoints from a recent lookup are tried right away. Otherwise the lookup runs in asio's
+	// resolver thread, no response on any other connection waits for it
+	resolve([this, on_connect](const boost::system::error_code &n_errc, const Endpoints &n_endpoints) {
 
-// #no_timeouts disabled
-//			m_read_timeout.async_wait([this](const boost::system::error_code &n_error) { this->check_read_deadline(n_error); });
+		// stopped or timed out while we were at it
+		if (m_status != Status::Connecting) {
+			return;
+		}
+
+		if (n_errc || n_endpoints.empty()) {
+			BOOST_LOG_SEV(logger(), warning) << "Could not resolve '" << m_server_name << "': " << n_errc.message();
+			m_connect_timeout.cancel();
+			retry_reconnect();
+			return;
+		}
 
+		asio::async_connect(m_socket, n_endpoints, on_connect);
 	});
 
 	// Initially start the timeout handlers. (Expiry for connect already set)
 	m_connect_timeout.async_wait([this](const boost::system::error_code &n_error) {
 
-		if (this->m_status == Status::ShuttingDown || this->m_status == Status::Shutdown) {
-			BOOST_LOG_SEV(logger(), debug) << "Shutting down, reconnect timeout ignored";
+		if (n_error == asio::error::operation_aborted) {
+			return;
+		}
+
+		if (m_status != Status::Connecting) {
+			BOOST_LOG_SEV(logger(), debug) << "Not connecting anymore, reconnect timeout ignored";
 			return;
 		}
 
 		// Check whether the deadline has passed. 
 		if (m_connect_timeout.expiry() <= steady_timer::clock_type::now()) {
-			// The deadline has passed. The socket is closed so that any outstanding
-			// asynchronous operations are cancelled.
+			// The deadline has passed. The socket is closed so that the connect
+			// returns with an error and tries again. Same for a lookup that takes too long
 			BOOST_LOG_SEV(logger(), debug) << "Reconnect timeout, killing socket";
+			boost::system::error_code ignored_error;
+			m_socket.close(ignored_error);
+			m_resolver.cancel();
+		}
+	});
+}
+
+void MRedisConnection::retry_reconnect() noexcept {
+
+	boost::system::error_code ignored_error;
+	m_socket.close(ignored_error);
+	++m_reconnect_attempts;
+
+	// From now on nobody waits for us. We keep trying, new requests fail until we're through
+	if (!m_circuit_open && (std::chrono::steady_clock::now() >= m_reconnect_deadline)) {
+		BOOST_LOG_SEV(logger(), warning) << "[Reconnect] Server unreachable, circuit open. Requests fail until it's back";
+		m_circuit_open = true;
+		abort_waiting("server unreachable");
+	}
+
+	// We stay in Connecting while we wait, so new requests don't start another attempt
+	try {
+		m_reconnect_timer.expires_after(reconnect_pause());
+		m_reconnect_timer.async_wait([this](const boost::system::error_code &n_errc) {
+
+			if ((n_errc == asio::error::operation_aborted) || (m_status != Status::Connecting)) {
+				return;
+			}
 
+			m_status = Status::ShutdownReconnect;
 			async_reconnect();
+		});
+	} catch (const std::exception &sex) {
+		BOOST_LOG_SEV(logger(), error) << "Could not wait to reconnect: " << sex.what();
+		m_status = Status::ShutdownReconnect;
+		m_circuit_open = false;
+		abort_waiting("could not reconnect");
+	}
+}
 
-			// There is no longer an active deadline. The expiry is set to the
-			// maximum time point so that the actor takes no action until a new
-			// deadline is set.
-			m_connect_timeout.expires_at(steady_timer::time_point::max());
-		} else {
-			std::cout << "deadline not passed, timeout ignored" << std::endl;
+Duration MRedisConnection::reconnect_pause() noexcept {
+
+	// Doubles with every attempt. Counting the doublings keeps it from overflowing
+	Duration pause = m_reconnect_policy.m_initial_pause;
+	for (unsigned int i = 1; (i < m_reconnect_attempts) && (pause < m_reconnect_policy.m_max_pause); ++i) {
+		pause *= 2;
+	}
+	pause = std::min(pause, m_reconnect_policy.m_max_pause);
+
+	const double jitter = std::min(std::max(m_reconnect_policy.m_jitter, 0.0), 1.0);
+	if (jitter > 0.0) {
+		const double left_out = std::uniform_real_distribution<double>(0.0, jitter)(m_random);
+		pause -= std::chrono::duration_cast<Duration>(pause * left_out);
+	}
+
+	return pause;
+}
+
+void MRedisConnection::resubscribe() noexcept {
+
+	try {
+		const std::vector<std::string> channels = m_resubscribe();
+
+		// In front, in reverse. Inserting in the middle would move requests whose deadlines point at them
+		for (std::vector<std::string>::const_reverse_iterator channel = channels.crbegin(); channel != channels.crend(); ++channel) {
+			mrequest subscribe{ nullptr };
+			subscribe.m_no_reply = true;
+			encode(subscribe, [channel_name = *channel](CommandBuffer &n_out) { format_subscribe(n_out, channel_name); });
+			++m_pending;
+			m_queued_bytes += subscribe.m_command.size();
+			m_requests_not_sent.emplace_front(std::move(subscribe));
 		}
-	});
+
+		if (!channels.empty()) {
+			BOOST_LOG_SEV(logger(), normal) << "[Reconnect] Subscribing to " << channels.size() << " channels again";
+		}
+	} catch (const std::exception &sex) {
+		BOOST_LOG_SEV(logger(), error) << "Could not subscribe again after reconnect: " << sex.what();
+	}
 }
 
+void MRedisConnection::abort_waiting(const char *n_message) noexcept {
 
+	try {
+		take_queued();
+	} catch (const std::exception &sex) {
+		BOOST_LOG_SEV(logger(), warning) << "Could not take queued requests: " << sex.what();
+	}
 
+	// Callbacks may send again. Those requests go into the queue and wait for the next attempt
+	std::deque<mrequest> waiting;
+	waiting.swap(m_requests_not_sent);
+	m_pending -= waiting.size();
+	for (const mrequest &r : waiting) {
+		m_queued_bytes -= r.m_command.size();
+	}
 
+	for (const mrequest &r : waiting) {
+		if (r.m_expired) {
+			continue;
+		}
 
+		m_deadlines.cancel(r.m_timer);
+		try {
+			abort_request(r, n_message);
+		} catch (const std::exception &sex) {
+			BOOST_LOG_SEV(logger(), warning) << "Aborting client callback caused exception: " << sex.what();
+		} catch (...) {
+			BOOST_LOG_SEV(logger(), warning) << "Aborting client callback caused unknown exception";
+		}
+	}
 
+	make_room();
+}
 
 void MRedisConnection::stop() noexcept {
 
@@ -387,19 +618,35 @@ void MRedisConnection::stop() noexcept {
 		return;
 	}
 
-	BOOST_LOG_SEV(logger(), normal) << "MRedis TCP connection now shutting down";
+	BOOST_LOG_SEV(logger(), normal) << "MRedis connection now shutting down";
 
 	m_status = Status::ShuttingDown;
+	m_stopped = true;
 
 	// requests we haven't sent yet timeout immediately
-	for (const mrequest &r : m_requests_not_sent) {
+	try {
+		m_request_queue.drain(m_requests_not_sent);
+	} catch (const std::exception &sex) {
+		BOOST_LOG_SEV(logger(), warning) << "Could not take queued requests: " << sex.what();
+	}
+
+	// All requests are aborted and moved out of here, there are no deadlines anymore
+	m_deadlines.clear();
+	m_deadline_timer.cancel();
+	m_deadline_timer_armed = false;
+
+	for (mrequest &r : m_requests_not_sent) {
+
+		m_queued_bytes -= r.m_command.size();
+
+		if (r.m_expired) {
+			continue;
+		}
 	
-		asio::post(m_parent.io_context(), [cb{ r.m_callback }] {
+		asio::post(m_parent.io_context(), [req{ std::move(r) }] {
 			try {
-				redis_error err;
 				BOOST_LOG_SEV(logger(), normal) << "Stop aborting remaining unsent handler";
-				err.set_server_message("unsent handler aborted");
-				cb(err);
+				abort_request(req, "unsent handler aborted");
 			} catch (const std::exception &sex) {
 				BOOST_LOG_SEV(logger(), warning) << "Aborting client callback caused exception: " << sex.what();
 			} catch (...) {
@@ -408,21 +655,22 @@ void MRedisConnection::stop() noexcept {
 		});
 	}	
 	
+	m_pending -= m_requests_not_sent.size();
 	m_requests_not_sent.clear();
 
 	// Post remaining handlers into the owning parent's io_service to be executed with a
-	// timeout exception
-	// I'd much rather salvage them and use them in a new connection but this has to wait
-	// because that would imply keeping the prepare functions as well, so we can send them again
-	// after the reconnect
-	for (const Callback &cb : m_outstanding) {
+	// timeout exception. Unlike shutdown_reconnect() we don't salvage anything, there is
+	// no connection after this one to send them on
+	for (mrequest &r : m_outstanding) {
+
+		if (r.m_expired) {
+			continue;
+		}
 		
-		asio::post(m_parent.io_context(), [cb] {	
+		asio::post(m_parent.io_context(), [req{ std::move(r) }] {	
 			try {
-				redis_error err;
 				BOOST_LOG_SEV(logger(), normal) << "Stop aborting remaining handler";
-				err.set_server_message("handler aborted");
-				cb(err);
+				abort_request(req, "handler aborted");
 			} catch (const std::exception &sex) {
 				BOOST_LOG_SEV(logger(), warning) << "Aborting client callback caused exception: " << sex.what();
 			} catch (...) {
@@ -431,21 +679,26 @@ void MRedisConnection::stop() noexcept {
 		});
 	}
 
+	m_pending -= m_outstanding.size();
 	m_outstanding.clear();
 
 	m_send_retry_timer.cancel();
-	m_receive_retry_timer.cancel();
+	m_linger_timer.cancel();
+	m_lingering = false;
 	m_connect_timeout.cancel();
+	m_reconnect_timer.cancel();
+	m_resolver.cancel();
 
 	// Closing the socket will cause read_response to return its handler with an error
 	boost::system::error_code ignored_error;
-	m_socket.shutdown(asio::ip::tcp::socket::shutdown_both, ignored_error);
+	m_socket.shutdown(asio::socket_base::shutdown_both, ignored_error);
 	m_socket.close(ignored_error);
 
 	// All remaining handlers will be posted for execution with an error into the io_service
 
 
 	m_status = Status::Shutdown;
+	make_room();
 
 
 
@@ -465,36 +718,41 @@ void MRedisConnection::shutdown_reconnect() noexcept {
 	// Leave it in this status
 	m_status = Status::ShuttingDownReconnect;
 
-	BOOST_LOG_SEV(logger(), normal) << "[Reconnect] TCP connection now shutting down to reconnect";
+	BOOST_LOG_SEV(logger(), normal) << "[Reconnect] Connection now shutting down to reconnect";
 
-	// requests we haven't sent yet timeout immediately
-	for (const mrequest &r : m_requests_not_sent) {
-		try {
-			redis_error err;
-			BOOST_LOG_SEV(logger(), normal) << "[Reconnect] aborting remaining unsent handler";
-			err.set_server_message("unsent handler aborted");
-			r.m_callback(err);
-		} catch (const std::exception &sex) {
-			BOOST_LOG_SEV(logger(), warning) << "Aborting client callback caused exception: " << sex.what();
-		} catch (...) {
-			BOOST_LOG_SEV(logger(), warning) << "Aborting client callback caused unknown exception";
-		}
+	// requests we haven't sent yet wait for the new connection
+	try {
+		take_queued();
+	} catch (const std::exception &sex) {
+		BOOST_LOG_SEV(logger(), warning) << "Could not take queued requests: " << sex.what();
 	}
 
-	m_requests_not_sent.clear();
-	BOOST_LOG_SEV(logger(), debug) << "[Reconnect] Unsent handlers emptied";
+	// The batch that was filling up never went out. Whatever is in there goes again as it is
+	std::deque<mrequest> unwritten;
+	const std::size_t filled = std::min(m_send_batches[m_send_filling].m_waiting, m_outstanding.size());
+	std::move(m_outstanding.end() - filled, m_outstanding.end(), std::back_inserter(unwritten));
+	m_outstanding.erase(m_outstanding.end() - filled, m_outstanding.end());
+
+	// Reads we sent go out again, before the others and in the order we sent them.
+	// Everything else may or may not have been executed. Only the caller can decide 
+	// whether to send it again. Those that timed out know already. A stream may have
+	// handed out elements already, it can't go again even if it only reads
+	const auto replays = [](const mrequest &n_request) { return n_request.m_replay && !n_request.m_stream; };
+	std::size_t replayed = 0;
+	for (const mrequest &r : m_outstanding) {
+		if (r.m_expired) {
+			continue;
+		}
 
-	// Post remaining handlers into the owning parent's io_service to be executed with a
-	// timeout exception
-	// I'd much rather salvage them and use them in a new connection but this has to wait
-	// because that would imply keeping the prepare functions as well, so we can send them again
-	// after the reconnect
-	for (const Callback &cb : m_outstanding) {
+		if (replays(r)) {
+			++replayed;
+			continue;
+		}
+
+		m_deadlines.cancel(r.m_timer);
 		try {
-			redis_error err;
 			BOOST_LOG_SEV(logger(), normal) << "[Reconnect] aborting remaining handler";
-			err.set_server_message("handler aborted");
-			cb(err);
+			abort_request(r, "connection lost, command may have been executed");
 		} catch (const std::exception &sex) {
 			BOOST_LOG_SEV(logger(), warning) << "Aborting client callback caused exception: " << sex.what();
 		} catch (...) {
@@ -502,271 +760,870 @@ void MRedisConnection::shutdown_reconnect() noexcept {
 		}	
 	}
 
-	// after executing the callbacks with an error, delete them.
+	for (std::deque<mrequest>::reverse_iterator r = unwritten.rbegin(); r != unwritten.rend(); ++r) {
+		m_queued_bytes += r->m_command.size();
+		m_requests_not_sent.push_front(std::move(*r));
+		m_deadlines.rebind(m_requests_not_sent.front().m_timer, &m_requests_not_sent.front());
+	}
+
+	for (std::deque<mrequest>::reverse_iterator r = m_outstanding.rbegin(); r != m_outstanding.rend(); ++r) {
+		if (replays(*r) && !r->m_expired) {
+			m_queued_bytes += r->m_command.size();
+			m_requests_not_sent.push_front(std::move(*r));
+			m_deadlines.rebind(m_requests_not_sent.front().m_timer, &m_requests_not_sent.front());
+		}
+	}
+
+	m_pending -= m_outstanding.size() - replayed;
 	m_outstanding.clear();
-	BOOST_LOG_SEV(logger(), debug) << "[Reconnect] Outstanding sent handlers emptied with an exception each";
+	make_room();
+	BOOST_LOG_SEV(logger(), debug) << "[Reconnect] " << replayed << " sent reads and " << unwritten.size() << " unwritten requests kept to send again, other handlers aborted";
 
 	m_send_retry_timer.cancel();
-	m_receive_retry_timer.cancel();
+	m_linger_timer.cancel();
+	m_lingering = false;
 	m_connect_timeout.cancel();
-	m_parent.io_context().poll();
 	BOOST_LOG_SEV(logger(), debug) << "[Reconnect] Timers cancelled";
 
-	// Closing the socket will cause read_response to return its handler with an error
+	// Closing the socket will cause read and write handlers to return with an error.
+	// We are in our strand, they can't run before we are done here. When they do, they 
+	// see they belong to the old socket and leave everything alone
 	boost::system::error_code ignored_error;
-	m_socket.shutdown(asio::ip::tcp::socket::shutdown_both, ignored_error);
+	m_socket.shutdown(asio::socket_base::shutdown_both, ignored_error);
 	m_socket.close(ignored_error);
-
-	// which is why we poll it now. We are in io_service's thread
-	m_parent.io_context().poll();
-	BOOST_LOG_SEV(logger(), debug) << "[Reconnect] Polled Q after closing socket";
-
-	// Whatever is left in the streambuf is BS now. I want to clear it. There is no described 
-	// way to do this though, so I resort to take all the input sequence
-	m_send_streambuf.consume(m_send_streambuf.size());
-	m_receive_streambuf.consume(m_receive_streambuf.size());
+	++m_generation;
+	m_send_buffer_busy = false;
+	m_receive_buffer_busy = false;
+
+	// Whatever is left in the buffers is BS now
+	m_send_buffer.clear();
+	m_send_batches[0].clear();
+	m_send_batches[1].clear();
+	m_receive_parsed = m_receive_filled;
+	m_response_parser.reset();
+	m_reply_parser.reset();
+	m_stream_parser.reset();
 
 	m_status = Status::ShutdownReconnect;
 
-	BOOST_LOG_SEV(logger(), normal) << "[Reconnect] TCP connection now in shutdown status (" << status_string() << "), ready to reconnect";
+	BOOST_LOG_SEV(logger(), normal) << "[Reconnect] Connection now in shutdown status (" << status_string() << "), ready to reconnect";
 
 	// I'm posting one handler for send_outstanding just in case there are some. 
 	// The handler will do nothing if there's no reason to reconnect right away
-	asio::post(m_parent.io_context(), [this] { this->send_outstanding_requests(); });
+	asio::post(m_strand, [this] { this->send_outstanding_requests(); });
 }
 
-void MRedisConnection::send(std::function<void(std::ostream &n_os)> &&n_prepare, Callback &&n_callback) noexcept {
+void MRedisConnection::set_push_handler(Callback &&n_handler) noexcept {
 
-	{
-		// MOEP! Introduce lockfree queue!
+	m_push_handler = std::move(n_handler);
+}
 
-		
-		mrequest req{ std::move(n_prepare) , std::move(n_callback) };
-		boost::unique_lock<boost::mutex> slock(m_request_queue_lock);
-		m_requests_not_sent.emplace_back(std::move(req));
-	}
+void MRedisConnection::set_resubscribe_handler(std::function<std::vector<std::string>()> &&n_channels) noexcept {
+
+	m_resubscribe = std::move(n_channels);
+}
 
+void MRedisConnection::set_scatter_threshold(const std::size_t n_threshold) noexcept {
 
-	m_parent.io_context().post([this]() { this->send_outstanding_requests(); });
+	m_scatter_threshold = n_threshold;
 }
 
-promised_response_ptr MRedisConnection::send(std::function<void(std::ostream &n_os)> &&n_prepare) noexcept {
+void MRedisConnection::set_request_timeout(const Duration &n_timeout) noexcept {
 
-	// We keep ownership over this promise in the mrequest object
-	promised_response_ptr promise(std::make_shared<promised_response>());
+	m_request_timeout = n_timeout;
+}
 
-	{
-		// Assemble a request object which will live until we have sent the request (via prepare function)
-		// after which we discard the object and only keep the promised answer
-		mrequest req{
-			// Prepare function (will issue command on stream)
-			std::move(n_prepare),
+void MRedisConnection::set_flush_policy(const FlushPolicy &n_policy) noexcept {
 
-			// Callback will be called once the connection receives a response to the call
-			[promise](const RedisMessage &n_response) {
+	m_flush_policy = n_policy;
+}
 
-				// A received (nested) error is re-thrown as a real exception 
-				// that will rise out of the future.
-				if (is_error(n_response)) {
-					promise->set_exception(boost::get<redis_error>(n_response));
-				} else {
-					promise->set_value(n_response);
-				}
-			} 
-		};
+void MRedisConnection::set_resolve_ttl(const Duration &n_ttl) noexcept {
 
-		// #moep Introduce lockfree queue!
+	m_resolve_ttl = n_ttl;
+}
 
+void MRedisConnection::set_reconnect_policy(const ReconnectPolicy &n_policy) noexcept {
 
-		boost::unique_lock<boost::mutex> slock(m_request_queue_lock);
-		m_requests_not_sent.emplace_back(std::move(req));
-	}
+	m_reconnect_policy = n_policy;
+}
 
-	m_parent.io_context().post([this]() { this->send_outstanding_requests(); });
+bool MRedisConnection::circuit_open() const noexcept {
 
-	return promise;
+	return m_circuit_open.load(std::memory_order_relaxed);
 }
 
-void MRedisConnection::send_outstanding_requests() noexcept {
+void MRedisConnection::set_backpressure(const std::size_t n_max_requests, const std::size_t n_max_bytes,
+                                        const Backpressure n_policy, std::function<void()> &&n_yield) noexcept {
 
-// 	if (m_status >= Status::ShuttingDown) {
-// 		return;
-// 	}
+	m_max_requests = n_max_requests;
+	m_max_bytes = n_max_bytes;
+	m_backpressure = n_policy;
+	m_yield = std::move(n_yield);
+}
 
-	try {
-		// if the streambuf is still in use we have to wait
-		// we have to wait for it to become available. We store both handlers until later
-		if (m_send_buffer_busy) {
-			// If we already have a retry timer set, don't do it again
-			//BOOST_LOG_SEV(logger(), debug) << "Setting send retry timer";
-			m_send_retry_timer.expires_after(asio::chrono::milliseconds(5));
-			m_send_retry_timer.async_wait(
-				[this](const boost::system::error_code &n_error) {
-
-					// this also happens when a new timer is set, e.g. because more requests come in
-					if (n_error == asio::error::operation_aborted) {
-						//BOOST_LOG_SEV(logger(), debug) << "Send retry timer aborted";
-						return;
-					}
+std::size_t MRedisConnection::pending() const noexcept {
 
-					if (!n_error && this->m_status == Status::Pushing) {
-						this->send_outstanding_requests();
-					}
-			});
-			
-			return;
-		}
+	return m_pending.load(std::memory_order_relaxed);
+}
 
-		if (m_status == Status::ShuttingDownReconnect) {
-			// we are being shut down by some error condition and try a reconnect
-			BOOST_LOG_SEV(logger(), debug) << "send_outstanding idle due to being shut down for reconnect.";
-			return;
+std::size_t MRedisConnection::queued_bytes() const noexcept {
 
-		} else if (m_status == Status::ShutdownReconnect) {
-			// we have been shutdown by some error condition and are ready for a reconnect
-			if (m_requests_not_sent.empty()) {
-				BOOST_LOG_SEV(logger(), debug) << "We are shut down for reconnect, no work to be done. I'm outta here.";
-			} else {
-				BOOST_LOG_SEV(logger(), debug) << "We are shut down for reconnect and there's stuff to be sent. Going to reconnect.";
-				async_reconnect();
-			}
+	return m_queued_bytes.load(std::memory_order_relaxed);
+}
 
-			return;
-		}
+boost::asio::strand<boost::asio::io_context::executor_type> &MRedisConnection::strand() noexcept {
+
+	return m_strand;
+}
 
-		// we have waited for our buffer to become available. Right now I assume there is 
-		// no async operation in progress on it
-		MOOSE_ASSERT(!m_send_buffer_busy)
-		m_send_buffer_busy = true;
+void MRedisConnection::send(std::function<void(CommandBuffer &n_out)> &&n_prepare, Callback &&n_callback) noexcept {
 
-		{
-#ifdef _WIN32
-			std::ostream os(&m_send_streambuf, std::ostream::binary);
-#else
-			std::ostream os(&m_send_streambuf);
-#endif
+	mrequest req{ nullptr, std::move(n_callback) };
+	encode(req, std::move(n_prepare));
+	enqueue(std::move(req));
+}
 
-	//		BOOST_LOG_SEV(logger(), debug) << "Sending " << m_requests_not_sent.size() << " outstanding requests";
-			
-			// MOEP! Please, lockfree! 
-			boost::unique_lock<boost::mutex> slock(m_request_queue_lock);
+void MRedisConnection::send_no_reply(std::function<void(CommandBuffer &n_out)> &&n_prepare) noexcept {
+
+	mrequest req{ nullptr };
+	req.m_no_reply = true;
+	encode(req, std::move(n_prepare));
+	enqueue(std::move(req));
+}
+
+void MRedisConnection::send(std::function<void(CommandBuffer &n_out)> &&n_prepare, ReplyCallback &&n_callback) noexcept {
 
-			// See if we have unsent requests and stream them first in the order they came in
-			for (mrequest &req : m_requests_not_sent) {
-				req.m_prepare(os);
-				m_outstanding.emplace_back(std::move(req.m_callback));
+	mrequest req{ nullptr, Callback(), std::move(n_callback) };
+	encode(req, std::move(n_prepare));
+	enqueue(std::move(req));
+}
+
+void MRedisConnection::send(std::function<void(CommandBuffer &n_out)> &&n_prepare, ReplyStream &&n_stream) noexcept {
+
+	mrequest req{ nullptr, Callback(), ReplyCallback(), std::make_shared<ReplyStream>(std::move(n_stream)) };
+	encode(req, std::move(n_prepare));
+	enqueue(std::move(req));
+}
+
+promised_response_ptr MRedisConnection::send(std::function<void(CommandBuffer &n_out)> &&n_prepare) noexcept {
+
+	// We keep ownership over this promise in the mrequest object
+	promised_response_ptr promise(std::make_shared<promised_response>());
+
+	// Assemble a request object which will live until we have sent the request
+	// after which we discard the object and only keep the promised answer
+	mrequest req{
+		nullptr,
+
+		// Callback will be called once the connection receives a response to the call
+		[promise](const RedisMessage &n_response) {
+
+			// A received (nested) error is re-thrown as a real exception 
+			// that will rise out of the future.
+			if (is_error(n_response)) {
+				promise->set_exception(boost::get<redis_error>(n_response));
+			} else {
+				promise->set_value(n_response);
 			}
+		} 
+	};
 
-			m_requests_not_sent.clear();
-		}
-		
-		// send the content of the streambuf to redis
-		asio::async_write(m_socket, m_send_streambuf,
-			[this](const boost::system::error_code n_errc, const std::size_t n_bytes_transferred) {
+	encode(req, std::move(n_prepare));
+	enqueue(std::move(req));
 
-				m_send_buffer_busy = false;
-				if (handle_error(n_errc, "sending command(s) to server")) {
-					stop();
-					return;
-				}
+	return promise;
+}
 
-				if (m_status >= Status::ShuttingDown) {
-					return;
-				}
+void MRedisConnection::encode(mrequest &n_request, std::function<void(CommandBuffer &n_out)> &&n_prepare) const noexcept {
 
-				read_response();
-			});
+	CommandBuffer &buffer = t_command_buffer;
 
-	} catch (const boost::system::system_error &serr) {
-		// Very likely we failed to set a retry timer. Doesn't matter. We still wake up as the next command comes in
-		BOOST_LOG_SEV(logger(), warning) << "Error sending command: " << boost::diagnostic_information(serr);
-	} catch (const tools::moose_error &merr) {
-		// Not expected at all
-		BOOST_LOG_SEV(logger(), warning) << "Error sending command: " << boost::diagnostic_information(merr);
+	try {
+		buffer.set_reference_threshold(m_scatter_threshold);
+		n_prepare(buffer);
+		n_request.m_command = buffer.encode();
+		n_request.m_replay = is_idempotent(n_request.m_command.name());
+
+		// The time starts now, not when the io thread gets to it
+		const Duration *scoped = ScopedTimeout::current();
+		const Duration timeout = scoped ? *scoped : m_request_timeout;
+		if (timeout != c_invalid_duration) {
+			n_request.m_deadline = Clock::now() + timeout;
+		}
+
+		// Referenced arguments live in what the prepare function captured
+		if (n_request.m_command.scattered()) {
+			n_request.m_prepare = std::move(n_prepare);
+		}
 	} catch (const std::exception &sex) {
-		// The caller didn't provide callbacks that were nothrow
-		BOOST_LOG_SEV(logger(), error) << "Unexpected exception in send_command(): " << boost::diagnostic_information(sex);
+		// The command stays empty. We don't call back in the caller's thread, the io thread aborts it
+		buffer.clear();
+		BOOST_LOG_SEV(logger(), error) << "Could not write command: " << sex.what();
 	}
 }
 
-void MRedisConnection::read_response() noexcept {
+void MRedisConnection::enqueue(mrequest &&n_request) noexcept {
 
-	if (m_status >= Status::ShuttingDown) {
+	// Don't let them queue up for a server that isn't there
+	if (m_circuit_open.load(std::memory_order_relaxed)) {
+		reject(std::move(n_request), "server unreachable");
 		return;
 	}
 
-	try {
-		// if the streambuf is in use we cannot push data into it
-		// we have to wait for it to become available. We store both handlers until later
-		if (m_receive_buffer_busy) {
-			
-			// I will only post a wait handler if the queue of outstanding 
-			// responses is not empty to avoid having multiple in flight
-			if (m_outstanding.empty()) {
-				BOOST_LOG_SEV(logger(), debug) << "Don't set read retry timer, no reason to read";
-				return;
-			}
-
-			//BOOST_LOG_SEV(logger(), debug) << "Setting read retry timer";
-			m_receive_retry_timer.expires_after(asio::chrono::milliseconds(5));
-			m_receive_retry_timer.async_wait(
-				[this](const boost::system::error_code &n_error) {
+	const std::size_t bytes = n_request.m_command.size();
+	if (!wait_for_room(bytes)) {
+		reject(std::move(n_request), m_stopped ? "connection stopped"
+		                           : (m_circuit_open ? "server unreachable" : "too many requests waiting for the connection"));
+		return;
+	}
 
-					// this also happens when a new timer is set, e.g. because more requests come in
-					if (n_error == asio::error::operation_aborted) {
-						//BOOST_LOG_SEV(logger(), debug) << "Receive retry timer aborted";
-						return;
-					}
+	// Counted before it's in, the io thread may be done with it before push() returns
+	++m_pending;
+	m_queued_bytes += bytes;
 
-					if (!n_error && this->m_status == Status::Pushing) {
-						this->read_response();
+	bool wakeup = false;
+	try {
+		// If there was something in the queue already, the io thread is about to take it.
+		// It will take this one too
+		wakeup = m_request_queue.push(std::move(n_request));
+	} catch (const std::exception &sex) {
+		--m_pending;
+		m_queued_bytes -= bytes;
+		BOOST_LOG_SEV(logger(), error) << "Could not queue request: " << sex.what();
+		abort_request(n_request, "Could not queue request");
+		return;
+	}
+
+	try {
+		if (wakeup) {
+			asio::post(m_strand, [this]() { this->send_outstanding_requests(); });
+		}
+	} catch (const std::exception &sex) {
+		// It stays queued. The next request that finds the queue empty wakes the io thread up
+		BOOST_LOG_SEV(logger(), error) << "Could not wake up io thread: " << sex.what();
+	}
+}
+
+void MRedisConnection::reject(mrequest &&n_request, const char *n_message) noexcept {
+
+	// Not in the caller's thread, like all other callbacks
+	try {
+		asio::post(m_parent.io_context(), [req{ std::move(n_request) }, n_message] {
+			try {
+				abort_request(req, n_message);
+			} catch (const std::exception &sex) {
+				BOOST_LOG_SEV(logger(), warning) << "Aborting client callback caused exception: " << sex.what();
+			} catch (...) {
+				BOOST_LOG_SEV(logger(), warning) << "Aborting client callback caused unknown exception";
+			}
+		});
+	} catch (const std::exception &sex) {
+		BOOST_LOG_SEV(logger(), error) << "Could not reject request: " << sex.what();
+	}
+}
+
+bool MRedisConnection::has_room(const std::size_t n_bytes) const noexcept {
+
+	if (m_max_requests && (m_pending.load() >= m_max_requests)) {
+		return false;
+	}
+
+	if (m_max_bytes) {
+		const std::size_t queued = m_queued_bytes.load();
+		if (queued && (queued + n_bytes > m_max_bytes)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool MRedisConnection::wait_for_room(const std::size_t n_bytes) noexcept {
+
+	if (has_room(n_bytes)) {
+		return true;
+	}
+
+	// In one of the io threads we would wait for the very handlers that make room
+	if (m_parent.io_context().get_executor().running_in_this_thread()) {
+		return true;
+	}
+
+	// Nobody makes room for us once the connection is stopped or has given up on the server
+	const auto given_up = [this] { return m_stopped.load() || m_circuit_open.load(); };
+
+	try {
+		switch (m_backpressure) {
+			case Backpressure::Fail:
+				return false;
+
+			case Backpressure::Yield:
+				if (m_yield) {
+					while (!has_room(n_bytes)) {
+						if (given_up()) {
+							return false;
+						}
+						m_yield();
 					}
-			});
-			
+					return true;
+				}
+				// Spinning would take the core from the io thread that makes room
+				[[fallthrough]];
+
+			case Backpressure::Block: {
+				boost::unique_lock<boost::mutex> lock(m_room_mutex);
+				++m_room_waiters;
+				try {
+					m_room.wait(lock, [this, n_bytes, &given_up] { return has_room(n_bytes) || given_up(); });
+				} catch (...) {
+					--m_room_waiters;
+					throw;
+				}
+				--m_room_waiters;
+				return !given_up();
+			}
+		}
+	} catch (const std::exception &sex) {
+		// Like thread interruption. We can't keep the caller any longer
+		BOOST_LOG_SEV(logger(), warning) << "Stopped waiting for room on connection: " << sex.what();
+	}
+
+	return false;
+}
+
+void MRedisConnection::make_room() noexcept {
+
+	if (!m_room_waiters.load()) {
+		return;
+	}
+
+	try {
+		// Once we have the lock, whoever counted as waiter is waiting
+		boost::lock_guard<boost::mutex> lock(m_room_mutex);
+		m_room.notify_all();
+	} catch (const std::exception &sex) {
+		BOOST_LOG_SEV(logger(), error) << "Could not wake up callers waiting for room: " << sex.what();
+	}
+}
+
+void MRedisConnection::send_outstanding_requests() noexcept {
+
+	try {
+		if (m_status >= Status::ShuttingDown) {
+			// Nothing goes out anymore. What was queued after stop() fails, it must not wait forever
+			m_request_queue.drain(m_requests_not_sent);
+			abort_waiting("connection stopped");
 			return;
 		}
-		
-		// we have waited for our buffer to become available. Right now I assume there is 
-		// no async operation in progress on it
-		MOOSE_ASSERT(!m_receive_buffer_busy)
+
+		// Even if we can't send them yet, their deadlines start running
+		take_queued();
+
+		if (m_status == Status::Connecting) {
+			// They wait. Once connected, we come back for them. Unless nobody knows when that will be
+			if (m_circuit_open) {
+				abort_waiting("server unreachable");
+			}
+			return;
+
+		} else if (m_status == Status::ShuttingDownReconnect) {
+			// we are being shut down by some error condition and try a reconnect
+			BOOST_LOG_SEV(logger(), debug) << "send_outstanding idle due to being shut down for reconnect.";
+			return;
+
+		} else if (m_status == Status::ShutdownReconnect) {
+			// we have been shutdown by some error condition and are ready for a reconnect.
+			// Subscriptions don't send anything, they'd wait for the next request otherwise
+			const bool subscribed = m_resubscribe && !m_resubscribe().empty();
+			if (m_requests_not_sent.empty() && !subscribed) {
+				BOOST_LOG_SEV(logger(), debug) << "We are shut down for reconnect, no work to be done. I'm outta here.";
+			} else {
+				BOOST_LOG_SEV(logger(), debug) << "We are shut down for reconnect and there's stuff to be sent. Going to reconnect.";
+				// If we can't get through in that time, the waiting requests fail
+				m_reconnect_deadline = std::chrono::steady_clock::now() + m_reconnect_policy.m_open_after;
+				m_reconnect_attempts = 0;
+				async_reconnect();
+			}
+
+			return;
+		}
+
+		// Requests are collected even while the other batch is being written.
+		// If it is, its write handler sends this one as soon as it is done
+		fill_send_batch();
+		flush_or_linger();
+
+	} catch (const boost::system::system_error &serr) {
+		// Very likely we failed to start the write. We try again when the next command comes in
+		BOOST_LOG_SEV(logger(), warning) << "Error sending command: " << boost::diagnostic_information(serr);
+	} catch (const tools::moose_error &merr) {
+		// Not expected at all
+		BOOST_LOG_SEV(logger(), warning) << "Error sending command: " << boost::diagnostic_information(merr);
+	} catch (const std::exception &sex) {
+		// The caller didn't provide callbacks that were nothrow
+		BOOST_LOG_SEV(logger(), error) << "Unexpected exception in send_command(): " << boost::diagnostic_information(sex);
+	}
+}
+
+void MRedisConnection::take_queued() {
+
+	const std::size_t taken = m_request_queue.drain(m_requests_not_sent);
+
+	// Deques don't move what's in them when they grow at either end
+	bool scheduled = false;
+	for (std::size_t i = m_requests_not_sent.size() - taken; i < m_requests_not_sent.size(); ++i) {
+		mrequest &req = m_requests_not_sent[i];
+		if ((req.m_deadline != TimePoint::max()) && !req.m_no_reply) {
+			req.m_timer = m_deadlines.schedule(req.m_deadline, &req);
+			scheduled = true;
+		}
+	}
+
+	if (scheduled) {
+		arm_deadline_timer();
+	}
+}
+
+void MRedisConnection::keep_outstanding(mrequest &&n_request) {
+
+	m_outstanding.push_back(std::move(n_request));
+	m_deadlines.rebind(m_outstanding.back().m_timer, &m_outstanding.back());
+}
+
+void MRedisConnection::arm_deadline_timer() noexcept {
+
+	const TimePoint next = m_deadlines.next_expiry();
+	if (next == TimePoint::max()) {
+		return;
+	}
+
+	// One wait for the earliest is enough. Later deadlines are checked when it goes off
+	if (m_deadline_timer_armed && (m_deadline_timer.expiry() <= next)) {
+		return;
+	}
+
+	try {
+		m_deadline_timer.expires_at(next);
+		m_deadline_timer.async_wait([this](const boost::system::error_code &n_errc) {
+
+			if (n_errc == asio::error::operation_aborted) {
+				return;
+			}
+
+			m_deadline_timer_armed = false;
+			expire_deadlines();
+			arm_deadline_timer();
+		});
+		m_deadline_timer_armed = true;
+	} catch (const std::exception &sex) {
+		// The next request that comes in tries again
+		BOOST_LOG_SEV(logger(), error) << "Could not wait for request deadlines: " << sex.what();
+		m_deadline_timer_armed = false;
+	}
+}
+
+void MRedisConnection::expire_deadlines() noexcept {
+
+	try {
+		m_expired.clear();
+		m_deadlines.expire(Clock::now(), m_expired);
+	} catch (const std::exception &sex) {
+		// They stay where they are, we get the others next time
+		BOOST_LOG_SEV(logger(), error) << "Could not take expired requests: " << sex.what();
+	}
+
+	for (mrequest *req : m_expired) {
+		req->m_timer = 0;
+		req->m_expired = true;
+
+		try {
+			abort_request(*req, "request timed out");
+		} catch (const std::exception &sex) {
+			BOOST_LOG_SEV(logger(), warning) << "Aborting client callback caused exception: " << sex.what();
+		} catch (...) {
+			BOOST_LOG_SEV(logger(), warning) << "Aborting client callback caused unknown exception";
+		}
+
+		// A stream may be half way through. The parser carries on but tells nobody
+		if (req->m_stream) {
+			*req->m_stream = ReplyStream();
+		}
+	}
+
+	m_expired.clear();
+}
+
+void MRedisConnection::fill_send_batch() {
+
+	SendBatch &batch = m_send_batches[m_send_filling];
+
+	// what the callers failed to write. Aborted after the others are taken, their callbacks may send again
+	std::vector<mrequest> failed;
+
+	// Take everything the callers queued. Whoever pushes from now on wakes us up again
+	take_queued();
+
+	// See if we have unsent requests and stream them first in the order they came in.
+	// They are written already, we only collect the pieces. Once the batch is as large
+	// as one write may be, the rest waits for the next
+	std::size_t bytes = 0;
+	std::size_t taken = 0;
+	for (; taken < m_requests_not_sent.size(); ++taken) {
+
+		if (m_flush_policy.m_max_bytes && (batch.m_bytes >= m_flush_policy.m_max_bytes)) {
+			break;
+		}
+
+		mrequest &req = m_requests_not_sent[taken];
+		bytes += req.m_command.size();
+
+		// Timed out while it waited. The caller knows already, the server doesn't have to
+		if (req.m_expired) {
+			--m_pending;
+			continue;
+		}
+
+		if (req.m_command.empty()) {
+			m_deadlines.cancel(req.m_timer);
+			failed.push_back(std::move(req));
+			continue;
+		}
+
+		if (batch.empty()) {
+			batch.m_started = Clock::now();
+		}
+
+		req.m_command.gather(batch.m_buffers);
+		batch.m_bytes += req.m_command.size();
+
+		// Commands staged one after another share their storage
+		if (batch.m_storage.empty() || (batch.m_storage.back() != req.m_command.storage())) {
+			batch.m_storage.push_back(req.m_command.storage());
+		}
+
+		// Some commands don't reply in-band, we must not wait for them. They have no deadline either.
+		// Those without a callback do get a reply, it has to be read to stay in sync
+		if (req.m_no_reply) {
+			if (req.m_prepare) {
+				batch.m_prepared.push_back(std::move(req.m_prepare));
+			}
+			--m_pending;
+			continue;
+		}
+
+		// Outstanding right away, we read as soon as the batch goes out. They stay whole until
+		// then, a reconnect before that puts them back in line. See flush_send_batch()
+		keep_outstanding(std::move(req));
+		++batch.m_waiting;
+	}
+
+	// Those left behind don't move when the front is erased, their deadlines stay valid
+	m_requests_not_sent.erase(m_requests_not_sent.begin(), m_requests_not_sent.begin() + taken);
+	m_queued_bytes -= bytes;
+
+	m_pending -= failed.size();
+	for (const mrequest &req : failed) {
+		abort_request(req, "Could not write command");
+	}
+
+	make_room();
+}
+
+void MRedisConnection::flush_send_batch() {
+
+	MOOSE_ASSERT(!m_send_buffer_busy)
+
+	SendBatch &batch = m_send_batches[m_send_filling];
+	if (batch.empty()) {
+		// nothing made it
+		return;
+	}
+
+	// Whatever it waited for, it's going now
+	if (m_lingering) {
+		m_linger_timer.cancel();
+		m_lingering = false;
+	}
+
+	// Reads keep their command, and what it points into, until answered. We may have to send
+	// them again. A stream may have handed out elements already, so it can't go again.
+	// The others only need their arguments until written
+	MOOSE_ASSERT(m_outstanding.size() >= batch.m_waiting)
+	for (std::deque<mrequest>::iterator r = m_outstanding.end() - batch.m_waiting; r != m_outstanding.end(); ++r) {
+		if (r->m_replay && !r->m_stream) {
+			continue;
+		}
+
+		if (r->m_prepare) {
+			batch.m_prepared.push_back(std::move(r->m_prepare));
+			r->m_prepare = nullptr;
+		}
+		r->m_command = EncodedCommand();
+	}
+
+	// From now on, the other one fills up
+	m_send_buffer_busy = true;
+	m_send_filling ^= 1;
+
+	// send the collected commands to redis
+	asio::async_write(m_socket, batch.m_buffers,
+		[this, &batch, generation = m_generation](const boost::system::error_code n_errc, const std::size_t n_bytes_transferred) {
+
+			// The socket this was written to is gone. So is the batch
+			if (generation != m_generation) {
+				return;
+			}
+
+			batch.clear();
+			m_send_buffer_busy = false;
+			if (handle_error(n_errc, "sending command(s) to server")) {
+				shutdown_reconnect();
+				return;
+			}
+
+			if (m_status >= Status::ShuttingDown) {
+				return;
+			}
+
+			// Whatever came in while we were writing goes out right away
+			send_outstanding_requests();
+		});
+
+	// Answers may come while we are still writing. A server that stops reading until we take
+	// them would never let the write finish, so we read along. The batch is outstanding already
+	read_response();
+}
+
+void MRedisConnection::flush_or_linger() {
+
+	SendBatch &batch = m_send_batches[m_send_filling];
+	if (m_send_buffer_busy || batch.empty()) {
+		// The write handler comes back for it
+		return;
+	}
+
+	// Adaptive waits only while the server has earlier requests to answer. When it
+	// doesn't, waiting for more would only add to the latency of these
+	const bool full = m_flush_policy.m_max_bytes && (batch.m_bytes >= m_flush_policy.m_max_bytes);
+	const bool idle = m_flush_policy.m_adaptive && (m_outstanding.size() <= batch.m_waiting);
+	const TimePoint due = batch.m_started + m_flush_policy.m_max_linger;
+	if (full || idle || (m_flush_policy.m_max_linger <= Duration::zero()) || (Clock::now() >= due)) {
+		flush_send_batch();
+		return;
+	}
+
+	if (m_lingering) {
+		return;
+	}
+
+	m_linger_timer.expires_at(due);
+	m_linger_timer.async_wait([this, generation = m_generation](const boost::system::error_code &n_errc) {
+
+		if ((n_errc == asio::error::operation_aborted) || (generation != m_generation) || !m_lingering) {
+			return;
+		}
+
+		m_lingering = false;
+		if ((m_status < Status::ShuttingDownReconnect) && !m_send_buffer_busy) {
+			try {
+				flush_send_batch();
+			} catch (const std::exception &sex) {
+				// The next request tries again
+				BOOST_LOG_SEV(logger(), warning) << "Error sending command: " << sex.what();
+			}
+		}
+	});
+	m_lingering = true;
+}
+
+void MRedisConnection::apply_socket_options() noexcept {
+
+	boost::system::error_code errc;
+
+	// unix domain sockets have no Nagle to turn off
+	if (m_server_port) {
+		m_socket.set_option(asio::ip::tcp::no_delay(m_flush_policy.m_no_delay), errc);
+		if (errc) {
+			BOOST_LOG_SEV(logger(), warning) << "Could not set TCP_NODELAY: " << errc.message();
+		}
+	}
+
+	if (m_flush_policy.m_send_buffer > 0) {
+		m_socket.set_option(asio::socket_base::send_buffer_size(m_flush_policy.m_send_buffer), errc);
+		if (errc) {
+			BOOST_LOG_SEV(logger(), warning) << "Could not set send buffer size: " << errc.message();
+		}
+	}
+}
+
+void MRedisConnection::SendBatch::clear() noexcept {
+
+	m_buffers.clear();
+	m_storage.clear();
+	m_prepared.clear();
+	m_bytes = 0;
+	m_waiting = 0;
+}
+
+bool MRedisConnection::SendBatch::empty() const noexcept {
+
+	return m_buffers.empty();
+}
+
+void MRedisConnection::read_response() noexcept {
+
+	if (m_status >= Status::ShuttingDown) {
+		return;
+	}
+
+	try {
+		// There is only ever one read in flight. It parses whatever it receives and reads
+		// on as long as responses are outstanding, including the ones that were just sent
+		if (m_receive_buffer_busy) {
+			return;
+		}
+
 		m_receive_buffer_busy = true;
 
-		// perhaps we already have bytes to read in our streambuf. If so, I parse those first
-		while (!m_outstanding.empty() && m_receive_streambuf.size()) {
-		
+		// RESP3 servers may push messages at any time. If someone listens for them we keep reading
+		const bool expect_push = (m_protocol == RespVersion::RESP3) && m_push_handler;
+
+		// perhaps we already have bytes to read in our slab. If so, I parse those first
+		while ((!m_outstanding.empty() || expect_push) && (m_receive_parsed < m_receive_filled)) {
+
+			const char *begin = m_receive_slab->data() + m_receive_parsed;
+			const char *end = m_receive_slab->data() + m_receive_filled;
+
+			const ResponseKind kind = next_response_kind();
+
 			RedisMessage r;
-				
-			// As long as we can parse messages from our stream, continue to do so.
-			bool success = parse_from_streambuf(m_receive_streambuf, r);
-			if (success) {
-				// call the callback which was stored along with the request
-				m_outstanding.front()(r);
-
-				// remove the callback
-				m_outstanding.pop_front();
-			} else {
+			RedisReply reply;
+			bool success = false;
+
+			// As long as we can parse messages, continue to do so.
+			// The parser keeps whatever is incomplete and resumes with the next read
+			try {
+				switch (kind) {
+					case ResponseKind::Message:
+						m_receive_parsed += m_response_parser.feed(begin, end, r, success);
+						break;
+					case ResponseKind::Reply:
+						m_receive_parsed += m_reply_parser.feed(m_receive_slab, begin, end, reply, success);
+						break;
+					case ResponseKind::Stream:
+						m_receive_parsed += m_stream_parser.feed(*m_outstanding.front().m_stream, begin, end, r, success);
+						break;
+				}
+			} catch (const std::exception &sex) {
+				// We don't know how far it got. No way to stay in sync with the stream after that
+				BOOST_LOG_SEV(logger(), error) << "Exception parsing response: " << sex.what();
+				m_response_parser.fail("exception while parsing");
+				success = false;
+			}
+
+			if (m_response_parser.failed() || m_reply_parser.failed() || m_stream_parser.failed()) {
+				// We cannot know where the next response starts. Only a new connection can fix that
+				BOOST_LOG_SEV(logger(), error) << "Cannot parse server response, reconnecting";
+				m_receive_buffer_busy = false;
+				shutdown_reconnect();
+				return;
+			}
+
+			if (!success) {
 				break;
 			}
+
+			const bool tape = (kind == ResponseKind::Reply);
+			if (tape ? (reply.root().type() == ReplyType::Push) : is_push(r)) {
+				// out of band, this is not the answer to anything we asked. Whatever the
+				// handler does, the rest of the slab still has to be parsed
+				if (m_push_handler) {
+					try {
+						m_push_handler(tape ? reply.to_message() : r);
+					} catch (const std::exception &sex) {
+						BOOST_LOG_SEV(logger(), error) << "Push handler threw an exception: " << sex.what();
+					} catch (...) {
+						BOOST_LOG_SEV(logger(), error) << "Push handler threw an unknown exception";
+					}
+				}
+				continue;
+			}
+
+			if (m_outstanding.empty()) {
+				BOOST_LOG_SEV(logger(), warning) << "Received a response nobody asked for, dropping it";
+				continue;
+			}
+
+			// It's done before the callback runs. Whatever the callback sends finds the room it made
+			m_deadlines.cancel(m_outstanding.front().m_timer);
+			const mrequest req = std::move(m_outstanding.front());
+			m_outstanding.pop_front();
+			--m_pending;
+			make_room();
+
+			// call the callback which was stored along with the request
+			if (req.m_expired) {
+				// It got its timeout error already
+			} else if (kind == ResponseKind::Stream) {
+				// the elements are through already
+				if (req.m_stream->m_done) {
+					req.m_stream->m_done();
+				}
+			} else if (req.m_reply_callback) {
+				req.m_reply_callback(tape ? reply : RedisReply::from_message(r));
+			} else if (req.m_callback) {
+				req.m_callback(tape ? reply.to_message() : r);
+			}
+		}
+
+		// A batch waiting for the server to catch up may go now
+		if (m_lingering) {
+			flush_or_linger();
 		}
 
 		// If there's nothing left to read, exit this strand. We should re-enter
 		// as new incoming request trigger this.
-		if (m_outstanding.empty()) {
+		if (m_outstanding.empty() && !expect_push) {
 //			BOOST_LOG_SEV(logger(), debug) << "Expecting no more responses. Nothing to read here, move along";
 			m_receive_timeout.cancel();
 			m_receive_buffer_busy = false;
 			return;
 		}
 
-		// Otherwise read more from the socket
+		// Otherwise read more from the socket. Waiting for pushes alone doesn't time out
 //		BOOST_LOG_SEV(logger(), debug) << "Set new timeout and read more responses";
-		m_receive_timeout.expires_after(asio::chrono::seconds(MREDIS_READ_TIMEOUT));
-		m_receive_timeout.async_wait([this](const boost::system::error_code &n_error) { this->check_read_deadline(n_error); });
+		if (m_outstanding.empty()) {
+			m_receive_timeout.cancel();
+		} else {
+			m_receive_timeout.expires_after(asio::chrono::seconds(MREDIS_READ_TIMEOUT));
+			m_receive_timeout.async_wait([this](const boost::system::error_code &n_error) { this->check_read_deadline(n_error); });
+		}
+
+		// A large bulk string that is being collected gets the rest right where it goes, in
+		// reads as large as whatever has arrived of it. The slab would only be copied out of
+		asio::mutable_buffer target = spill_buffer();
+		const bool spill = (m_receive_parsed == m_receive_filled) && (target.size() >= MREDIS_SPILL_SIZE);
+		if (!spill) {
+			prepare_receive_slab();
+			target = asio::buffer(m_receive_slab->data() + m_receive_filled, m_receive_slab->capacity() - m_receive_filled);
+		}
 
 		// read one response and evaluate
-		asio::async_read(m_socket, m_receive_streambuf, asio::transfer_at_least(1),
-			[this](const boost::system::error_code n_errc, const std::size_t n_bytes_transferred) {
+		asio::async_read(m_socket, target, asio::transfer_at_least(1),
+			[this, spill, generation = m_generation](const boost::system::error_code n_errc, const std::size_t n_bytes_transferred) {
+
+				// The socket this was read from is gone, we don't care what it read
+				if (generation != m_generation) {
+					return;
+				}
 				
+				if (spill) {
+					spilled(n_bytes_transferred);
+				} else {
+					m_receive_filled += n_bytes_transferred;
+				}
+
 				if (handle_error(n_errc, "reading response")) {
 					m_receive_buffer_busy = false;
 
@@ -775,8 +1632,8 @@ void MRedisConnection::read_response() noexcept {
 						// We exit here and rely on the fact that a handler is already posted.
 						BOOST_LOG_SEV(logger(), debug) << "read timeout cancelled read, all good.";
 					} else {
-						BOOST_LOG_SEV(logger(), warning) << "stop connection";
-						stop();
+						BOOST_LOG_SEV(logger(), warning) << "Lost connection, reconnecting";
+						shutdown_reconnect();
 					}
 
 					return;
@@ -793,17 +1650,145 @@ void MRedisConnection::read_response() noexcept {
 				read_response();
 			});
 	} catch (const boost::system::system_error &serr) {
-		// Very likely we failed to set a retry timer. Doesn't matter. We still wake up as the next command comes in
+		// Very likely we failed to start the read. The next write tries again
 		BOOST_LOG_SEV(logger(), warning) << "Error reading response: " << boost::diagnostic_information(serr);
+		m_receive_buffer_busy = false;
 	} catch (const tools::moose_error &merr) {
 		// Not expected at all
 		BOOST_LOG_SEV(logger(), warning) << "Error reading response: " << boost::diagnostic_information(merr);
+		m_receive_buffer_busy = false;
 	} catch (const std::exception &sex) {
 		// The caller didn't provide callbacks that were nothrow
 		BOOST_LOG_SEV(logger(), error) << "Unexpected exception in read_response(): " << boost::diagnostic_information(sex);
+		m_receive_buffer_busy = false;
+	}
+}
+
+MRedisConnection::ResponseKind MRedisConnection::next_response_kind() const noexcept {
+
+	// Once started, a response has to be completed by the same parser
+	if (m_reply_parser.busy()) {
+		return ResponseKind::Reply;
+	}
+
+	if (m_stream_parser.busy()) {
+		return ResponseKind::Stream;
+	}
+
+	if (m_response_parser.busy() || m_outstanding.empty()) {
+		return ResponseKind::Message;
+	}
+
+	// Otherwise it's what the request that comes next asked for
+	const mrequest &req = m_outstanding.front();
+	if (req.m_stream) {
+		return ResponseKind::Stream;
+	}
+
+	if (req.m_reply_callback) {
+		return ResponseKind::Reply;
+	}
+
+	return ResponseKind::Message;
+}
+
+asio::mutable_buffer MRedisConnection::spill_buffer() noexcept {
+
+	switch (next_response_kind()) {
+		case ResponseKind::Message:
+			return m_response_parser.bulk_tail();
+		case ResponseKind::Reply:
+			return m_reply_parser.bulk_tail();
+		case ResponseKind::Stream:
+			return m_stream_parser.bulk_tail();
+	}
+
+	return asio::mutable_buffer();
+}
+
+void MRedisConnection::spilled(const std::size_t n_bytes) noexcept {
+
+	// The parser collecting it is busy, so it's still the one
+	switch (next_response_kind()) {
+		case ResponseKind::Message:
+			m_response_parser.bulk_received(n_bytes);
+			break;
+		case ResponseKind::Reply:
+			m_reply_parser.bulk_received(n_bytes);
+			break;
+		case ResponseKind::Stream:
+			m_stream_parser.bulk_received(n_bytes);
+			break;
+	}
+}
+
+void MRedisConnection::prepare_receive_slab() {
+
+	// All parsed and nobody points into it. We can start over from the beginning
+	if (m_receive_slab && (m_receive_parsed == m_receive_filled) && (m_receive_slab.use_count() == 1)) {
+		m_receive_parsed = 0;
+		m_receive_filled = 0;
+	}
+
+	if (m_receive_slab && (m_receive_slab->capacity() - m_receive_filled >= MREDIS_MIN_READ_SIZE)) {
+		return;
+	}
+
+	// Not enough room left. Replies keep the old one alive as long as they need it
+	SlabPtr slab = m_slab_pool->get();
+	const std::size_t unparsed = m_receive_filled - m_receive_parsed;
+	if (unparsed) {
+		std::memcpy(slab->data(), m_receive_slab->data() + m_receive_parsed, unparsed);
 	}
+
+	m_receive_slab = std::move(slab);
+	m_receive_parsed = 0;
+	m_receive_filled = unparsed;
 }
 
+void MRedisConnection::resolve(ResolveHandler &&n_handler) {
+
+	Endpoints endpoints;
+
+	if (!m_server_port) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+		endpoints.emplace_back(asio::local::stream_protocol::endpoint(m_server_name));
+#else
+		BOOST_LOG_SEV(logger(), error) << "No unix domain sockets on this platform";
+#endif
+	} else if (!m_endpoints.empty() && (Clock::now() < m_endpoints_expiry)) {
+		endpoints = m_endpoints;
+	} else {
+		m_resolver.async_resolve(m_server_name, std::to_string(m_server_port), ip::tcp::resolver::numeric_service,
+			[this, handler{ std::move(n_handler) }](const boost::system::error_code &n_errc, const ip::tcp::resolver::results_type &n_results) {
+
+				if (n_errc) {
+					// Where it was is better than nothing. Unless we gave up waiting
+					if ((n_errc != asio::error::operation_aborted) && !m_endpoints.empty()) {
+						BOOST_LOG_SEV(logger(), warning) << "Could not resolve '" << m_server_name << "', trying the last known address: " << n_errc.message();
+						handler(boost::system::error_code(), m_endpoints);
+					} else {
+						handler(n_errc, Endpoints());
+					}
+					return;
+				}
+
+				m_endpoints.clear();
+				for (const ip::tcp::resolver::results_type::value_type &e : n_results) {
+					m_endpoints.emplace_back(e.endpoint());
+				}
+				m_endpoints_expiry = Clock::now() + m_resolve_ttl;
+
+				handler(n_errc, m_endpoints);
+			});
+		return;
+	}
+
+	// Called back the same way as after a lookup, never before we return
+	asio::post(m_strand, [handler{ std::move(n_handler) }, endpoints = std::move(endpoints)] {
+		handler(boost::system::error_code(), endpoints);
+	});
+}
 
 bool MRedisConnection::handle_error(const boost::system::error_code n_errc, const char *n_message) const {
 
@@ -870,6 +1855,31 @@ void MRedisConnection::check_read_deadline(const boost::system::error_code &n_er
 	// the current time since a new asynchronous operation may have moved the
 	// deadline before this actor had a chance to run.
 	if (m_receive_timeout.expiry() <= steady_timer::clock_type::now()) {
+
+		// Only requests without a deadline have nothing but us to tell them the server is gone.
+		// Those with one get until then and fail on their own, without the connection. Those
+		// that did know already, their answers may well take longer
+		const TimePoint now = Clock::now();
+		TimePoint latest = now;
+		bool unbounded = false;
+		for (const mrequest &r : m_outstanding) {
+			if (r.m_expired) {
+				continue;
+			}
+			if (r.m_deadline == TimePoint::max()) {
+				unbounded = true;
+				break;
+			}
+			latest = std::max(latest, r.m_deadline);
+		}
+
+		if (!unbounded) {
+			// Look again then, something without a deadline may be waiting by that time
+			m_receive_timeout.expires_at(std::max(latest, now + std::chrono::seconds(MREDIS_READ_TIMEOUT)));
+			m_receive_timeout.async_wait([this](const boost::system::error_code &n_error) { this->check_read_deadline(n_error); });
+			return;
+		}
+
 		// The deadline has passed. The socket is closed so that any outstanding
 		// asynchronous operations are cancelled.
 		BOOST_LOG_SEV(logger(), normal) << "Read timeout, killing connection for reconnect...";
@@ -7,13 +7,22 @@
 #include "MRedisConfig.hpp"
 #include "MRedisConnection.hpp"
 #include "RESP.hpp"
+#include "RespWriter.hpp"
+#include "RequestQueue.hpp"
+#include "TimerWheel.hpp"
 
 #include <boost/asio.hpp>
 #include <boost/lockfree/queue.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <string>
+#include <random>
 #include <deque>
+#include <vector>
 
 namespace moose {
 namespace mredis {
@@ -27,6 +36,21 @@ class MRedisConnection {
 		enum { MREDIS_CONNECT_TIMEOUT =  2 };
 		enum { MREDIS_READ_TIMEOUT    =  5 };   // make that 10
 		enum { MREDIS_WRITE_TIMEOUT   =  5 };
+		//! resolved addresses are used that many seconds before the host name is looked up again
+		enum { MREDIS_RESOLVE_TTL     = 60 };
+
+		//! request deadlines are rounded up to this many microseconds
+		enum { MREDIS_DEADLINE_RESOLUTION = 1000 };
+
+		//! responses are received into slabs of this size, zero-copy replies point into them
+		enum { MREDIS_RECEIVE_SLAB_SIZE = 64 * 1024 };
+		//! don't read into less room than that, take a new slab instead
+		enum { MREDIS_MIN_READ_SIZE     =  4 * 1024 };
+		//! bulk strings with that much still to come are received right into their own buffer
+		enum { MREDIS_SPILL_SIZE        = MREDIS_RECEIVE_SLAB_SIZE };
+
+		//! bulk arguments from this size on are written from where they are, not copied
+		enum { MREDIS_SCATTER_THRESHOLD = 16 * 1024 };
 
 		MRedisConnection(AsyncClient &n_parent);
 		MRedisConnection(const MRedisConnection &) = delete;
@@ -35,10 +59,15 @@ class MRedisConnection {
 
 
 		//! This blocks until connected or throws on error
-		void connect(const std::string &n_server, const boost::uint16_t n_port = 6379);
+		//! @param n_port 0 means n_server is the path of a unix domain socket
+		//! @param n_version RESP3 will be negotiated using HELLO, connect fails if the server can't do that
+		void connect(const std::string &n_server, const boost::uint16_t n_port = 6379, const RespVersion n_version = RespVersion::RESP2);
 
 		//! This doesn't block and sets promise upon done
-		void async_connect(const std::string &n_server, const boost::uint16_t n_port, std::shared_ptr<boost::promise<bool> > n_ret);
+		//! @param n_port 0 means n_server is the path of a unix domain socket
+		//! @param n_version RESP3 will be negotiated using HELLO, connect fails if the server can't do that
+		void async_connect(const std::string &n_server, const boost::uint16_t n_port, std::shared_ptr<boost::promise<bool> > n_ret,
+		                   const RespVersion n_version = RespVersion::RESP2);
 
 
 		//! This doesn't block and sets promise upon done
@@ -56,13 +85,98 @@ class MRedisConnection {
 		 */
 		virtual void stop() noexcept;
 
+		/*! @brief receive out of band push messages
+			Only RESP3 connections get them. With a handler set, the connection keeps reading 
+			even when no responses are outstanding. Will be called in one of the io threads.
+			Set before connecting.
+		 */
+		void set_push_handler(Callback &&n_handler) noexcept;
+
+		/*! @brief arguments of at least n_threshold bytes are not copied into the send buffer
+			but written from where they are, in one gathering write. 0 copies everything.
+			Set before connecting.
+		 */
+		void set_scatter_threshold(const std::size_t n_threshold) noexcept;
+
+		/*! @brief requests not answered n_timeout after they were made fail, unless a ScopedTimeout
+			says otherwise. c_invalid_duration means never. Set before connecting.
+		 */
+		void set_request_timeout(const Duration &n_timeout) noexcept;
+
+		/*! @brief limit what may wait on this connection. When a limit is reached, n_policy 
+				decides what happens to the next request. Callers in one of the io threads are 
+				always let through, they would wait for themselves.
+				With many threads sending at once, the limits may be exceeded by a few requests.
+			@param n_max_requests queued or waiting for an answer. 0 for no limit
+			@param n_max_bytes of commands not written yet. 0 for no limit. A larger one 
+				still goes when nothing else waits
+			@param n_yield called for Backpressure::Yield until there is room. 
+				Without one, Backpressure::Yield blocks like Backpressure::Block
+			Set before connecting.
+		 */
+		void set_backpressure(const std::size_t n_max_requests, const std::size_t n_max_bytes, 
+		                      const Backpressure n_policy, std::function<void()> &&n_yield) noexcept;
+
+		/*! @brief how writes are batched and the socket is set up. See FlushPolicy
+			Set before connecting.
+		 */
+		void set_flush_policy(const FlushPolicy &n_policy) noexcept;
+
+		/*! @brief reconnects use the address the host name was resolved to for that long.
+			After that, or when connecting to it fails, it's looked up again. Set before connecting.
+		 */
+		void set_resolve_ttl(const Duration &n_ttl) noexcept;
+
+		/*! @brief n_channels tells which channels to subscribe to again after a reconnect
+			For RESP3, where subscriptions live on a regular connection. As long as it returns
+			any, a dropped connection reconnects right away instead of with the next request
+		 */
+		void set_resubscribe_handler(std::function<std::vector<std::string>()> &&n_channels) noexcept;
+
+		//! @brief pauses between reconnect attempts and when to give up on waiting requests. Set before connecting
+		void set_reconnect_policy(const ReconnectPolicy &n_policy) noexcept;
+
+		/*! @brief true while the server can't be reached. Requests fail right away then
+			Safe to call from any thread, same as pending()
+		 */
+		bool circuit_open() const noexcept;
+
+		/*! @brief requests that were made but are not answered yet, including those still queued
+			Safe to call from any thread but may be outdated by the time you look. 
+			Good enough to balance load
+		 */
+		std::size_t pending() const noexcept;
+
+		//! bytes of commands that are not written yet. Same as pending() in all other respects
+		std::size_t queued_bytes() const noexcept;
+
+		//! all handlers of this connection run in here. Post into it to touch its state
+		boost::asio::strand<boost::asio::io_context::executor_type> &strand() noexcept;
+
 		/*! @brief send an unknown command that can be filled by the caller via n_prepare		
+			@param n_callback may be empty if you don't care about the reply. It is consumed all the same
+		 */
+		void send(std::function<void(CommandBuffer &n_out)> &&n_prepare, Callback &&n_callback) noexcept;
+
+		/*! @brief send a command the server doesn't answer in-band, like SUBSCRIBE in RESP3
+			Nothing waits for a reply. Anything the server says about it comes as push message
 		 */
-		void send(std::function<void(std::ostream &n_os)> &&n_prepare, Callback &&n_callback) noexcept;
+		void send_no_reply(std::function<void(CommandBuffer &n_out)> &&n_prepare) noexcept;
+
+		/*! @brief send an unknown command and get the response as zero-copy reply
+			@param n_callback gets a reply that points into the receive buffers. 
+				Keep the reply rather than the views if you need them for longer.
+		 */
+		void send(std::function<void(CommandBuffer &n_out)> &&n_prepare, ReplyCallback &&n_callback) noexcept;
+
+		/*! @brief send an unknown command and get the response element by element
+			@param n_stream gets the elements as they are parsed. Nothing but the current one is kept
+		 */
+		void send(std::function<void(CommandBuffer &n_out)> &&n_prepare, ReplyStream &&n_stream) noexcept;
 
 		/*! @brief send an unknown command that can be filled by the caller via n_prepare	
 		 */
-		promised_response_ptr send(std::function<void(std::ostream &n_os)> &&n_prepare) noexcept;
+		promised_response_ptr send(std::function<void(CommandBuffer &n_out)> &&n_prepare) noexcept;
 
 		//! connection lifecycle
 		enum class Status {
@@ -78,15 +192,102 @@ class MRedisConnection {
 		};
 
 	protected:
+		/*! @brief write the command into n_request, in the caller's thread
+			n_prepare is kept in the request if the command references what it captured.
+			On errors the command stays empty and the request is aborted when it is sent
+		 */
+		void encode(mrequest &n_request, std::function<void(CommandBuffer &n_out)> &&n_prepare) const noexcept;
+
+		//! queue n_request and wake the io thread up to send it, unless it already is
+		void enqueue(mrequest &&n_request) noexcept;
+
+		//! @return true if a request of n_bytes is within the limits
+		bool has_room(const std::size_t n_bytes) const noexcept;
+
+		/*! @brief see that a request of n_bytes is within the limits, in the caller's thread
+			@return false if it has to fail
+		 */
+		bool wait_for_room(const std::size_t n_bytes) noexcept;
+
+		//! wake up callers waiting for room, if there are any. Call after requests are done or written
+		void make_room() noexcept;
+
 		//! assume there are some and go send
 		void send_outstanding_requests() noexcept;
 
+		//! requests gathered for one write. One is on the wire while the other fills up
+		struct SendBatch {
+			std::vector<boost::asio::const_buffer>     m_buffers;   //!< requests as they were encoded by the callers
+			std::vector<std::shared_ptr<const void> >  m_storage;   //!< keeps what m_buffers points to until written
+			std::vector<std::function<void(CommandBuffer &n_out)> >
+			                                           m_prepared;  //!< own the arguments m_buffers references until written
+			std::size_t                                m_bytes = 0;   //!< in m_buffers
+			std::size_t                                m_waiting = 0; //!< requests in here that wait for an answer
+			TimePoint                                  m_started;     //!< when the first request was put in
+
+			void clear() noexcept;
+			bool empty() const noexcept;
+		};
+
+		//! take the queued requests into m_requests_not_sent and watch their deadlines
+		void take_queued();
+
+		//! put a request that was sent into m_outstanding, its deadline goes along
+		void keep_outstanding(mrequest &&n_request);
+
+		//! take the queued requests into the batch that is filling up
+		void fill_send_batch();
+
+		//! write the batch that is filling up, if there's something in it. Must not be writing already
+		void flush_send_batch();
+
+		//! write the batch that is filling up now or a little later, as the flush policy says
+		void flush_or_linger();
+
+		//! set the socket options of the flush policy on a socket that just connected
+		void apply_socket_options() noexcept;
+
 		void read_response() noexcept;
 
+		//! which parser the next response goes to
+		enum class ResponseKind {
+			Message = 0,   //!< RedisMessage for Callback and promises
+			Reply,         //!< zero-copy RedisReply
+			Stream         //!< element by element to a ReplyStream
+		};
+
+		//! @return the parser to use for what comes next, considering partial responses
+		ResponseKind next_response_kind() const noexcept;
+
+		//! make sure there is room to read into. Takes a new slab if the current one is full
+		void prepare_receive_slab();
+
+		//! @return where the rest of a bulk string the current parser collects can be read to. Empty if none
+		boost::asio::mutable_buffer spill_buffer() noexcept;
+
+		//! n_bytes were read into spill_buffer()
+		void spilled(const std::size_t n_bytes) noexcept;
+
+		using Endpoints = std::vector<boost::asio::generic::stream_protocol::endpoint>;
+		using ResolveHandler = std::function<void(const boost::system::error_code &n_errc, const Endpoints &n_endpoints)>;
+
+		/*! @brief find out where to connect to, without blocking. A unix domain socket if m_server_port is 0
+			Addresses looked up less than m_resolve_ttl ago are taken as they are. When a lookup fails,
+			the last known addresses are used, if there are any.
+			@param n_handler called in our strand, with an error if there's nowhere to connect to
+		 */
+		void resolve(ResolveHandler &&n_handler);
+
 		//! when handling error conditions after async ops, use this to save some lines
 		//! @return true when error should cause closing of the connection
 		bool handle_error(const boost::system::error_code n_errc, const char *n_message) const;
 
+		//! make sure m_deadline_timer goes off when the next deadline is due
+		void arm_deadline_timer() noexcept;
+
+		//! fail the requests whose deadline has passed. Their answers are dropped when they come
+		void expire_deadlines() noexcept;
+
 		//! yeah, this needs refactoring. I don't need two functions for that
 		void check_connect_deadline(const boost::system::error_code &n_error);
 
@@ -95,41 +296,106 @@ class MRedisConnection {
 		/*! @brief shut the connection down and try to reconnect until done.
 			must be called by the connection itself, in io_service's thread
 
-
+			Reads that were sent but not answered are sent again after the reconnect, 
+			other commands fail as we can't know whether the server executed them. 
+			Unsent requests wait for the new connection
 		 */
 		virtual void shutdown_reconnect() noexcept;
 
+		/*! @brief a reconnect attempt failed. Try again after a pause that grows with every attempt.
+			Once the reconnect deadline has passed, the circuit opens and the attempts go on in the background
+		 */
+		void retry_reconnect() noexcept;
+
+		//! @return how long to wait before the next reconnect attempt, see ReconnectPolicy
+		Duration reconnect_pause() noexcept;
+
+		//! fail n_request in the io_context, not in the caller's thread, like all other callbacks
+		void reject(mrequest &&n_request, const char *n_message) noexcept;
+
+		//! put SUBSCRIBE for the channels m_resubscribe returns in front of the requests that wait
+		void resubscribe() noexcept;
+
+		//! fail the requests that wait for a connection, queued or not
+		void abort_waiting(const char *n_message) noexcept;
+
 
 		/*! output current status as string */
 		const char *status_string() const noexcept;
 
 
 		AsyncClient                   &m_parent;
-		std::string                    m_server_name;
-		boost::uint16_t                m_server_port;
-		boost::asio::ip::tcp::socket   m_socket;              //!< Socket for the connection
-
-		boost::asio::streambuf         m_send_streambuf;      //!< use for writing
-		bool                           m_send_buffer_busy;    //!< streambuf in use
-		boost::asio::steady_timer      m_send_retry_timer;    //!< when buffer is in use for sending, retry after a few micros
+		std::string                    m_server_name;         //!< host name or socket path
+		boost::uint16_t                m_server_port;         //!< 0 for a unix domain socket
+		RespVersion                    m_protocol;            //!< what we negotiated at connect
+		Callback                       m_push_handler;        //!< RESP3 out of band messages go here
+		std::function<std::vector<std::string>()>
+		                               m_resubscribe;         //!< see set_resubscribe_handler()
+		boost::asio::strand<boost::asio::io_context::executor_type>
+		                               m_strand;              //!< all our handlers run in here, one at a time
+		boost::asio::generic::stream_protocol::socket
+		                               m_socket;              //!< TCP or unix domain socket, see resolve()
+
+		std::size_t                    m_scatter_threshold;   //!< arguments from this size on are referenced, not copied
+		Duration                       m_request_timeout;     //!< default for requests, see set_request_timeout()
+		CommandBuffer                  m_send_buffer;         //!< use for writing during connect
+		SendBatch                      m_send_batches[2];     //!< double buffered writes
+		std::size_t                    m_send_filling;        //!< index of the batch that is filling up, the other may be on the wire
+		bool                           m_send_buffer_busy;    //!< a write is in flight
+		FlushPolicy                    m_flush_policy;        //!< see set_flush_policy()
+		boost::asio::steady_timer      m_linger_timer;        //!< writes a batch that waited for more long enough
+		bool                           m_lingering;           //!< m_linger_timer waits for the batch that is filling up
+		boost::asio::steady_timer      m_send_retry_timer;    //!< pubsub only. When buffer is in use for sending, retry after a few micros
 		boost::asio::steady_timer      m_send_timeout;
 
-		boost::asio::streambuf         m_receive_streambuf;   //!< use for reading
-		bool                           m_receive_buffer_busy; //!< streambuf in use
-		boost::asio::steady_timer      m_receive_retry_timer; //!< when buffer is in use for receiving, retry after a few micros
+		std::shared_ptr<SlabPool>      m_slab_pool;           //!< slabs come back here when no reply points into them anymore
+		SlabPtr                        m_receive_slab;        //!< responses and pubsub messages are read into this
+		std::size_t                    m_receive_parsed;      //!< bytes in m_receive_slab the parsers have seen
+		std::size_t                    m_receive_filled;      //!< bytes in m_receive_slab received
+		RespParser                     m_response_parser;     //!< keeps partial responses between reads
+		RespTapeParser                 m_reply_parser;        //!< same for requests that want a zero-copy reply
+		RespStreamParser               m_stream_parser;       //!< same for requests that want elements one by one
+		bool                           m_receive_buffer_busy; //!< a read is in flight
 		boost::asio::steady_timer      m_receive_timeout;        //!< pipelining connection, we always have two concurrent timeouts
 
 		boost::asio::steady_timer      m_connect_timeout;     //!< we try to adopt a timeout concept but since we are in a 
-
-
-		boost::mutex                   m_request_queue_lock;
+		boost::asio::steady_timer      m_reconnect_timer;     //!< pause between reconnect attempts
+		std::chrono::steady_clock::time_point
+		                               m_reconnect_deadline;  //!< the waiting requests fail when we're not connected by then
+		ReconnectPolicy                m_reconnect_policy;    //!< see set_reconnect_policy()
+		unsigned int                   m_reconnect_attempts;  //!< failed in a row. The pause grows with it
+		std::minstd_rand               m_random;              //!< jitter for the pauses
+		std::atomic<bool>              m_circuit_open;        //!< see circuit_open()
+		boost::asio::ip::tcp::resolver m_resolver;            //!< looks up m_server_name in asio's resolver thread
+		Endpoints                      m_endpoints;           //!< last known addresses of m_server_name
+		TimePoint                      m_endpoints_expiry;    //!< look it up again from then on
+		Duration                       m_resolve_ttl;         //!< see set_resolve_ttl()
+
+
+		RequestQueue                   m_request_queue;       //!< callers put their requests in here
 		
-		std::deque<mrequest>           m_requests_not_sent;
-		std::deque<Callback>           m_outstanding;         //!< callbacks that have not been resolved yet. We are waiting for an answer
+		std::deque<mrequest>           m_requests_not_sent;   //!< taken from m_request_queue, io thread only
+		std::deque<mrequest>           m_outstanding;         //!< callbacks that have not been resolved yet. We are waiting for an answer
+		TimerWheel                     m_deadlines;           //!< of the requests in the two above. They don't move in there
+		boost::asio::steady_timer      m_deadline_timer;      //!< goes off when the next deadline is due
+		bool                           m_deadline_timer_armed;
+		std::vector<mrequest *>        m_expired;             //!< taken out of m_deadlines, kept to save allocations
 
 		
 
 		Status                         m_status;              //!< tell where we are in our workflow
+		std::atomic<std::size_t>       m_pending;             //!< see pending()
+		std::atomic<std::size_t>       m_queued_bytes;        //!< see queued_bytes()
+
+		std::size_t                    m_max_requests;        //!< see set_backpressure(). 0 for no limit
+		std::size_t                    m_max_bytes;           //!< same
+		Backpressure                   m_backpressure;        //!< what to do when a limit is reached
+		std::function<void()>          m_yield;               //!< for Backpressure::Yield
+		boost::mutex                   m_room_mutex;          //!< Backpressure::Block callers wait on m_room
+		boost::condition_variable      m_room;
+		std::atomic<std::size_t>       m_room_waiters;        //!< so we don't notify for nothing
+		std::atomic<bool>              m_stopped;             //!< stop() was called. Callers waiting for room give up
+		std::size_t                    m_generation;          //!< counts sockets. Handlers for an old one are ignored
 };
 
 }
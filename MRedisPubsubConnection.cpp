@@ -92,7 +92,7 @@ boost::unique_future<bool> MRedisPubsubConnection::subscribe(const std::string &
 	m_pending_subscriptions.push(new pending_subscription{ n_channel_name, 0, promised_retval });
 	m_subscriptions_pending++;
 
-	asio::post(m_parent.io_context(), [this] {
+	asio::post(m_strand, [this] {
 
 		this->finish_subscriptions();
 	});
@@ -140,7 +140,7 @@ void MRedisPubsubConnection::unsubscribe(const boost::uint64_t n_id) {
 	m_pending_subscriptions.push(new pending_subscription{ channel_name, n_id, 0 });
 	m_subscriptions_pending++;
 
-	m_parent.io_context().post([this] () {
+	asio::post(m_strand, [this] () {
 
 		this->finish_subscriptions();
 	});
@@ -153,7 +153,7 @@ void MRedisPubsubConnection::finish_subscriptions() {
 	pending_subscription *sub = 0;
 	
 	try {
-		// if the streambuf is still in use so we have to wait for it to become available.
+		// if the send buffer is still in use we have to wait for it to become available.
 		if (m_send_buffer_busy) {
 			m_send_retry_timer.expires_after(asio::chrono::milliseconds(1));
 			m_send_retry_timer.async_wait(
@@ -178,20 +178,18 @@ void MRedisPubsubConnection::finish_subscriptions() {
 		MOOSE_ASSERT((!m_send_buffer_busy));
 		m_send_buffer_busy = true;
 
-		{
-			std::ostream os(&m_send_streambuf);
-			if (sub->get<1>() != 0) {
-				format_unsubscribe(os, sub->get<0>());
-			} else {
-				format_subscribe(os, sub->get<0>());
-			}
+		if (sub->get<1>() != 0) {
+			format_unsubscribe(m_send_buffer, sub->get<0>());
+		} else {
+			format_subscribe(m_send_buffer, sub->get<0>());
 		}
 
-		// send the content of the streambuf to redis
+		// send the content of the buffer to redis
 		// We also transfer ownership over the subscription
-		asio::async_write(m_socket, m_send_streambuf,
+		asio::async_write(m_socket, m_send_buffer.buffers(),
 			[this, sub] (const boost::system::error_code n_errc, const std::size_t) {
 
+				m_send_buffer.clear();
 				m_send_buffer_busy = false;
 
 				const std::string channel = sub->get<0>();
@@ -302,6 +300,13 @@ class MessageVisitor : public boost::static_visitor<> {
 		BOOST_LOG_SEV(logger(), error) << "Received null message, while expecting an array";
 	}
 
+	//! RESP3 types. This connection speaks RESP2, so we should never see them
+	template <typename T>
+	void operator()(const T &) const {
+
+		BOOST_LOG_SEV(logger(), error) << "Received RESP3 message on a RESP2 pubsub connection";
+	}
+
 	void operator()(const std::vector<RedisMessage> &n_array) const {
 
 		// From the redis specs:
@@ -458,34 +463,33 @@ void MRedisPubsubConnection::read_message() {
 	}
 
 	try {
-		// if the streambuf is in use we cannot push data into it
-		// we have to wait for it to become available. We store both handlers until later
+		// A read is in progress. It will come back here when it's done and parse whatever is there
 		if (m_receive_buffer_busy) {	
-			m_receive_retry_timer.expires_after(asio::chrono::milliseconds(1));
-			m_receive_retry_timer.async_wait(
-				[this] (const boost::system::error_code &n_err) {
-
-					if (!n_err && this->m_status == Status::Pubsub) {
-						this->read_message();
-					}
-			});
-		
 			return;
 		}
 
-		// we have waited for our buffer to become available. Right now I assume there is 
-		// no async operation in progress on it
-		MOOSE_ASSERT((!m_send_buffer_busy));
-		m_send_buffer_busy = true;
+		m_receive_buffer_busy = true;
+
+		// perhaps we already have bytes to read in our slab. If so, I parse those first.
+		// The parser keeps whatever is incomplete and resumes with the next read
+		while (m_receive_parsed < m_receive_filled) {
 
-		// perhaps we already have bytes to read in our streambuf. If so, I parse those first
-		while (m_send_streambuf.size()) {
+			const char *begin = m_receive_slab->data() + m_receive_parsed;
+			const char *end = m_receive_slab->data() + m_receive_filled;
 
-			std::istream is(&m_send_streambuf);
 			RedisMessage r;
+			bool success = false;
+			m_receive_parsed += m_response_parser.feed(begin, end, r, success);
 
-			// As long as we can parse messages from our stream, continue to do so.
-			bool success = parse_from_stream(is, r);
+			if (m_response_parser.failed()) {
+				// We cannot know where the next message starts
+				BOOST_LOG_SEV(logger(), error) << "Cannot parse pubsub message, shutting down";
+				m_receive_buffer_busy = false;
+				stop();
+				return;
+			}
+
+			// As long as we can parse messages, continue to do so.
 			if (success) {
 				boost::apply_visitor(MessageVisitor(*this), r);
 			} else {
@@ -495,9 +499,9 @@ void MRedisPubsubConnection::read_message() {
 
 		// We may have been woken up by a message, only to be able to see if we 
 		// got outstanding subscriptions
-		if ((m_subscriptions_pending.load() > 0) && (m_receive_streambuf.size() == 0)) {
-			m_send_buffer_busy = false;
-			asio::post(m_parent.io_context(), [this] {
+		if ((m_subscriptions_pending.load() > 0) && (m_receive_parsed == m_receive_filled) && !m_response_parser.busy()) {
+			m_receive_buffer_busy = false;
+			asio::post(m_strand, [this] {
 				this->finish_subscriptions();
 			});
 			return;
@@ -505,18 +509,31 @@ void MRedisPubsubConnection::read_message() {
 
 		// handle_message may have caused us to leave pubsub mode by removing the last subscription
 		if (m_status != Status::Pubsub) {
-			m_send_buffer_busy = false;
+			m_receive_buffer_busy = false;
 			return;
 		}
 
 		// Otherwise read more from the socket
 	//	BOOST_LOG_SEV(logger(), debug) << "Reading more messages";
 
+		// Large messages get the rest of them right where they go, same as responses do
+		asio::mutable_buffer target = spill_buffer();
+		const bool spill = (m_receive_parsed == m_receive_filled) && (target.size() >= MREDIS_SPILL_SIZE);
+		if (!spill) {
+			prepare_receive_slab();
+			target = asio::buffer(m_receive_slab->data() + m_receive_filled, m_receive_slab->capacity() - m_receive_filled);
+		}
+
 		// read one messages and evaluate
-		asio::async_read(m_socket, m_receive_streambuf, asio::transfer_at_least(1),
-			[this] (const boost::system::error_code n_errc, const std::size_t) {
+		asio::async_read(m_socket, target, asio::transfer_at_least(1),
+			[this, spill] (const boost::system::error_code n_errc, const std::size_t n_bytes_transferred) {
 
 				m_receive_buffer_busy = false;
+				if (spill) {
+					spilled(n_bytes_transferred);
+				} else {
+					m_receive_filled += n_bytes_transferred;
+				}
 
 				if (handle_error(n_errc, "reading message")) {
 					stop();
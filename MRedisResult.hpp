@@ -6,6 +6,8 @@
 #pragma once
 #include "MRedisConfig.hpp"
 #include "MRedisError.hpp"
+#include "MRedisTypes.hpp"
+#include "RespWriter.hpp"
 
 #include <boost/variant.hpp>
 #include <boost/cstdint.hpp>
@@ -15,6 +17,7 @@
 
 #include <functional>
 #include <vector>
+#include <utility>
 #include <chrono>
 #include <atomic>
 
@@ -23,14 +26,70 @@ namespace mredis {
 
 struct null_result {};
 
+/*! @defgroup RESP3 types
+	Only ever received when the connection was made with RespVersion::RESP3.
+	Scalars are wrapped so they don't compete with std::string and boost::int64_t 
+	when a RedisMessage is constructed from a literal.
+	@{
+*/
+
+struct double_result {
+	double m_value;
+};
+
+struct boolean_result {
+	bool m_value;
+};
+
+//! integers beyond 64 bit. We don't do arbitrary precision, you get the digits
+struct big_number_result {
+	std::string m_value;
+};
+
+//! a string with a format hint like "txt" or "mkd"
+struct verbatim_result {
+	std::string m_format;
+	std::string m_value;
+};
+
+//! key value pairs in the order the server sent them
+template <typename Message>
+struct map_result {
+	std::vector<std::pair<Message, Message> > m_entries;
+};
+
+template <typename Message>
+struct set_result {
+	std::vector<Message> m_elements;
+};
+
+//! out of band data like pub/sub messages or client tracking invalidations
+template <typename Message>
+struct push_result {
+	std::vector<Message> m_elements;
+};
+
+/*! @} */
+
 using RedisMessage = boost::make_recursive_variant<
 	redis_error,                           // 0 wrapped up exception for error cases
 	std::string,                           // 1 string response  (simple or bulk)
 	boost::int64_t,                        // 2 integer response
 	null_result,                           // 3 null response
-	std::vector<boost::recursive_variant_> // 4 arrays
+	std::vector<boost::recursive_variant_>,// 4 arrays
+	double_result,                         // 5 RESP3 double
+	boolean_result,                        // 6 RESP3 boolean
+	big_number_result,                     // 7 RESP3 big number
+	verbatim_result,                       // 8 RESP3 verbatim string
+	map_result<boost::recursive_variant_>, // 9 RESP3 map
+	set_result<boost::recursive_variant_>, // 10 RESP3 set
+	push_result<boost::recursive_variant_> // 11 RESP3 push
 >::type;
 
+using RedisMap  = map_result<RedisMessage>;
+using RedisSet  = set_result<RedisMessage>;
+using RedisPush = push_result<RedisMessage>;
+
 //! convenience type check so you don't have to fuck around with magic numbers like which() does
 inline bool is_error(const RedisMessage &n_message) noexcept {
 
@@ -58,16 +117,67 @@ inline bool is_array(const RedisMessage &n_message) noexcept {
 	return n_message.which() == 4;
 }
 
+inline bool is_double(const RedisMessage &n_message) noexcept {
+
+	return n_message.which() == 5;
+}
+
+inline bool is_boolean(const RedisMessage &n_message) noexcept {
+
+	return n_message.which() == 6;
+}
+
+inline bool is_big_number(const RedisMessage &n_message) noexcept {
+
+	return n_message.which() == 7;
+}
+
+inline bool is_verbatim(const RedisMessage &n_message) noexcept {
+
+	return n_message.which() == 8;
+}
+
+inline bool is_map(const RedisMessage &n_message) noexcept {
+
+	return n_message.which() == 9;
+}
+
+inline bool is_set(const RedisMessage &n_message) noexcept {
+
+	return n_message.which() == 10;
+}
+
+inline bool is_push(const RedisMessage &n_message) noexcept {
+
+	return n_message.which() == 11;
+}
+
 //! callback for all kinds of responses
 using Callback        = std::function<void(const RedisMessage &)>;
 
+//! callback for zero-copy responses, see RespTape.hpp
+class RedisReply;
+using ReplyCallback   = std::function<void(const RedisReply &)>;
+
+//! callbacks for element by element responses, see RespTape.hpp
+struct ReplyStream;
+
 //! the way I understand the protocol, payload to a message published is always a string
 using MessageCallback = std::function<void(const std::string &)>;
 
+//! a request is written when it is made, in the caller's thread
 struct mrequest {
 
-	std::function<void(std::ostream &n_os)> m_prepare;
-	Callback                                m_callback;
+	std::function<void(CommandBuffer &n_out)> m_prepare;       //!< only kept if m_command references arguments it captured
+	Callback                                m_callback;        //!< may be empty if nobody cares about the reply. It's consumed anyway
+	ReplyCallback                           m_reply_callback;  //!< set instead of m_callback if the caller wants a zero-copy reply
+	std::shared_ptr<ReplyStream>            m_stream;          //!< set instead of m_callback if the caller wants the reply element by element
+	EncodedCommand                          m_command;         //!< what goes out to the server. Empty if writing it failed
+	bool                                    m_replay = false;  //!< only reads. Kept when sent and sent again after a reconnect
+	TimePoint                               m_deadline = TimePoint::max(); //!< answered with a timeout error if not done by then
+	boost::uint32_t                         m_timer = 0;       //!< where the connection keeps m_deadline, 0 if it doesn't
+	bool                                    m_expired = false; //!< the deadline passed and the callback got an error. The answer is dropped
+	bool                                    m_no_reply = false; //!< the server doesn't reply in-band, like RESP3 SUBSCRIBE. Not waited for
 };
 
 using future_response       = boost::unique_future<RedisMessage>;
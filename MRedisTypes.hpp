@@ -9,6 +9,8 @@
 #include "tools/Error.hpp"
 
 #include <chrono>
+#include <cstddef>
+#include <string>
 
 namespace moose {
 namespace mredis {
@@ -28,6 +30,49 @@ MOOSE_TOOLS_API enum class SetCondition {
 	XX           //!< set only if it does already exist
 };
 
+//! Protocol version to talk to the server. RESP3 needs redis 6 or above
+MOOSE_TOOLS_API enum class RespVersion {
+	RESP2 = 2,   //!< plain old protocol, what you get without HELLO
+	RESP3 = 3    //!< negotiated by HELLO 3. Adds maps, sets, doubles and out of band push messages
+};
+
+//! What happens to a request when its connection has as much waiting as it may
+MOOSE_TOOLS_API enum class Backpressure {
+	Fail = 0,    //!< the request fails right away with a redis_error
+	Block,       //!< the caller's thread waits until there's room
+	Yield        //!< the caller yields until there's room, to other fibers or coroutines
+};
+
+/*! @brief when a connection writes the requests it collected, and how its socket is set up
+	By default, whatever is there goes out as soon as the last write is done.
+ */
+struct FlushPolicy {
+	std::size_t m_max_bytes   = 0;                  //!< one write takes no more, the rest goes with the next. Writes right away when reached. 0 for no limit
+	Duration    m_max_linger  = Duration::zero();   //!< a batch that isn't full waits that long for more. Zero doesn't wait
+	bool        m_adaptive    = false;              //!< only wait while answers to earlier writes are outstanding. When idle, write right away
+	bool        m_no_delay    = true;               //!< TCP_NODELAY. We batch ourselves, the kernel shouldn't hold back what we write
+	int         m_send_buffer = 0;                  //!< SO_SNDBUF in bytes. 0 leaves the system's default
+};
+
+/*! @brief how a connection tries to get its server back after losing it
+	Pauses between attempts double from m_initial_pause up to m_max_pause. A random part
+	of up to m_jitter is left out of each, so clients that lost the same server don't all
+	come back at the same moment. If the server can't be reached within m_open_after, the
+	circuit opens: the waiting requests fail and so does every new one, right away, until
+	an attempt in the background gets through.
+ */
+struct ReconnectPolicy {
+	Duration m_initial_pause = std::chrono::milliseconds(100);  //!< after the first attempt that failed
+	Duration m_max_pause     = std::chrono::seconds(5);         //!< pauses don't grow beyond that
+	double   m_jitter        = 0.5;                             //!< 0 to 1. Up to this part of a pause is randomly left out
+	Duration m_open_after    = std::chrono::seconds(2);         //!< waiting requests fail when not reconnected by then
+};
+
+//! Path of a unix domain socket to connect to, as opposed to a host name
+struct UnixSocket {
+	std::string m_path;
+};
+
 #if defined(BOOST_MSVC)
 void MredisTypesGetRidOfLNK4221();
 #endif
@@ -4,176 +4,920 @@
 //  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 
 #include "RESP.hpp"
-
-// #define BOOST_SPIRIT_DEBUG
-// #define BOOST_SPIRIT_DEBUG_PRINT_SOME 200
-// #define BOOST_SPIRIT_DEBUG_OUT std::cerr
+#include "RespScanner.hpp"
 
 #include "tools/Log.hpp"
+#include "tools/Assert.hpp"
 
-#include <boost/spirit/include/qi.hpp>
 #include <boost/spirit/include/karma.hpp>
-#include <boost/spirit/include/qi_parse.hpp>
 #include <boost/spirit/include/karma_format.hpp>
-#include <boost/spirit/include/support_multi_pass.hpp>
 #include <boost/spirit/include/phoenix.hpp>
 
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
 namespace moose {
 namespace mredis {
 
-namespace qi = boost::spirit::qi;
-namespace ascii = qi::ascii;
 namespace karma = boost::spirit::karma;
 namespace phx = boost::phoenix;
 using namespace moose::tools;
 
-template <typename InputIterator>
-struct simple_string_parser : qi::grammar<InputIterator, std::string()> {
+//! redis' own default for proto-max-bulk-len. Anything larger is not a valid bulk string
+constexpr boost::int64_t c_max_bulk_length = 512 * 1024 * 1024;
+
+//! don't trust array headers with our memory. Vectors grow beyond that if they must
+constexpr std::size_t c_max_array_reserve = 1024;
+
+//! longer lines are a protocol violation. Numbers and status lines are short, errors are a sentence
+constexpr std::size_t c_max_line_length = 64 * 1024;
+
+//! buffers for lines and bulk strings spanning reads are kept for the next one up to this size
+constexpr std::size_t c_max_kept_capacity = 64 * 1024;
+
+//! Deeper nesting is treated as protocol violation. Nothing redis sends comes near that
+//! but the recursive RedisMessage d'tor would have to walk it on the call stack
+constexpr std::size_t c_max_nesting_depth = 256;
 
-	simple_string_parser() : simple_string_parser::base_type(m_simple_start, "simple_string") {
+namespace {
 
-		// The docs are not very specific on what a simple ascii char is. I assume it's char_ except for space and newlines
-		m_simple_start %= '+' >> +(ascii::char_ - ascii::char_("\r\n")) >> "\r\n";
+//! empty it, giving its memory back if that was a lot
+void release(std::string &n_buffer) noexcept {
 
-//		BOOST_SPIRIT_DEBUG_NODES((m_simple_start));
+	if (n_buffer.capacity() > c_max_kept_capacity) {
+		std::string().swap(n_buffer);
+	} else {
+		n_buffer.clear();
 	}
+}
 
-	qi::rule<InputIterator, std::string()>  m_simple_start;
-};
+//! what a RESP aggregate type byte means on the tape
+ReplyType aggregate_reply_type(const char n_type) noexcept {
+
+	switch (n_type) {
+		default:
+		case '*':
+		case '|':
+			return ReplyType::Array;
+		case '%':
+			return ReplyType::Map;
+		case '~':
+			return ReplyType::Set;
+		case '>':
+			return ReplyType::Push;
+	}
+}
 
-template <typename InputIterator>
-struct bulk_string_parser : qi::grammar<InputIterator, std::string()> {
+}
+
+template <class Builder>
+BasicRespParser<Builder>::BasicRespParser()
+		: m_state{ State::Type }
+		, m_type{ 0 }
+		, m_bulk_remaining{ 0 }
+		, m_crlf_seen{ 0 } {
+}
+
+template <class Builder>
+std::size_t BasicRespParser<Builder>::feed(const char *n_begin, const char *n_end, result_type &n_response, bool &n_complete) {
+
+	n_complete = false;
+	const char *pos = n_begin;
+
+	while ((pos < n_end) && !n_complete) {
+
+		switch (m_state) {
+
+			case State::Type:
+				m_type = *pos++;
+				if (!m_type || !std::strchr("+-:$*_,#!=(%~|>", m_type)) {
+					fail("unknown type");
+					break;
+				}
+				m_state = State::Line;
+				break;
+
+			case State::Line: {
+				const char *newline = find_line_end(pos, n_end);
+				if (newline == n_end) {
+					// line continues in the next read, carry it over. A peer that never ends it doesn't get our memory
+					if (m_line.size() + static_cast<std::size_t>(n_end - pos) > c_max_line_length) {
+						fail("line too long");
+						break;
+					}
+					m_line.append(pos, n_end);
+					pos = n_end;
+					break;
+				}
+
+				const char *line_begin = pos;
+				const char *line_end = newline;
+				pos = newline + 1;
+
+				// Unless the line was split across reads we can take it right from the input
+				if (!m_line.empty()) {
+					m_line.append(line_begin, line_end);
+					line_begin = m_line.data();
+					line_end = line_begin + m_line.size();
+				}
+
+				if ((line_begin == line_end) || (*(line_end - 1) != '\r')) {
+					fail("line not terminated by CRLF");
+					break;
+				}
+
+				if (static_cast<std::size_t>(line_end - line_begin) > c_max_line_length + 1) {
+					fail("line too long");
+					break;
+				}
+
+				m_state = State::Type;
+				n_complete = handle_line(line_begin, line_end - 1, n_response);
+				release(m_line);
+				break;
+			}
+
+			case State::Bulk: {
+				const std::size_t available = static_cast<std::size_t>(n_end - pos);
+
+				// Most of the time the whole payload is in the buffer already. Take it
+				// in one piece, without looking at the bytes
+				if (m_bulk.empty() && (available >= m_bulk_remaining + 2)) {
+					const char *payload_end = pos + m_bulk_remaining;
+					if ((payload_end[0] != '\r') || (payload_end[1] != '\n')) {
+						fail("bulk string not terminated by CRLF");
+						break;
+					}
+
+					const char *payload_begin = pos;
+					pos = payload_end + 2;
+					m_bulk_remaining = 0;
+					m_state = State::Type;
+					n_complete = finish_bulk(payload_begin, payload_end, n_response);
+					break;
+				}
+
+				// It spans reads. Collect it in a buffer of its own, whatever comes next may go right in there
+				const std::size_t chunk = std::min(available, m_bulk_remaining);
+				if (m_bulk.empty()) {
+					m_bulk.resize(m_bulk_remaining);
+				}
+				std::memcpy(&m_bulk[m_bulk.size() - m_bulk_remaining], pos, chunk);
+				pos += chunk;
+				bulk_received(chunk);
+				break;
+			}
+
+			case State::BulkEnd:
+				if (*pos++ != "\r\n"[m_crlf_seen]) {
+					fail("bulk string not terminated by CRLF");
+					break;
+				}
+
+				if (++m_crlf_seen == 2) {
+					m_crlf_seen = 0;
+					m_state = State::Type;
+
+					// Plain bulk strings are the big ones. Let the builder have the buffer
+					if (m_type == '$') {
+						std::string value;
+						value.swap(m_bulk);
+						m_builder.bulk(std::move(value));
+						n_complete = complete_value(n_response);
+					} else {
+						n_complete = finish_bulk(m_bulk.data(), m_bulk.data() + m_bulk.size(), n_response);
+						release(m_bulk);
+					}
+				}
+				break;
+
+			case State::Failed:
+				return static_cast<std::size_t>(pos - n_begin);
+		}
+	}
 
-	bulk_string_parser()
-			: bulk_string_parser::base_type(m_bulk_start, "bulk_string")
-			, m_size(0) {
+	return static_cast<std::size_t>(pos - n_begin);
+}
+
+template <class Builder>
+bool BasicRespParser<Builder>::failed() const noexcept {
 
-		using qi::labels::_1;
-		using qi::_val;
+	return m_state == State::Failed;
+}
 
-		m_prefix      = '$' >> qi::ulong_[phx::ref(m_size) = _1] >> "\r\n";
-		m_bulk_start %= m_prefix >> qi::repeat(phx::ref(m_size))[qi::char_] >> "\r\n";
+template <class Builder>
+bool BasicRespParser<Builder>::busy() const noexcept {
+
+	return (m_state != State::Type) || !m_stack.empty();
+}
 
-//		BOOST_SPIRIT_DEBUG_NODES((m_prefix)(m_bulk_start));
+template <class Builder>
+void BasicRespParser<Builder>::reset() noexcept {
+
+	m_state = State::Type;
+	m_type = 0;
+	release(m_line);
+	release(m_bulk);
+	m_bulk_remaining = 0;
+	m_crlf_seen = 0;
+	m_stack.clear();
+	m_builder.reset();
+}
+
+template <class Builder>
+bool BasicRespParser<Builder>::handle_line(const char *n_begin, const char *n_end, result_type &n_response) {
+
+	switch (m_type) {
+
+		case '+':
+			m_builder.string(n_begin, n_end);
+			return complete_value(n_response);
+
+		case '-':
+			// Errors may appear inside arrays as well, e.g. a failed command in EXEC
+			m_builder.error(n_begin, n_end);
+			return complete_value(n_response);
+
+		case ':': {
+			boost::int64_t value = 0;
+			if (!parse_decimal(n_begin, n_end, value)) {
+				fail("malformed integer");
+				return false;
+			}
+			m_builder.integer(value);
+			return complete_value(n_response);
+		}
+
+		case '_':
+			if (n_begin != n_end) {
+				fail("malformed null");
+				return false;
+			}
+			m_builder.null();
+			return complete_value(n_response);
+
+		case ',': {
+			// from_chars knows about inf, -inf and nan, just like RESP3 does
+			double value = 0.0;
+			const std::from_chars_result res = std::from_chars(n_begin, n_end, value);
+			if ((n_begin == n_end) || (res.ec != std::errc()) || (res.ptr != n_end)) {
+				fail("malformed double");
+				return false;
+			}
+			m_builder.number(value);
+			return complete_value(n_response);
+		}
+
+		case '#':
+			if ((n_end - n_begin != 1) || ((*n_begin != 't') && (*n_begin != 'f'))) {
+				fail("malformed boolean");
+				return false;
+			}
+			m_builder.boolean(*n_begin == 't');
+			return complete_value(n_response);
+
+		case '(': {
+			const char *digits = ((n_begin != n_end) && (*n_begin == '-')) ? n_begin + 1 : n_begin;
+			if ((digits == n_end) || !std::all_of(digits, n_end, [](const char c) { return (c >= '0') && (c <= '9'); })) {
+				fail("malformed big number");
+				return false;
+			}
+			m_builder.big_number(n_begin, n_end);
+			return complete_value(n_response);
+		}
+
+		case '$':
+		case '!':
+		case '=': {
+			boost::int64_t length = 0;
+			if (!parse_decimal(n_begin, n_end, length) || (length < -1) || (length > c_max_bulk_length)) {
+				fail("malformed bulk string length");
+				return false;
+			}
+
+			if (length == -1) {
+				// RESP2 null bulk string
+				m_builder.null();
+				return complete_value(n_response);
+			}
+
+			// Don't reserve yet. If the payload is complete in the buffer we won't need m_bulk
+			m_bulk.clear();
+			m_bulk_remaining = static_cast<std::size_t>(length);
+			m_state = m_bulk_remaining ? State::Bulk : State::BulkEnd;
+			return false;
+		}
+
+		case '*':
+		case '%':
+		case '~':
+		case '|':
+		case '>': {
+			boost::int64_t size = 0;
+			if (!parse_decimal(n_begin, n_end, size) || (size < -1) || (size > c_max_bulk_length)) {
+				fail("malformed aggregate size");
+				return false;
+			}
+
+			if (size == -1) {
+				// RESP2 null array
+				m_builder.null();
+				return complete_value(n_response);
+			}
+
+			// maps and attributes announce pairs but we count elements
+			const bool pairs = (m_type == '%') || (m_type == '|');
+			return open_frame(m_type, static_cast<std::size_t>(pairs ? size * 2 : size), n_response);
+		}
+
+		default:
+			fail("unknown type");
+			return false;
 	}
+}
 
-	std::size_t                             m_size;
-	qi::rule<InputIterator>                 m_prefix;
-	qi::rule<InputIterator, std::string()>  m_bulk_start;
-};
+template <class Builder>
+bool BasicRespParser<Builder>::finish_bulk(const char *n_begin, const char *n_end, result_type &n_response) {
 
-unsigned long read_string_size(const std::string &v) {
+	if (m_type == '!') {
+		m_builder.error(n_begin, n_end);
+		return complete_value(n_response);
+	}
+	
+	if (m_type == '=') {
+		// verbatim strings start with a three letter format and a colon
+		if ((n_end - n_begin < 4) || (n_begin[3] != ':')) {
+			fail("malformed verbatim string");
+			return false;
+		}
+		m_builder.verbatim(n_begin, n_end);
+		return complete_value(n_response);
+	}
 
-	return static_cast<unsigned long>(v.size());
+	m_builder.bulk(n_begin, n_end);
+	return complete_value(n_response);
 }
 
-template <typename OutputIterator>
-struct bulk_string_generator : karma::grammar<OutputIterator, std::string()> {
+template <class Builder>
+bool BasicRespParser<Builder>::complete_value(result_type &n_response) {
 
-	bulk_string_generator() : bulk_string_generator::base_type(m_bulk_start, "bulk_string") {
+	// A value may complete its aggregate, which may complete the enclosing one and so on
+	while (!m_stack.empty()) {
+		if (--m_stack.back().m_remaining) {
+			return false;
+		}
 
-		using karma::labels::_1;
-		using karma::labels::_val;
+		const char type = m_stack.back().m_type;
+		m_stack.pop_back();
+		m_builder.close(type);
 
-		m_prefix    %= '$' << karma::ulong_ << "\r\n";
-		m_bulk_start = m_prefix[_1 = phx::bind(&read_string_size, _val)] << karma::string[_1 = _val] << "\r\n";
+		// Attributes describe the reply that follows. They are no element of their own
+		if (type == '|') {
+			return false;
+		}
 	}
 
-	karma::rule<OutputIterator, unsigned long()> m_prefix;
-	karma::rule<OutputIterator, std::string()>   m_bulk_start;
-};
+	m_builder.finish(n_response);
+	return true;
+}
 
-template <typename InputIterator>
-struct null_parser : qi::grammar<InputIterator, null_result()> {
+template <class Builder>
+bool BasicRespParser<Builder>::open_frame(const char n_type, const std::size_t n_expected, result_type &n_response) {
 
-	null_parser() : null_parser::base_type(m_null_start, "null") {
+	// Aggregates can contain further aggregates (EXEC, SCAN, XRANGE, Lua...). We go down
+	// on our own stack rather than recursing, so depth only costs heap
+	if (m_stack.size() >= c_max_nesting_depth) {
+		fail("aggregates nested too deep");
+		return false;
+	}
 
-		using qi::labels::_1;
+	m_builder.open(n_type, n_expected);
 
-		m_null_start = qi::lit("$-1\r\n")[_1 = phx::construct<null_result>()];
+	if (n_expected) {
+		m_stack.push_back(Frame{ n_type, n_expected });
+		return false;
 	}
 
-	qi::rule<InputIterator, null_result()>  m_null_start;
-};
+	// empty ones are done right away
+	m_builder.close(n_type);
+	if (n_type == '|') {
+		return false;
+	}
 
-template <typename OutputIterator>
-struct null_generator : karma::grammar<OutputIterator, null_result()> {
+	return complete_value(n_response);
+}
 
-	null_generator() : null_generator::base_type(m_null_start, "null") {
+template <class Builder>
+void BasicRespParser<Builder>::fail(const char *n_reason) noexcept {
 
-		using karma::labels::_1;
+	BOOST_LOG_SEV(logger(), warning) << "RESP protocol error, type '" << m_type << "': " << n_reason;
+	m_state = State::Failed;
+}
 
-		m_null_start = karma::lit("$-1\r\n")[_1];
+template <class Builder>
+boost::asio::mutable_buffer BasicRespParser<Builder>::bulk_tail() noexcept {
+
+	if ((m_state != State::Bulk) || m_bulk.empty()) {
+		return boost::asio::mutable_buffer();
 	}
 
-	karma::rule<OutputIterator, null_result()>  m_null_start;
-};
+	return boost::asio::mutable_buffer(&m_bulk[m_bulk.size() - m_bulk_remaining], m_bulk_remaining);
+}
 
-template <typename InputIterator>
-struct integer_parser : qi::grammar<InputIterator, boost::int64_t()> {
+template <class Builder>
+void BasicRespParser<Builder>::bulk_received(const std::size_t n_bytes) noexcept {
 
-	integer_parser() : integer_parser::base_type(m_int_start, "integer") {
+	MOOSE_ASSERT(n_bytes <= m_bulk_remaining);
 
-		m_int_start %= ':' >> qi::long_long >> qi::eol;
-//		BOOST_SPIRIT_DEBUG_NODE(m_int_start);
+	m_bulk_remaining -= n_bytes;
+	if (!m_bulk_remaining) {
+		m_state = State::BulkEnd;
 	}
+}
 
-	qi::rule<InputIterator, boost::int64_t()>  m_int_start;
-};
+template class MREDIS_API BasicRespParser<MessageBuilder>;
+template class MREDIS_API BasicRespParser<TapeBuilder>;
+template class MREDIS_API BasicRespParser<StreamBuilder>;
 
-template <typename OutputIterator>
-struct integer_generator : karma::grammar<OutputIterator, boost::int64_t()> {
+std::size_t RespTapeParser::feed(const SlabPtr &n_slab, const char *n_begin, const char *n_end, RedisReply &n_reply, bool &n_complete) {
 
-	integer_generator() : integer_generator::base_type(m_int_start, "integer") {
+	MOOSE_ASSERT((!n_slab || n_slab->contains(n_begin, n_end)));
 
-		m_int_start %= ':' << karma::long_long << "\r\n";
+	m_builder.set_input(n_slab);
+	const std::size_t consumed = BasicRespParser<TapeBuilder>::feed(n_begin, n_end, n_reply, n_complete);
+	m_builder.set_input(SlabPtr());
+	return consumed;
+}
+
+std::size_t RespStreamParser::feed(ReplyStream &n_stream, const char *n_begin, const char *n_end, RedisMessage &n_push, bool &n_complete) {
+
+	m_builder.set_stream(&n_stream);
+	const std::size_t consumed = BasicRespParser<StreamBuilder>::feed(n_begin, n_end, n_push, n_complete);
+	m_builder.set_stream(nullptr);
+	return consumed;
+}
+
+void MessageBuilder::string(const char *n_begin, const char *n_end) {
+
+	add(std::string(n_begin, n_end));
+}
+
+void MessageBuilder::bulk(const char *n_begin, const char *n_end) {
+
+	add(std::string(n_begin, n_end));
+}
+
+void MessageBuilder::bulk(std::string &&n_value) {
+
+	add(std::move(n_value));
+}
+
+void MessageBuilder::error(const char *n_begin, const char *n_end) {
+
+	redis_error err;
+	err.set_server_message(std::string(n_begin, n_end));
+	add(std::move(err));
+}
+
+void MessageBuilder::integer(const boost::int64_t n_value) {
+
+	add(n_value);
+}
+
+void MessageBuilder::null() {
+
+	add(null_result());
+}
+
+void MessageBuilder::number(const double n_value) {
+
+	add(double_result{ n_value });
+}
+
+void MessageBuilder::boolean(const bool n_value) {
+
+	add(boolean_result{ n_value });
+}
+
+void MessageBuilder::big_number(const char *n_begin, const char *n_end) {
+
+	add(big_number_result{ std::string(n_begin, n_end) });
+}
+
+void MessageBuilder::verbatim(const char *n_begin, const char *n_end) {
+
+	add(verbatim_result{ std::string(n_begin, n_begin + 3), std::string(n_begin + 4, n_end) });
+}
+
+void MessageBuilder::open(const char n_type, const std::size_t n_elements) {
+
+	m_stack.emplace_back();
+	Frame &frame = m_stack.back();
+	frame.m_type = n_type;
+
+	// don't trust the header with our memory
+	frame.m_elements.reserve(std::min(n_elements, c_max_array_reserve));
+}
+
+void MessageBuilder::close(const char n_type) {
+
+	std::vector<RedisMessage> elements(std::move(m_stack.back().m_elements));
+	m_stack.pop_back();
+
+	switch (n_type) {
+		default:
+		case '*':
+			add(std::move(elements));
+			return;
+
+		case '%': {
+			RedisMap map;
+			map.m_entries.reserve(elements.size() / 2);
+			for (std::size_t i = 0; i + 1 < elements.size(); i += 2) {
+				map.m_entries.emplace_back(std::move(elements[i]), std::move(elements[i + 1]));
+			}
+			add(std::move(map));
+			return;
+		}
+
+		case '~':
+			add(RedisSet{ std::move(elements) });
+			return;
+
+		case '>':
+			add(RedisPush{ std::move(elements) });
+			return;
+
+		case '|':
+			// Nothing in here uses attributes
+			return;
 	}
+}
 
-	karma::rule<OutputIterator, boost::int64_t()>  m_int_start;
-};
+void MessageBuilder::finish(RedisMessage &n_result) {
 
-template <typename InputIterator>
-struct array_parser : qi::grammar<InputIterator, std::vector<RedisMessage>() > {
+	n_result = std::move(m_result);
+}
 
-	array_parser() 
-			: array_parser::base_type(m_start, "array")
-			, m_size(0) {
+void MessageBuilder::reset() noexcept {
 
-		m_prefix = '*' >> qi::ulong_[phx::ref(m_size) = qi::labels::_1] >> "\r\n";
+	m_stack.clear();
+}
 
-		// I assume arrays can not contain error or further arrays. Not quite sure about the errors though
-		m_variant %= m_simple_string | m_integer | m_null_result | m_bulk_string;
+void MessageBuilder::add(RedisMessage &&n_value) {
 
-		m_start %= m_prefix >> qi::repeat(phx::ref(m_size))[m_variant];
+	if (m_stack.empty()) {
+		m_result = std::move(n_value);
+	} else {
+		m_stack.back().m_elements.push_back(std::move(n_value));
 	}
+}
+
+void TapeBuilder::set_input(const SlabPtr &n_slab) noexcept {
+
+	m_input = n_slab;
+}
+
+void TapeBuilder::string(const char *n_begin, const char *n_end) {
+
+	append_string(ReplyType::String, n_begin, n_end);
+}
+
+void TapeBuilder::bulk(const char *n_begin, const char *n_end) {
+
+	append_string(ReplyType::String, n_begin, n_end);
+}
+
+void TapeBuilder::bulk(std::string &&n_value) {
+
+	// This one was assembled from several reads. We keep the string as it is
+	std::shared_ptr<const std::string> spilled{ std::make_shared<const std::string>(std::move(n_value)) };
+	TapeEntry &entry = append(ReplyType::String);
+	entry.m_data = spilled->data();
+	entry.m_size = spilled->size();
+	m_reply.m_owners.push_back(std::move(spilled));
+}
 
-	std::size_t                                           m_size;
-	qi::rule<InputIterator>                               m_prefix;
-	qi::rule<InputIterator, RedisMessage()>               m_variant;
-	integer_parser<InputIterator>                         m_integer;
-	simple_string_parser<InputIterator>                   m_simple_string;
-	bulk_string_parser<InputIterator>                     m_bulk_string;
-	null_parser<InputIterator>                            m_null_result;
-	qi::rule<InputIterator, std::vector<RedisMessage>() > m_start;
+void TapeBuilder::error(const char *n_begin, const char *n_end) {
+
+	append_string(ReplyType::Error, n_begin, n_end);
+}
+
+void TapeBuilder::integer(const boost::int64_t n_value) {
+
+	append(ReplyType::Integer).m_integer = n_value;
+}
+
+void TapeBuilder::null() {
+
+	append(ReplyType::Null).m_integer = 0;
+}
+
+void TapeBuilder::number(const double n_value) {
+
+	append(ReplyType::Double).m_double = n_value;
+}
+
+void TapeBuilder::boolean(const bool n_value) {
+
+	append(ReplyType::Boolean).m_integer = n_value ? 1 : 0;
+}
+
+void TapeBuilder::big_number(const char *n_begin, const char *n_end) {
+
+	append_string(ReplyType::BigNumber, n_begin, n_end);
+}
+
+void TapeBuilder::verbatim(const char *n_begin, const char *n_end) {
+
+	append_string(ReplyType::Verbatim, n_begin, n_end);
+}
+
+void TapeBuilder::open(const char n_type, const std::size_t n_elements) {
+
+	// attributes are dropped at close anyway
+	m_open.push_back(m_reply.m_tape.size());
+	TapeEntry &entry = append(aggregate_reply_type(n_type));
+	entry.m_size = n_elements;
+	entry.m_next = 0;
+}
+
+void TapeBuilder::close(const char n_type) {
+
+	const std::size_t index = m_open.back();
+	m_open.pop_back();
+
+	if (n_type == '|') {
+		// Nothing in here uses attributes. Whatever they pointed to stays owned, which is harmless
+		m_reply.m_tape.resize(index);
+		return;
+	}
+
+	m_reply.m_tape[index].m_next = m_reply.m_tape.size();
+}
+
+void TapeBuilder::finish(RedisReply &n_result) {
+
+	n_result = std::move(m_reply);
+	m_reply = RedisReply();
+	m_owned = nullptr;
+}
+
+void TapeBuilder::reset() noexcept {
+
+	m_reply = RedisReply();
+	m_open.clear();
+	m_owned = nullptr;
+}
+
+TapeEntry &TapeBuilder::append(const ReplyType n_type) {
+
+	m_reply.m_tape.emplace_back();
+	TapeEntry &entry = m_reply.m_tape.back();
+	entry.m_type = n_type;
+	entry.m_size = 0;
+	return entry;
+}
+
+void TapeBuilder::append_string(const ReplyType n_type, const char *n_begin, const char *n_end) {
+
+	const char *data = n_begin;
+
+	if (m_input && m_input->contains(n_begin, n_end)) {
+		// The usual case. Point into the slab and keep it alive. Once per reply, unless it's fed alternating slabs
+		if (m_owned != m_input.get()) {
+			m_reply.m_owners.push_back(m_input);
+			m_owned = m_input.get();
+		}
+	} else if (n_begin != n_end) {
+		// Parser's own buffer. Gone after this call
+		std::shared_ptr<const std::string> spilled{ std::make_shared<const std::string>(n_begin, n_end) };
+		data = spilled->data();
+		m_reply.m_owners.push_back(std::move(spilled));
+	}
+
+	TapeEntry &entry = append(n_type);
+	entry.m_data = data;
+	entry.m_size = static_cast<std::size_t>(n_end - n_begin);
+}
+
+StreamBuilder::StreamBuilder()
+		: m_stream{ nullptr }
+		, m_depth{ 0 }
+		, m_attribute_depth{ 0 }
+		, m_collect{ false } {
+}
+
+void StreamBuilder::set_stream(ReplyStream *n_stream) noexcept {
+
+	m_stream = n_stream;
+}
+
+void StreamBuilder::string(const char *n_begin, const char *n_end) {
+
+	if (m_collect) {
+		m_push.string(n_begin, n_end);
+	} else {
+		deliver(std::string(n_begin, n_end));
+	}
+}
+
+void StreamBuilder::bulk(const char *n_begin, const char *n_end) {
+
+	if (m_collect) {
+		m_push.bulk(n_begin, n_end);
+	} else {
+		deliver(std::string(n_begin, n_end));
+	}
+}
+
+void StreamBuilder::bulk(std::string &&n_value) {
+
+	if (m_collect) {
+		m_push.bulk(std::move(n_value));
+	} else {
+		deliver(std::move(n_value));
+	}
+}
+
+void StreamBuilder::error(const char *n_begin, const char *n_end) {
+
+	if (m_collect) {
+		m_push.error(n_begin, n_end);
+	} else {
+		redis_error err;
+		err.set_server_message(std::string(n_begin, n_end));
+		deliver(std::move(err));
+	}
+}
+
+void StreamBuilder::integer(const boost::int64_t n_value) {
+
+	if (m_collect) {
+		m_push.integer(n_value);
+	} else {
+		deliver(n_value);
+	}
+}
+
+void StreamBuilder::null() {
+
+	if (m_collect) {
+		m_push.null();
+	} else {
+		deliver(null_result());
+	}
+}
+
+void StreamBuilder::number(const double n_value) {
+
+	if (m_collect) {
+		m_push.number(n_value);
+	} else {
+		deliver(double_result{ n_value });
+	}
+}
+
+void StreamBuilder::boolean(const bool n_value) {
+
+	if (m_collect) {
+		m_push.boolean(n_value);
+	} else {
+		deliver(boolean_result{ n_value });
+	}
+}
+
+void StreamBuilder::big_number(const char *n_begin, const char *n_end) {
+
+	if (m_collect) {
+		m_push.big_number(n_begin, n_end);
+	} else {
+		deliver(big_number_result{ std::string(n_begin, n_end) });
+	}
+}
+
+void StreamBuilder::verbatim(const char *n_begin, const char *n_end) {
+
+	if (m_collect) {
+		m_push.verbatim(n_begin, n_end);
+	} else {
+		deliver(verbatim_result{ std::string(n_begin, n_begin + 3), std::string(n_begin + 4, n_end) });
+	}
+}
+
+void StreamBuilder::open(const char n_type, const std::size_t n_elements) {
+
+	// Pushes are out of band and go elsewhere. They are small, build them conventionally
+	if (!m_depth && (n_type == '>')) {
+		m_collect = true;
+	}
+
+	++m_depth;
+
+	if (m_collect) {
+		m_push.open(n_type, n_elements);
+		return;
+	}
+
+	if (!m_attribute_depth && (n_type == '|')) {
+		m_attribute_depth = m_depth;
+	}
+
+	if (!m_attribute_depth && m_stream && m_stream->m_begin) {
+		m_stream->m_begin(aggregate_reply_type(n_type), n_elements);
+	}
+}
+
+void StreamBuilder::close(const char n_type) {
+
+	const std::size_t depth = m_depth--;
+
+	if (m_collect) {
+		m_push.close(n_type);
+		return;
+	}
+
+	if (m_attribute_depth) {
+		if (depth == m_attribute_depth) {
+			m_attribute_depth = 0;
+		}
+		return;
+	}
+
+	if (m_stream && m_stream->m_end) {
+		m_stream->m_end(aggregate_reply_type(n_type));
+	}
+}
+
+void StreamBuilder::finish(RedisMessage &n_result) {
+
+	if (m_collect) {
+		m_push.finish(n_result);
+		m_collect = false;
+	} else {
+		n_result = null_result();
+	}
+}
+
+void StreamBuilder::reset() noexcept {
+
+	m_depth = 0;
+	m_attribute_depth = 0;
+	m_collect = false;
+	m_push.reset();
+}
+
+void StreamBuilder::deliver(RedisMessage &&n_value) {
+
+	if (!m_attribute_depth && m_stream && m_stream->m_element) {
+		m_stream->m_element(n_value);
+	}
+}
+
+unsigned long read_string_size(const std::string &v) {
+
+	return static_cast<unsigned long>(v.size());
+}
+
+template <typename OutputIterator>
+struct bulk_string_generator : karma::grammar<OutputIterator, std::string()> {
+
+	bulk_string_generator() : bulk_string_generator::base_type(m_bulk_start, "bulk_string") {
+
+		using karma::labels::_1;
+		using karma::labels::_val;
+
+		m_prefix    %= '$' << karma::ulong_ << "\r\n";
+		m_bulk_start = m_prefix[_1 = phx::bind(&read_string_size, _val)] << karma::string[_1 = _val] << "\r\n";
+	}
+
+	karma::rule<OutputIterator, unsigned long()> m_prefix;
+	karma::rule<OutputIterator, std::string()>   m_bulk_start;
 };
 
-template <typename InputIterator>
-struct error_parser : qi::grammar<InputIterator, redis_error()> {
+template <typename OutputIterator>
+struct null_generator : karma::grammar<OutputIterator, null_result()> {
+
+	null_generator() : null_generator::base_type(m_null_start, "null") {
+
+		using karma::labels::_1;
+
+		m_null_start = karma::lit("$-1\r\n")[_1];
+	}
 
-	error_parser() : error_parser::base_type(m_start, "error") {
+	karma::rule<OutputIterator, null_result()>  m_null_start;
+};
 
-		using qi::_val;
-		using qi::labels::_1;
+template <typename OutputIterator>
+struct integer_generator : karma::grammar<OutputIterator, boost::int64_t()> {
 
-		// Very similar to basic string but I need a different type		
-		m_error_text %= +(ascii::char_ - qi::eol);
+	integer_generator() : integer_generator::base_type(m_int_start, "integer") {
 
-		m_start = qi::lit('-')[_val = phx::construct<redis_error>()] >>
-			m_error_text[phx::bind(&redis_error::set_server_message, _val, _1)] >> qi::eol;
+		m_int_start %= ':' << karma::long_long << "\r\n";
 	}
 
-	qi::rule<InputIterator, std::string()>  m_error_text;
-	qi::rule<InputIterator, redis_error()>  m_start;
+	karma::rule<OutputIterator, boost::int64_t()>  m_int_start;
 };
 
 // phoenix function to extract the server message.
@@ -210,14 +954,14 @@ unsigned long read_msg_vec_size(const std::vector<RedisMessage> &n_vector) {
 
 template <typename OutputIterator>
 struct array_generator : karma::grammar<OutputIterator, std::vector<RedisMessage>() > {
-	
+
 	array_generator() : array_generator::base_type(m_start, "array") {
 
 		using karma::labels::_1;
 		using karma::labels::_val;
 
 		m_prefix  %= '*' << karma::ulong_ << "\r\n";
-		m_variant %= m_bulk_string | m_integer | m_null_result | m_error;
+		m_variant %= m_bulk_string | m_integer | m_null_result | m_error | m_start;
 		m_start    = m_prefix[_1 = phx::bind(&read_msg_vec_size, _val)] << (*m_variant)[_1 = _val];
 	}
 
@@ -230,23 +974,6 @@ struct array_generator : karma::grammar<OutputIterator, std::vector<RedisMessage
 	karma::rule<OutputIterator, std::vector<RedisMessage>() >  m_start;
 };
 
-template <typename InputIterator>
-struct message_parser : qi::grammar<InputIterator, RedisMessage()> {
-
-	message_parser() : message_parser::base_type(m_start, "message") {
-	
-		m_start %= m_simple_string | m_integer | m_array | m_null_result | m_bulk_string | m_error;
-	}
-
-	integer_parser<InputIterator>        m_integer;
-	simple_string_parser<InputIterator>  m_simple_string;
-	bulk_string_parser<InputIterator>    m_bulk_string;
-	null_parser<InputIterator>           m_null_result;
-	array_parser<InputIterator>          m_array;
-	error_parser<InputIterator>          m_error;
-	qi::rule<InputIterator, RedisMessage()>  m_start;
-};
-
 template <typename OutputIterator>
 struct message_generator : karma::grammar<OutputIterator, RedisMessage()> {
 
@@ -254,7 +981,7 @@ struct message_generator : karma::grammar<OutputIterator, RedisMessage()> {
 
 		m_start   %= m_integer | m_array | m_null | m_bulk_string | m_error;
 	}
-	
+
 	null_generator<OutputIterator>                 m_null;
 	array_generator<OutputIterator>                m_array;
 	integer_generator<OutputIterator>              m_integer;
@@ -263,24 +990,19 @@ struct message_generator : karma::grammar<OutputIterator, RedisMessage()> {
 	karma::rule<OutputIterator, RedisMessage()>    m_start;
 };
 
-// since we should only be parsing from one thread,
-// it should be safe to re-use one object
-using stream_iterator_type = std::istreambuf_iterator<char>;
-message_parser<boost::spirit::multi_pass<stream_iterator_type> > s_response_stream_parser;
+bool parse(const std::string &n_input, RedisMessage &n_response) {
+
+	RespParser parser;
+	bool complete = false;
+	const std::size_t consumed = parser.feed(n_input.data(), n_input.data() + n_input.size(), n_response, complete);
 
-message_parser<const char *> s_response_parser;
+	return complete && (consumed == n_input.size());
+}
 
 RedisMessage parse_one(std::istream &n_is) {
-	
-	boost::spirit::multi_pass<stream_iterator_type> first =
-		boost::spirit::make_default_multi_pass(stream_iterator_type(n_is));
-	const boost::spirit::multi_pass<stream_iterator_type> last =
-		boost::spirit::make_default_multi_pass(stream_iterator_type());
-	
-	message_parser<boost::spirit::multi_pass<stream_iterator_type> > p;
 
 	RedisMessage result;
-	if (!qi::parse(first, last, s_response_stream_parser, result) || (first != last)) {
+	if (!parse_from_stream(n_is, result) || (n_is.rdbuf()->sgetc() != std::char_traits<char>::eof())) {
 		return redis_error();
 	} else {
 		return result;
@@ -289,20 +1011,33 @@ RedisMessage parse_one(std::istream &n_is) {
 
 bool parse_from_stream(std::istream &n_is, RedisMessage &n_response) noexcept {
 
-// Original code problematic as incomplete parse will consume parts of the stream.
-//
-// 	boost::spirit::multi_pass<stream_iterator_type> first =
-// 		boost::spirit::make_default_multi_pass(stream_iterator_type(n_is));
-// 	const boost::spirit::multi_pass<stream_iterator_type> last =
-// 		boost::spirit::make_default_multi_pass(stream_iterator_type());
-// 
-// 	const bool retval = qi::parse(first, last, s_response_parser, n_response);
-// 
-// 	return retval;
-// 
-//  Until a solution is found I'm gonna have to copy the input buffer and parse from there.
-
-	return false;
+	// A stream cannot give back what we have read, so I feed it byte by byte.
+	// This way we stop right after the message and never take more than that.
+	// Slow but it's only used for testing and debugging.
+	try {
+		std::streambuf *sb = n_is.rdbuf();
+		RespParser parser;
+		bool complete = false;
+
+		while (!complete) {
+			const std::char_traits<char>::int_type c = sb->sbumpc();
+			if (c == std::char_traits<char>::eof()) {
+				return false;
+			}
+
+			const char byte = std::char_traits<char>::to_char_type(c);
+			parser.feed(&byte, &byte + 1, n_response, complete);
+			if (parser.failed()) {
+				return false;
+			}
+		}
+
+		return true;
+
+	} catch (const std::exception &sex) {
+		BOOST_LOG_SEV(logger(), error) << "Exception parsing response from stream: " << sex.what();
+		return false;
+	}
 }
 
 bool parse_from_streambuf(boost::asio::streambuf &n_streambuf, RedisMessage &n_response) noexcept {
@@ -311,22 +1046,54 @@ bool parse_from_streambuf(boost::asio::streambuf &n_streambuf, RedisMessage &n_r
 		return false;
 	}
 
-	const char *original_begin = reinterpret_cast<const char *>(n_streambuf.data().data());
-	const char *begin_ptr = original_begin;
-	const char *end_ptr = begin_ptr + n_streambuf.size();
+	try {
+		const char *begin_ptr = reinterpret_cast<const char *>(n_streambuf.data().data());
+		const char *end_ptr = begin_ptr + n_streambuf.size();
 
-	const bool retval = qi::parse(begin_ptr, end_ptr, s_response_parser, n_response);
+		RespParser parser;
+		bool complete = false;
+		const std::size_t bytes_to_consume = parser.feed(begin_ptr, end_ptr, n_response, complete);
 
-	if (retval) {
-		const std::size_t bytes_to_consume = begin_ptr - original_begin;
-		MOOSE_ASSERT(bytes_to_consume)
+		if (complete) {
+			MOOSE_ASSERT(bytes_to_consume)
 
-		// We have parsed one message successfully. This means, begin_ptr 
-		// should now point to where the msg ended. We consume the buffer to remove it
-		n_streambuf.consume(bytes_to_consume);
+			// We have parsed one message successfully. We consume the buffer to remove it
+			n_streambuf.consume(bytes_to_consume);
+		}
+
+		return complete;
+
+	} catch (const std::exception &sex) {
+		BOOST_LOG_SEV(logger(), error) << "Exception parsing response: " << sex.what();
+		return false;
+	}
+}
+
+bool parse_from_streambuf(RespParser &n_parser, boost::asio::streambuf &n_streambuf, RedisMessage &n_response) noexcept {
+
+	if (!n_streambuf.size()) {
+		return false;
 	}
 
-	return retval;
+	try {
+		const char *begin_ptr = reinterpret_cast<const char *>(n_streambuf.data().data());
+		const char *end_ptr = begin_ptr + n_streambuf.size();
+
+		bool complete = false;
+		const std::size_t bytes_to_consume = n_parser.feed(begin_ptr, end_ptr, n_response, complete);
+
+		// Whatever the parser has seen is now part of its state, the buffer can let go of it
+		n_streambuf.consume(bytes_to_consume);
+
+		return complete;
+
+	} catch (const std::exception &sex) {
+		BOOST_LOG_SEV(logger(), error) << "Exception parsing response: " << sex.what();
+
+		// We don't know how far it got. No way to stay in sync with the stream after that
+		n_parser.fail("exception while parsing");
+		return false;
+	}
 }
 
 
@@ -338,3 +1105,4 @@ void generate_to_stream(std::ostream &n_os, const RedisMessage &n_message) {
 
 }
 }
+
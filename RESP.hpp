@@ -7,13 +7,16 @@
 #include "MRedisConfig.hpp"
 #include "MRedisResult.hpp"
 #include "MRedisTypes.hpp"
+#include "RespTape.hpp"
 
 #include <boost/variant.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/asio/buffer.hpp>
 #include <boost/asio/streambuf.hpp>
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include <chrono>
 
 namespace moose {
@@ -22,21 +25,299 @@ namespace mredis {
 /*! Raw protocol implementation
  */
 
-// debug
+/*! @brief turns what the parser finds into a RedisMessage
+	Aggregates are collected in vectors on a stack until they are complete.
+	Used by RespParser, you won't need it directly.
+ */
+class MREDIS_API MessageBuilder {
+
+	public:
+		using result_type = RedisMessage;
+
+		void string(const char *n_begin, const char *n_end);
+		void bulk(const char *n_begin, const char *n_end);
+		void bulk(std::string &&n_value);
+		void error(const char *n_begin, const char *n_end);
+		void integer(const boost::int64_t n_value);
+		void null();
+		void number(const double n_value);
+		void boolean(const bool n_value);
+		void big_number(const char *n_begin, const char *n_end);
+
+		//! whole payload, including the format and colon
+		void verbatim(const char *n_begin, const char *n_end);
+
+		//! an aggregate of n_type starts. n_elements is twice the pairs for maps
+		void open(const char n_type, const std::size_t n_elements);
+
+		//! innermost aggregate of n_type is complete
+		void close(const char n_type);
+
+		//! the message is complete, hand it out
+		void finish(RedisMessage &n_result);
+
+		void reset() noexcept;
+
+	private:
+		struct Frame {
+			char                      m_type;
+			std::vector<RedisMessage> m_elements;
+		};
+
+		//! put into the enclosing aggregate or make it the result
+		void add(RedisMessage &&n_value);
+
+		std::vector<Frame> m_stack;    //!< aggregates still waiting for elements, innermost last
+		RedisMessage       m_result;
+};
+
+/*! @brief turns what the parser finds into a RedisReply
+	Strings inside the current input slab are referenced, all others copied.
+	Used by RespTapeParser, you won't need it directly.
+ */
+class MREDIS_API TapeBuilder {
+
+	public:
+		using result_type = RedisReply;
+
+		//! strings within this slab are referenced rather than copied
+		void set_input(const SlabPtr &n_slab) noexcept;
+
+		void string(const char *n_begin, const char *n_end);
+		void bulk(const char *n_begin, const char *n_end);
+		void bulk(std::string &&n_value);
+		void error(const char *n_begin, const char *n_end);
+		void integer(const boost::int64_t n_value);
+		void null();
+		void number(const double n_value);
+		void boolean(const bool n_value);
+		void big_number(const char *n_begin, const char *n_end);
+		void verbatim(const char *n_begin, const char *n_end);
+		void open(const char n_type, const std::size_t n_elements);
+		void close(const char n_type);
+		void finish(RedisReply &n_result);
+		void reset() noexcept;
+
+	private:
+		TapeEntry &append(const ReplyType n_type);
+		void append_string(const ReplyType n_type, const char *n_begin, const char *n_end);
+
+		SlabPtr                  m_input;   //!< what we are currently fed from
+		RedisReply               m_reply;   //!< under construction
+		std::vector<std::size_t> m_open;    //!< tape index of aggregates still waiting for elements
+		const void              *m_owned = nullptr;  //!< slab last added to m_reply's owners. It keeps it alive, so the address is not reused
+};
+
+/*! @brief hands what the parser finds to a ReplyStream, one element at a time
+	Nothing is kept but the current element. Pushes are the exception, they are
+	built into a RedisMessage as they are out of band and no business of the stream.
+	Used by RespStreamParser, you won't need it directly.
+ */
+class MREDIS_API StreamBuilder {
+
+	public:
+		//! a push message or null_result when the reply went to the stream
+		using result_type = RedisMessage;
+
+		StreamBuilder();
+
+		//! elements go to this one. May be null, then they are discarded
+		void set_stream(ReplyStream *n_stream) noexcept;
+
+		void string(const char *n_begin, const char *n_end);
+		void bulk(const char *n_begin, const char *n_end);
+		void bulk(std::string &&n_value);
+		void error(const char *n_begin, const char *n_end);
+		void integer(const boost::int64_t n_value);
+		void null();
+		void number(const double n_value);
+		void boolean(const bool n_value);
+		void big_number(const char *n_begin, const char *n_end);
+		void verbatim(const char *n_begin, const char *n_end);
+		void open(const char n_type, const std::size_t n_elements);
+		void close(const char n_type);
+		void finish(RedisMessage &n_result);
+		void reset() noexcept;
+
+	private:
+		//! hand a scalar to the stream, unless it belongs to an attribute
+		void deliver(RedisMessage &&n_value);
+
+		ReplyStream     *m_stream;
+		std::size_t      m_depth;            //!< aggregates currently open
+		std::size_t      m_attribute_depth;  //!< depth of the attribute we are in or 0. Its contents are dropped
+		bool             m_collect;          //!< this is a push, build it in m_push
+		MessageBuilder   m_push;
+};
+
+/*! @brief resumable parser for server responses
+	Bytes are fed in as they come off the socket. The parser keeps its position
+	and all partially received messages between calls, so a large reply that
+	arrives over many reads is still only looked at once.
+
+	Arrays may be nested to any reasonable depth and contain errors. Nesting is
+	tracked on an explicit stack, no recursion. Replies nested deeper than 256
+	levels are rejected as protocol error.
+
+	Understands RESP3 as well, which is a superset of RESP2. Attributes are 
+	parsed but dropped as nothing in here asks for them.
+
+	What comes out is up to the Builder. See RespParser and RespTapeParser.
+
+	Not thread safe. Use one per connection.
+ */
+template <class Builder>
+class BasicRespParser {
+
+	public:
+		using result_type = typename Builder::result_type;
+
+		BasicRespParser();
+		BasicRespParser(const BasicRespParser &) = delete;
+		BasicRespParser &operator=(const BasicRespParser &) = delete;
+
+		/*! @brief feed raw bytes into the parser
+			Parsing stops when one message is complete or the input is exhausted,
+			whichever comes first. Partial messages are kept for the next call.
+			@param n_response will hold the message when n_complete is set
+			@param n_complete true if one complete message was parsed
+			@return number of bytes consumed from the input
+			@throw std::bad_alloc
+		 */
+		std::size_t feed(const char *n_begin, const char *n_end, result_type &n_response, bool &n_complete);
+
+		//! @return true if the input violated the protocol. The parser needs a reset() to continue
+		bool failed() const noexcept;
+
+		//! @return true if the parser is in the middle of a message
+		bool busy() const noexcept;
+
+		//! discard all partial state, for example after reconnect
+		void reset() noexcept;
+
+		//! put the parser into failed state, for example when it was interrupted by an exception
+		void fail(const char *n_reason) noexcept;
+
+		/*! @brief where the rest of a bulk string can be received to, without going through the input
+			A bulk string that doesn't fit into one read is collected in a buffer of its own,
+			sized by its header. Once that is started, the rest can go straight in there.
+			@return what is still missing of it. Empty if no bulk string is being collected
+		 */
+		boost::asio::mutable_buffer bulk_tail() noexcept;
+
+		//! n_bytes were received into the front of bulk_tail()
+		void bulk_received(const std::size_t n_bytes) noexcept;
+
+	protected:
+		Builder            m_builder;
+
+	private:
+		enum class State {
+			Type = 0,   //!< expecting the type byte of the next element
+			Line,       //!< reading up to the next CRLF
+			Bulk,       //!< copying bulk string payload
+			BulkEnd,    //!< expecting the CRLF after bulk string payload
+			Failed      //!< protocol error, we cannot continue
+		};
+
+		//! an aggregate (array, map, set...) we have seen the header of but not all the elements yet
+		struct Frame {
+			char                      m_type;
+			std::size_t               m_remaining;  //!< elements still to come, twice the pairs for maps
+		};
+
+		//! act on a complete line of the current type
+		//! @return true when this completed the message
+		bool handle_line(const char *n_begin, const char *n_end, result_type &n_response);
+
+		//! bulk payload of the current type is complete, hand it to the builder
+		//! @return true when this completed the message
+		bool finish_bulk(const char *n_begin, const char *n_end, result_type &n_response);
+
+		//! a value was handed to the builder. Count it towards the enclosing aggregates
+		//! @return true when this completed the message
+		bool complete_value(result_type &n_response);
+
+		//! start a new aggregate of n_type
+		//! @return true when this completed the message, which happens with empty ones
+		bool open_frame(const char n_type, const std::size_t n_expected, result_type &n_response);
+
+		State              m_state;
+		char               m_type;            //!< type byte of the element we are reading
+		std::string        m_line;            //!< line data carried over from the previous read
+		std::string        m_bulk;            //!< bulk payload that didn't fit into one read. Sized by the header
+		std::size_t        m_bulk_remaining;  //!< bulk payload bytes still to come
+		unsigned int       m_crlf_seen;       //!< how much of the bulk terminator we have seen
+		std::vector<Frame> m_stack;           //!< aggregates still waiting for elements, innermost last
+};
+
+extern template class MREDIS_API BasicRespParser<MessageBuilder>;
+extern template class MREDIS_API BasicRespParser<TapeBuilder>;
+extern template class MREDIS_API BasicRespParser<StreamBuilder>;
+
+//! parses into RedisMessage, copying all strings
+using RespParser = BasicRespParser<MessageBuilder>;
+
+/*! @brief parses into zero-copy RedisReply
+	Strings are referenced where they were received, as long as they are within
+	one slab. Only those spanning several reads are copied.
+ */
+class MREDIS_API RespTapeParser : public BasicRespParser<TapeBuilder> {
+
+	public:
+		using BasicRespParser<TapeBuilder>::feed;
+
+		/*! @brief like BasicRespParser::feed()
+			@param n_slab contains the input. The reply will point into it and keep it alive
+		 */
+		std::size_t feed(const SlabPtr &n_slab, const char *n_begin, const char *n_end, RedisReply &n_reply, bool &n_complete);
+};
+
+/*! @brief parses into a ReplyStream, element by element
+	Memory stays bounded by the largest single element, no matter how large
+	the reply is.
+ */
+class MREDIS_API RespStreamParser : public BasicRespParser<StreamBuilder> {
+
+	public:
+		using BasicRespParser<StreamBuilder>::feed;
+
+		/*! @brief like BasicRespParser::feed()
+			@param n_stream gets the elements as they are parsed
+			@param n_push will hold a push message if that is what was completed. Those don't go to the stream
+		 */
+		std::size_t feed(ReplyStream &n_stream, const char *n_begin, const char *n_end, RedisMessage &n_push, bool &n_complete);
+};
+
+/*! Parse a string that is expected to contain exactly one message
+	@return false on cannot parse one
+ */
 MREDIS_API bool parse(const std::string &n_input, RedisMessage &n_response);
 
+/*! Parse a stream that is expected to contain exactly one message
+	@return the message or a redis_error if parsing failed
+ */
 MREDIS_API RedisMessage parse_one(std::istream &n_is);
 
 /*! Parse one message from the stream.
+	Only the bytes belonging to the message are taken out of the stream.
 	@return false on cannot parse any
  */
 MREDIS_API bool parse_from_stream(std::istream &n_is, RedisMessage &n_response) noexcept;
 
 /*! Parse one message from the streambuf and consume if successful.
+	This has to start over each time. Prefer the resumable overload below.
 	@return false on cannot parse any
  */
 MREDIS_API bool parse_from_streambuf(boost::asio::streambuf &n_streambuf, RedisMessage &n_response) noexcept;
 
+/*! Parse one message from the streambuf, resuming where the last call left off.
+	Everything the parser has looked at is consumed, even when no message was completed.
+	Check n_parser.failed() when this returns false.
+	@return false on no complete message available yet
+ */
+MREDIS_API bool parse_from_streambuf(RespParser &n_parser, boost::asio::streambuf &n_streambuf, RedisMessage &n_response) noexcept;
+
 /*! Generate to stream
 	Mostly for testing
  */
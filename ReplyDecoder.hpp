@@ -0,0 +1,276 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "MRedisConfig.hpp"
+#include "MRedisError.hpp"
+#include "RespScanner.hpp"
+#include "RespTape.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/future.hpp>
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace moose {
+namespace mredis {
+
+/*! Decoding replies straight into the type you want
+
+	decode<T>() turns a reply into T by a decoder chosen at compile time. There is no
+	RedisMessage in between and no checking which() it is. Supported are std::string,
+	integers, double, bool, std::optional of those for nil values and vectors, sets
+	and maps of all that. Maps are taken from RESP3 maps as well as from the flat
+	field/value arrays RESP2 has for HGETALL.
+
+	Specialize ReplyDecoder for your own types.
+ */
+
+//! the reply doesn't fit the type asked for
+[[noreturn]] inline void throw_unexpected_reply(const ReplyView &n_view, const char *n_expected) {
+
+	using namespace moose::tools;
+	BOOST_THROW_EXCEPTION(redis_error()
+			<< error_message(std::string("Unexpected return type, not ") + n_expected)
+			<< error_argument(static_cast<int>(n_view.type())));
+}
+
+template <typename T, typename Enable = void>
+struct ReplyDecoder {
+
+	static T decode(const ReplyView &) {
+
+		static_assert(sizeof(T) == -1, "No decoder for this type. Specialize ReplyDecoder");
+	}
+};
+
+/*! @brief decode a reply into T
+	@throw redis_error if the server returned an error or the reply doesn't fit T
+ */
+template <typename T>
+T decode(const ReplyView &n_view) {
+
+	if (n_view.is_error()) {
+		redis_error err;
+		err.set_server_message(std::string(n_view.string()));
+		BOOST_THROW_EXCEPTION(err);
+	}
+
+	return ReplyDecoder<T>::decode(n_view);
+}
+
+template <>
+struct ReplyDecoder<std::string> {
+
+	static std::string decode(const ReplyView &n_view) {
+
+		switch (n_view.type()) {
+			case ReplyType::String:
+			case ReplyType::BigNumber:
+			case ReplyType::Verbatim:
+				return std::string(n_view.string());
+			default:
+				throw_unexpected_reply(n_view, "a string");
+		}
+	}
+};
+
+//! all integers. Strings are converted as redis stores numbers that way
+template <typename T>
+struct ReplyDecoder<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> > > {
+
+	static T decode(const ReplyView &n_view) {
+
+		boost::int64_t value = 0;
+		switch (n_view.type()) {
+			case ReplyType::Integer:
+			case ReplyType::Boolean:
+				value = n_view.integer();
+				break;
+			case ReplyType::String: {
+				const std::string_view digits = n_view.string();
+				if (!parse_decimal(digits.data(), digits.data() + digits.size(), value)) {
+					throw_unexpected_reply(n_view, "an integer");
+				}
+				break;
+			}
+			default:
+				throw_unexpected_reply(n_view, "an integer");
+		}
+
+		return static_cast<T>(value);
+	}
+};
+
+template <>
+struct ReplyDecoder<double> {
+
+	static double decode(const ReplyView &n_view) {
+
+		switch (n_view.type()) {
+			case ReplyType::Double:
+				return n_view.number();
+			case ReplyType::Integer:
+				return static_cast<double>(n_view.integer());
+			case ReplyType::String:
+				try {
+					// INCRBYFLOAT and friends answer in strings
+					return boost::lexical_cast<double>(n_view.string().data(), n_view.string().size());
+				} catch (const boost::bad_lexical_cast &) {
+					throw_unexpected_reply(n_view, "a number");
+				}
+			default:
+				throw_unexpected_reply(n_view, "a number");
+		}
+	}
+};
+
+template <>
+struct ReplyDecoder<bool> {
+
+	static bool decode(const ReplyView &n_view) {
+
+		switch (n_view.type()) {
+			case ReplyType::Boolean:
+				return n_view.boolean();
+			case ReplyType::Integer:
+				// RESP2 answers with 0 or 1, like EXISTS does
+				return n_view.integer() != 0;
+			default:
+				throw_unexpected_reply(n_view, "a boolean");
+		}
+	}
+};
+
+//! nil becomes std::nullopt
+template <typename T>
+struct ReplyDecoder<std::optional<T> > {
+
+	static std::optional<T> decode(const ReplyView &n_view) {
+
+		if (n_view.is_null()) {
+			return std::nullopt;
+		}
+
+		return mredis::decode<T>(n_view);
+	}
+};
+
+//! arrays, or anything else with elements. Null arrays are empty
+template <typename T>
+struct ReplyDecoder<std::vector<T> > {
+
+	static std::vector<T> decode(const ReplyView &n_view) {
+
+		if (n_view.is_null()) {
+			return std::vector<T>();
+		}
+
+		if (!n_view.is_aggregate()) {
+			throw_unexpected_reply(n_view, "an array");
+		}
+
+		std::vector<T> ret;
+		ret.reserve(n_view.size());
+		for (const ReplyView element : n_view) {
+			ret.push_back(mredis::decode<T>(element));
+		}
+		return ret;
+	}
+};
+
+//! sets and unordered sets
+template <typename Set>
+struct SetDecoder {
+
+	static Set decode(const ReplyView &n_view) {
+
+		if (n_view.is_null()) {
+			return Set();
+		}
+
+		if (!n_view.is_aggregate()) {
+			throw_unexpected_reply(n_view, "a set");
+		}
+
+		Set ret;
+		for (const ReplyView element : n_view) {
+			ret.insert(mredis::decode<typename Set::value_type>(element));
+		}
+		return ret;
+	}
+};
+
+template <typename T, typename Compare, typename Allocator>
+struct ReplyDecoder<std::set<T, Compare, Allocator> > : public SetDecoder<std::set<T, Compare, Allocator> > {
+};
+
+template <typename T, typename Hash, typename Equal, typename Allocator>
+struct ReplyDecoder<std::unordered_set<T, Hash, Equal, Allocator> > : public SetDecoder<std::unordered_set<T, Hash, Equal, Allocator> > {
+};
+
+//! RESP3 maps or RESP2 arrays with keys and values alternating
+template <typename Map>
+struct MapDecoder {
+
+	static Map decode(const ReplyView &n_view) {
+
+		if (n_view.is_null()) {
+			return Map();
+		}
+
+		if (!n_view.is_aggregate() || (n_view.size() % 2)) {
+			throw_unexpected_reply(n_view, "a map");
+		}
+
+		Map ret;
+		for (ReplyView::const_iterator i = n_view.begin(); i != n_view.end(); ++i) {
+			typename Map::key_type key = mredis::decode<typename Map::key_type>(*i);
+			++i;
+			ret.emplace(std::move(key), mredis::decode<typename Map::mapped_type>(*i));
+		}
+		return ret;
+	}
+};
+
+template <typename K, typename V, typename Compare, typename Allocator>
+struct ReplyDecoder<std::map<K, V, Compare, Allocator> > : public MapDecoder<std::map<K, V, Compare, Allocator> > {
+};
+
+template <typename K, typename V, typename Hash, typename Equal, typename Allocator>
+struct ReplyDecoder<std::unordered_map<K, V, Hash, Equal, Allocator> > : public MapDecoder<std::unordered_map<K, V, Hash, Equal, Allocator> > {
+};
+
+/*! @brief a ReplyCallback that decodes into T and satisfies n_promise with it
+	Errors and replies that don't fit T become a redis_error in the promise
+ */
+template <typename T>
+ReplyCallback decoding_responder(const std::shared_ptr<boost::promise<T> > &n_promise) {
+
+	return [n_promise](const RedisReply &n_reply) {
+
+		try {
+			n_promise->set_value(decode<T>(n_reply.root()));
+		} catch (const redis_error &err) {
+			n_promise->set_exception(err);
+		} catch (...) {
+			n_promise->set_exception(boost::current_exception());
+		}
+	};
+}
+
+}
+}
+
@@ -0,0 +1,82 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "RequestQueue.hpp"
+
+namespace moose {
+namespace mredis {
+
+RequestQueue::RequestQueue() noexcept
+		: m_head{ nullptr } {
+}
+
+RequestQueue::~RequestQueue() noexcept {
+
+	discard(m_head.exchange(nullptr, std::memory_order_acquire));
+}
+
+bool RequestQueue::push(mrequest &&n_request) {
+
+	Node *head = m_head.load(std::memory_order_relaxed);
+	Node *node = new Node{ std::move(n_request), head };
+
+	// The consumer never takes single nodes, only all of them. So there is no ABA.
+	// Once it's in, the node is the consumer's. Don't look at it any more
+	while (!m_head.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed)) {
+		node->m_next = head;
+	}
+
+	return !head;
+}
+
+std::size_t RequestQueue::drain(std::deque<mrequest> &n_out) {
+
+	Node *nodes = m_head.exchange(nullptr, std::memory_order_acquire);
+	if (!nodes) {
+		return 0;
+	}
+
+	// We got them newest first. Turn them around
+	Node *oldest = nullptr;
+	while (nodes) {
+		Node *next = nodes->m_next;
+		nodes->m_next = oldest;
+		oldest = nodes;
+		nodes = next;
+	}
+
+	std::size_t count = 0;
+	try {
+		while (oldest) {
+			n_out.emplace_back(std::move(oldest->m_request));
+			Node *done = oldest;
+			oldest = oldest->m_next;
+			delete done;
+			++count;
+		}
+	} catch (...) {
+		discard(oldest);
+		throw;
+	}
+
+	return count;
+}
+
+bool RequestQueue::empty() const noexcept {
+
+	return !m_head.load(std::memory_order_acquire);
+}
+
+void RequestQueue::discard(Node *n_nodes) noexcept {
+
+	while (n_nodes) {
+		Node *next = n_nodes->m_next;
+		delete n_nodes;
+		n_nodes = next;
+	}
+}
+
+}
+}
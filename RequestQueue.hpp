@@ -0,0 +1,61 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "MRedisConfig.hpp"
+#include "MRedisResult.hpp"
+
+#include <atomic>
+#include <deque>
+
+namespace moose {
+namespace mredis {
+
+/*! @brief requests on their way from the callers to the io thread
+	Lock-free. Any number of threads push, one thread drains. Each request is 
+	wrapped in a node that carries the link, there is no other storage.
+
+	Pushing onto an empty queue tells the caller so. Only then does the io thread 
+	have to be woken up, it takes everything there is in one go.
+ */
+class MREDIS_API RequestQueue {
+
+	public:
+		RequestQueue() noexcept;
+		RequestQueue(const RequestQueue &) = delete;
+		RequestQueue &operator=(const RequestQueue &) = delete;
+
+		//! requests still in here are discarded without calling back
+		~RequestQueue() noexcept;
+
+		/*! @brief add a request, from any thread
+			@return true if the queue was empty. Wake up the consumer then
+			@throw std::bad_alloc
+		 */
+		bool push(mrequest &&n_request);
+
+		/*! @brief take all requests there are, in the order they were pushed
+			Only one thread may do this at a time
+			@return number of requests appended to n_out
+		 */
+		std::size_t drain(std::deque<mrequest> &n_out);
+
+		//! @return true if there's nothing to drain. May be outdated by the time you look
+		bool empty() const noexcept;
+
+	private:
+		struct Node {
+			mrequest  m_request;
+			Node     *m_next;
+		};
+
+		//! delete a chain of nodes
+		static void discard(Node *n_nodes) noexcept;
+
+		std::atomic<Node *>  m_head;   //!< last pushed, linked to the ones before
+};
+
+}
+}
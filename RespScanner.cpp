@@ -0,0 +1,193 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "RespScanner.hpp"
+
+#include <boost/predef/other/endian.h>
+
+#include <charconv>
+#include <cstring>
+
+// SSE2 is part of x86-64, so only AVX2 needs checking at runtime
+#if defined(__x86_64__) || defined(_M_X64)
+	#define MREDIS_SCAN_X86
+	#include <immintrin.h>
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#include <intrin.h>
+		#define MREDIS_TARGET_AVX2
+	#else
+		#define MREDIS_TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
+namespace moose {
+namespace mredis {
+
+namespace {
+
+using LineEndKernel = const char *(*)(const char *n_begin, const char *n_end);
+
+const char *find_line_end_scalar(const char *n_begin, const char *n_end) {
+
+	const void *lf = std::memchr(n_begin, '\n', static_cast<std::size_t>(n_end - n_begin));
+	return lf ? static_cast<const char *>(lf) : n_end;
+}
+
+#if defined(MREDIS_SCAN_X86)
+
+inline unsigned int lowest_bit(const unsigned int n_mask) noexcept {
+
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	_BitScanForward(&index, n_mask);
+	return index;
+#else
+	return static_cast<unsigned int>(__builtin_ctz(n_mask));
+#endif
+}
+
+const char *find_line_end_sse2(const char *n_begin, const char *n_end) {
+
+	const __m128i lf = _mm_set1_epi8('\n');
+	while (n_end - n_begin >= 16) {
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(n_begin));
+		const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, lf)));
+		if (mask) {
+			return n_begin + lowest_bit(mask);
+		}
+		n_begin += 16;
+	}
+
+	return find_line_end_scalar(n_begin, n_end);
+}
+
+MREDIS_TARGET_AVX2 const char *find_line_end_avx2(const char *n_begin, const char *n_end) {
+
+	const __m256i lf = _mm256_set1_epi8('\n');
+	while (n_end - n_begin >= 32) {
+		const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(n_begin));
+		const unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, lf)));
+		if (mask) {
+			return n_begin + lowest_bit(mask);
+		}
+		n_begin += 32;
+	}
+
+	return find_line_end_sse2(n_begin, n_end);
+}
+
+bool cpu_has_avx2() noexcept {
+
+#if defined(_MSC_VER) && !defined(__clang__)
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7) {
+		return false;
+	}
+
+	// The OS has to save the ymm registers for us, or we can't use them
+	__cpuid(regs, 1);
+	const bool osxsave = (regs[2] & (1 << 27)) != 0;
+	if (!osxsave || ((_xgetbv(0) & 0x6) != 0x6)) {
+		return false;
+	}
+
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+LineEndKernel select_line_end_kernel() noexcept {
+
+#if defined(MREDIS_SCAN_X86)
+	if (cpu_has_avx2()) {
+		return &find_line_end_avx2;
+	}
+	return &find_line_end_sse2;
+#else
+	return &find_line_end_scalar;
+#endif
+}
+
+const LineEndKernel c_line_end_kernel = select_line_end_kernel();
+
+#if BOOST_ENDIAN_LITTLE_BYTE
+
+//! all eight bytes are '0'...'9'
+inline bool is_eight_digits(const boost::uint64_t n_chunk) noexcept {
+
+	return (((n_chunk & 0xF0F0F0F0F0F0F0F0) | (((n_chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) == 0x3333333333333333);
+}
+
+//! eight digits, first one in the lowest byte, combined pairwise in three multiplications
+inline boost::uint64_t decode_eight_digits(boost::uint64_t n_chunk) noexcept {
+
+	n_chunk -= 0x3030303030303030;
+	n_chunk = (n_chunk * 10) + (n_chunk >> 8);
+	return (((n_chunk & 0x000000FF000000FF) * (100 + (1000000ULL << 32)))
+	      + (((n_chunk >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >> 32;
+}
+
+#endif
+
+}
+
+const char *find_line_end(const char *n_begin, const char *n_end) noexcept {
+
+	return c_line_end_kernel(n_begin, n_end);
+}
+
+bool parse_decimal(const char *n_begin, const char *n_end, boost::int64_t &n_value) noexcept {
+
+#if BOOST_ENDIAN_LITTLE_BYTE
+	const bool negative = (n_begin != n_end) && (*n_begin == '-');
+	const char *digits = negative ? n_begin + 1 : n_begin;
+	const std::size_t length = static_cast<std::size_t>(n_end - digits);
+
+	// Lengths and sizes rarely have more than a few digits. Pad those with leading zeros
+	// and decode them all at once
+	if (length && (length <= 8)) {
+		char buffer[8] = { '0', '0', '0', '0', '0', '0', '0', '0' };
+		std::memcpy(buffer + (8 - length), digits, length);
+
+		boost::uint64_t chunk;
+		std::memcpy(&chunk, buffer, sizeof(chunk));
+		if (!is_eight_digits(chunk)) {
+			return false;
+		}
+
+		const boost::int64_t value = static_cast<boost::int64_t>(decode_eight_digits(chunk));
+		n_value = negative ? -value : value;
+		return true;
+	}
+#endif
+
+	if (n_begin == n_end) {
+		return false;
+	}
+
+	const std::from_chars_result res = std::from_chars(n_begin, n_end, n_value);
+	return (res.ec == std::errc()) && (res.ptr == n_end);
+}
+
+const char *scan_kernel_name() noexcept {
+
+#if defined(MREDIS_SCAN_X86)
+	if (c_line_end_kernel == &find_line_end_avx2) {
+		return "avx2";
+	}
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+}
+}
+
@@ -0,0 +1,36 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "MRedisConfig.hpp"
+
+#include <boost/cstdint.hpp>
+
+namespace moose {
+namespace mredis {
+
+/*! Low level scanning primitives for the RESP parser.
+
+	Finding line ends uses AVX2 or SSE2 when the CPU has it, selected once at
+	startup. Other platforms get the scalar version.
+ */
+
+/*! @brief find the next '\n'
+	@return pointer to it or n_end if there is none
+ */
+MREDIS_API const char *find_line_end(const char *n_begin, const char *n_end) noexcept;
+
+/*! @brief decode a signed decimal integer, such as a length header
+	Up to eight digits are decoded in one go, longer ones the conventional way
+	@return false if the range is not exactly one decimal integer
+ */
+MREDIS_API bool parse_decimal(const char *n_begin, const char *n_end, boost::int64_t &n_value) noexcept;
+
+//! @return name of the kernel find_line_end() uses on this machine, like "avx2"
+MREDIS_API const char *scan_kernel_name() noexcept;
+
+}
+}
+
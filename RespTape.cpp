@@ -0,0 +1,427 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "RespTape.hpp"
+
+#include "tools/Assert.hpp"
+
+#include <boost/variant/static_visitor.hpp>
+
+#include <functional>
+
+namespace moose {
+namespace mredis {
+
+ReplySlab::ReplySlab(const std::size_t n_capacity)
+		: m_data{ new char[n_capacity] }
+		, m_capacity{ n_capacity } {
+}
+
+char *ReplySlab::data() noexcept {
+
+	return m_data.get();
+}
+
+const char *ReplySlab::data() const noexcept {
+
+	return m_data.get();
+}
+
+std::size_t ReplySlab::capacity() const noexcept {
+
+	return m_capacity;
+}
+
+bool ReplySlab::contains(const char *n_begin, const char *n_end) const noexcept {
+
+	const char *begin = m_data.get();
+	return std::less_equal<const char *>()(begin, n_begin) && std::less_equal<const char *>()(n_end, begin + m_capacity);
+}
+
+std::shared_ptr<SlabPool> SlabPool::create(const std::size_t n_slab_size, const std::size_t n_max_idle /* = 8 */) {
+
+	return std::shared_ptr<SlabPool>(new SlabPool(n_slab_size, n_max_idle));
+}
+
+SlabPool::SlabPool(const std::size_t n_slab_size, const std::size_t n_max_idle)
+		: m_slab_size{ n_slab_size }
+		, m_max_idle{ n_max_idle } {
+
+	MOOSE_ASSERT(n_slab_size);
+}
+
+SlabPtr SlabPool::get() {
+
+	std::unique_ptr<ReplySlab> slab;
+	{
+		boost::unique_lock<boost::mutex> slock(m_lock);
+		if (!m_idle.empty()) {
+			slab = std::move(m_idle.back());
+			m_idle.pop_back();
+		}
+	}
+
+	if (!slab) {
+		slab.reset(new ReplySlab(m_slab_size));
+	}
+
+	// The last reference brings it back here, unless we are gone by then
+	std::weak_ptr<SlabPool> pool{ shared_from_this() };
+	return SlabPtr(slab.release(), [pool](ReplySlab *n_slab) {
+
+		const std::shared_ptr<SlabPool> p = pool.lock();
+		if (p) {
+			p->recycle(n_slab);
+		} else {
+			delete n_slab;
+		}
+	});
+}
+
+std::size_t SlabPool::slab_size() const noexcept {
+
+	return m_slab_size;
+}
+
+std::size_t SlabPool::idle() const noexcept {
+
+	boost::unique_lock<boost::mutex> slock(m_lock);
+	return m_idle.size();
+}
+
+void SlabPool::recycle(ReplySlab *n_slab) noexcept {
+
+	std::unique_ptr<ReplySlab> slab{ n_slab };
+
+	try {
+		boost::unique_lock<boost::mutex> slock(m_lock);
+		if (m_idle.size() < m_max_idle) {
+			m_idle.push_back(std::move(slab));
+		}
+	} catch (...) {
+		// couldn't keep it. The unique_ptr deletes it then
+	}
+}
+
+//! fills a tape from a RedisMessage, copying strings
+struct TapeAppender : public boost::static_visitor<> {
+
+	explicit TapeAppender(RedisReply &n_reply)
+			: m_reply(n_reply) {
+	}
+
+	TapeEntry &append(const ReplyType n_type) const {
+
+		m_reply.m_tape.emplace_back();
+		TapeEntry &entry = m_reply.m_tape.back();
+		entry.m_type = n_type;
+		entry.m_size = 0;
+		return entry;
+	}
+
+	void append_string(const ReplyType n_type, std::string &&n_value) const {
+
+		std::shared_ptr<const std::string> owned{ std::make_shared<const std::string>(std::move(n_value)) };
+		TapeEntry &entry = append(n_type);
+		entry.m_data = owned->data();
+		entry.m_size = owned->size();
+		m_reply.m_owners.push_back(std::move(owned));
+	}
+
+	void append_aggregate(const ReplyType n_type, const std::vector<RedisMessage> &n_elements) const {
+
+		const std::size_t index = m_reply.m_tape.size();
+		append(n_type).m_size = n_elements.size();
+		for (const RedisMessage &element : n_elements) {
+			boost::apply_visitor(*this, element);
+		}
+		m_reply.m_tape[index].m_next = m_reply.m_tape.size();
+	}
+
+	void operator()(const std::string &n_string) const {
+
+		append_string(ReplyType::String, std::string(n_string));
+	}
+
+	void operator()(const redis_error &n_error) const {
+
+		append_string(ReplyType::Error, n_error.server_message());
+	}
+
+	void operator()(const boost::int64_t n_integer) const {
+
+		append(ReplyType::Integer).m_integer = n_integer;
+	}
+
+	void operator()(const null_result &) const {
+
+		append(ReplyType::Null).m_integer = 0;
+	}
+
+	void operator()(const std::vector<RedisMessage> &n_array) const {
+
+		append_aggregate(ReplyType::Array, n_array);
+	}
+
+	void operator()(const double_result &n_double) const {
+
+		append(ReplyType::Double).m_double = n_double.m_value;
+	}
+
+	void operator()(const boolean_result &n_boolean) const {
+
+		append(ReplyType::Boolean).m_integer = n_boolean.m_value ? 1 : 0;
+	}
+
+	void operator()(const big_number_result &n_number) const {
+
+		append_string(ReplyType::BigNumber, std::string(n_number.m_value));
+	}
+
+	void operator()(const verbatim_result &n_verbatim) const {
+
+		append_string(ReplyType::Verbatim, n_verbatim.m_format + ":" + n_verbatim.m_value);
+	}
+
+	void operator()(const RedisMap &n_map) const {
+
+		const std::size_t index = m_reply.m_tape.size();
+		append(ReplyType::Map).m_size = n_map.m_entries.size() * 2;
+		for (const std::pair<RedisMessage, RedisMessage> &entry : n_map.m_entries) {
+			boost::apply_visitor(*this, entry.first);
+			boost::apply_visitor(*this, entry.second);
+		}
+		m_reply.m_tape[index].m_next = m_reply.m_tape.size();
+	}
+
+	void operator()(const RedisSet &n_set) const {
+
+		append_aggregate(ReplyType::Set, n_set.m_elements);
+	}
+
+	void operator()(const RedisPush &n_push) const {
+
+		append_aggregate(ReplyType::Push, n_push.m_elements);
+	}
+
+	RedisReply &m_reply;
+};
+
+ReplyView RedisReply::root() const noexcept {
+
+	MOOSE_ASSERT_MSG((!m_tape.empty()), "Empty reply has no root");
+	return ReplyView(m_tape.data(), 0);
+}
+
+bool RedisReply::empty() const noexcept {
+
+	return m_tape.empty();
+}
+
+std::size_t RedisReply::size() const noexcept {
+
+	return m_tape.size();
+}
+
+RedisMessage RedisReply::to_message() const {
+
+	if (m_tape.empty()) {
+		return null_result();
+	}
+
+	return root().to_message();
+}
+
+RedisReply RedisReply::from_message(const RedisMessage &n_message) {
+
+	RedisReply reply;
+	boost::apply_visitor(TapeAppender(reply), n_message);
+	return reply;
+}
+
+ReplyView::ReplyView(const TapeEntry *n_tape, const std::size_t n_index) noexcept
+		: m_tape{ n_tape }
+		, m_index{ n_index } {
+}
+
+const TapeEntry &ReplyView::entry() const noexcept {
+
+	return m_tape[m_index];
+}
+
+ReplyType ReplyView::type() const noexcept {
+
+	return entry().m_type;
+}
+
+bool ReplyView::is_string() const noexcept {
+
+	return type() == ReplyType::String;
+}
+
+bool ReplyView::is_error() const noexcept {
+
+	return type() == ReplyType::Error;
+}
+
+bool ReplyView::is_int() const noexcept {
+
+	return type() == ReplyType::Integer;
+}
+
+bool ReplyView::is_null() const noexcept {
+
+	return type() == ReplyType::Null;
+}
+
+bool ReplyView::is_aggregate() const noexcept {
+
+	const ReplyType t = type();
+	return (t == ReplyType::Array) || (t == ReplyType::Map) || (t == ReplyType::Set) || (t == ReplyType::Push);
+}
+
+std::string_view ReplyView::string() const noexcept {
+
+	const TapeEntry &e = entry();
+	switch (e.m_type) {
+		case ReplyType::String:
+		case ReplyType::Error:
+		case ReplyType::BigNumber:
+			return std::string_view(e.m_data, e.m_size);
+		case ReplyType::Verbatim:
+			return std::string_view(e.m_data + 4, e.m_size - 4);
+		default:
+			MOOSE_ASSERT_MSG(false, "Reply is not a string");
+			return std::string_view();
+	}
+}
+
+std::string_view ReplyView::verbatim_format() const noexcept {
+
+	MOOSE_ASSERT_MSG((type() == ReplyType::Verbatim), "Reply is not a verbatim string");
+	return std::string_view(entry().m_data, 3);
+}
+
+boost::int64_t ReplyView::integer() const noexcept {
+
+	MOOSE_ASSERT_MSG(((type() == ReplyType::Integer) || (type() == ReplyType::Boolean)), "Reply is not an integer");
+	return entry().m_integer;
+}
+
+double ReplyView::number() const noexcept {
+
+	MOOSE_ASSERT_MSG((type() == ReplyType::Double), "Reply is not a double");
+	return entry().m_double;
+}
+
+bool ReplyView::boolean() const noexcept {
+
+	MOOSE_ASSERT_MSG((type() == ReplyType::Boolean), "Reply is not a boolean");
+	return entry().m_integer != 0;
+}
+
+std::size_t ReplyView::size() const noexcept {
+
+	return is_aggregate() ? entry().m_size : 0;
+}
+
+ReplyView::const_iterator &ReplyView::const_iterator::operator++() noexcept {
+
+	const TapeEntry &e = m_tape[m_index];
+	const bool aggregate = (e.m_type == ReplyType::Array) || (e.m_type == ReplyType::Map)
+	                    || (e.m_type == ReplyType::Set) || (e.m_type == ReplyType::Push);
+
+	// skip over nested aggregates in one step
+	m_index = aggregate ? e.m_next : m_index + 1;
+	return *this;
+}
+
+ReplyView::const_iterator ReplyView::begin() const noexcept {
+
+	return is_aggregate() ? const_iterator(m_tape, m_index + 1) : end();
+}
+
+ReplyView::const_iterator ReplyView::end() const noexcept {
+
+	return is_aggregate() ? const_iterator(m_tape, entry().m_next) : const_iterator(m_tape, m_index);
+}
+
+ReplyView ReplyView::operator[](const std::size_t n_index) const noexcept {
+
+	MOOSE_ASSERT_MSG((n_index < size()), "Reply element index out of range");
+
+	const_iterator i = begin();
+	for (std::size_t n = 0; n < n_index; ++n) {
+		++i;
+	}
+	return *i;
+}
+
+RedisMessage ReplyView::to_message() const {
+
+	switch (type()) {
+		default:
+		case ReplyType::Null:
+			return null_result();
+
+		case ReplyType::String:
+			return std::string(string());
+
+		case ReplyType::Error: {
+			redis_error err;
+			err.set_server_message(std::string(string()));
+			return err;
+		}
+
+		case ReplyType::Integer:
+			return integer();
+
+		case ReplyType::Double:
+			return double_result{ number() };
+
+		case ReplyType::Boolean:
+			return boolean_result{ boolean() };
+
+		case ReplyType::BigNumber:
+			return big_number_result{ std::string(string()) };
+
+		case ReplyType::Verbatim:
+			return verbatim_result{ std::string(verbatim_format()), std::string(string()) };
+
+		case ReplyType::Map: {
+			RedisMap map;
+			map.m_entries.reserve(size() / 2);
+			for (const_iterator i = begin(); i != end(); ++i) {
+				RedisMessage key = (*i).to_message();
+				if (++i == end()) {
+					break;
+				}
+				map.m_entries.emplace_back(std::move(key), (*i).to_message());
+			}
+			return map;
+		}
+
+		case ReplyType::Array:
+		case ReplyType::Set:
+		case ReplyType::Push: {
+			std::vector<RedisMessage> elements;
+			elements.reserve(size());
+			for (const ReplyView element : *this) {
+				elements.push_back(element.to_message());
+			}
+
+			if (type() == ReplyType::Set) {
+				return RedisSet{ std::move(elements) };
+			} else if (type() == ReplyType::Push) {
+				return RedisPush{ std::move(elements) };
+			}
+			return elements;
+		}
+	}
+}
+
+}
+}
+
@@ -0,0 +1,254 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "MRedisConfig.hpp"
+#include "MRedisResult.hpp"
+
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iterator>
+
+namespace moose {
+namespace mredis {
+
+/*! Zero-copy replies
+
+	Bytes are received into slabs. Rather than copying strings out of them into a
+	RedisMessage, a RedisReply points into the slabs and keeps them alive for as long
+	as it exists. Nested replies are not a tree but a flat tape of entries in the order
+	they came in, aggregates knowing where they end.
+ */
+
+/*! @brief a block of received bytes
+	Replies point into it and keep it alive as long as they exist
+ */
+class MREDIS_API ReplySlab {
+
+	public:
+		explicit ReplySlab(const std::size_t n_capacity);
+		ReplySlab(const ReplySlab &) = delete;
+		ReplySlab &operator=(const ReplySlab &) = delete;
+
+		char *data() noexcept;
+		const char *data() const noexcept;
+		std::size_t capacity() const noexcept;
+
+		//! @return true if the range lies within this slab
+		bool contains(const char *n_begin, const char *n_end) const noexcept;
+
+	private:
+		std::unique_ptr<char[]>  m_data;
+		const std::size_t        m_capacity;
+};
+
+using SlabPtr = std::shared_ptr<ReplySlab>;
+
+/*! @brief recycles slabs of one size
+	A slab goes back into the pool when the last reference to it is gone.
+	Thread safe, as replies may die in any thread. Slabs may outlive the pool.
+ */
+class MREDIS_API SlabPool : public std::enable_shared_from_this<SlabPool> {
+
+	public:
+		/*! @param n_slab_size size of all the slabs
+			@param n_max_idle keep no more than this many unused slabs around
+		 */
+		static std::shared_ptr<SlabPool> create(const std::size_t n_slab_size, const std::size_t n_max_idle = 8);
+
+		SlabPool(const SlabPool &) = delete;
+		SlabPool &operator=(const SlabPool &) = delete;
+
+		//! @return an unused slab, recycled or new
+		//! @throw std::bad_alloc
+		SlabPtr get();
+
+		std::size_t slab_size() const noexcept;
+
+		//! @return number of unused slabs kept for later
+		std::size_t idle() const noexcept;
+
+	private:
+		SlabPool(const std::size_t n_slab_size, const std::size_t n_max_idle);
+
+		//! slab's deleter calls this
+		void recycle(ReplySlab *n_slab) noexcept;
+
+		const std::size_t                        m_slab_size;
+		const std::size_t                        m_max_idle;
+		mutable boost::mutex                     m_lock;
+		std::vector<std::unique_ptr<ReplySlab> > m_idle;
+};
+
+//! what a tape entry is
+enum class ReplyType : boost::uint8_t {
+	String = 0,
+	Error,
+	Integer,
+	Null,
+	Array,
+	Double,    //!< RESP3
+	Boolean,   //!< RESP3
+	BigNumber, //!< RESP3, digits as string
+	Verbatim,  //!< RESP3, string with format
+	Map,       //!< RESP3, keys and values alternating
+	Set,       //!< RESP3
+	Push       //!< RESP3
+};
+
+/*! @brief receive a reply element by element as it is parsed
+	Huge aggregates, like SMEMBERS of a large set, never have to be in memory as a whole.
+	Only the largest single element does.
+
+	Aggregates are announced by m_begin and m_end, everything in between belongs to
+	them. Scalars, including a reply that is no aggregate at all, go to m_element.
+	m_done is called once the reply is complete, also after errors.
+	All of them are called in the io thread and must not throw. Leave the ones
+	you don't need empty.
+ */
+struct ReplyStream {
+	std::function<void(const ReplyType n_type, const std::size_t n_size)> m_begin;    //!< aggregate with n_size elements starts. Maps count keys and values separately
+	std::function<void(const RedisMessage &n_element)>                    m_element;  //!< one scalar
+	std::function<void(const ReplyType n_type)>                           m_end;      //!< innermost aggregate is complete
+	std::function<void()>                                                 m_done;     //!< the reply is complete
+};
+
+/*! @brief one value on the tape
+	Aggregates are followed by their elements. They know where they end so
+	you can skip over them.
+ */
+struct TapeEntry {
+	ReplyType            m_type;
+	std::size_t          m_size;       //!< strings: length. aggregates: number of elements
+	union {
+		const char      *m_data;       //!< strings, errors, big numbers, verbatim
+		boost::int64_t   m_integer;    //!< integers and booleans
+		double           m_double;
+		std::size_t      m_next;       //!< aggregates: index of the entry behind the last element
+	};
+};
+
+class ReplyView;
+
+/*! @brief a reply that points into the buffers it was received in
+	Cheap to copy, all copies share the buffers. Immutable once parsed.
+ */
+class MREDIS_API RedisReply {
+
+	public:
+		RedisReply() = default;
+
+		//! @return the top level value. Only valid as long as this reply exists
+		ReplyView root() const noexcept;
+
+		//! @return true if nothing was parsed into this
+		bool empty() const noexcept;
+
+		//! @return number of entries on the tape
+		std::size_t size() const noexcept;
+
+		//! convert into the conventional variant, copying all strings
+		RedisMessage to_message() const;
+
+		//! convert from the conventional variant, copying all strings
+		static RedisReply from_message(const RedisMessage &n_message);
+
+	private:
+		friend class TapeBuilder;
+		friend class ReplyView;
+		friend struct TapeAppender;
+
+		std::vector<TapeEntry>                  m_tape;
+		std::vector<std::shared_ptr<const void> > m_owners;  //!< slabs and spilled strings the tape points into
+};
+
+/*! @brief look at a value on the tape
+	Only valid as long as the reply it came from exists.
+	Accessors for the wrong type assert.
+ */
+class MREDIS_API ReplyView {
+
+	public:
+		ReplyType type() const noexcept;
+
+		bool is_string() const noexcept;
+		bool is_error() const noexcept;
+		bool is_int() const noexcept;
+		bool is_null() const noexcept;
+
+		//! @return true for arrays, maps, sets and pushes
+		bool is_aggregate() const noexcept;
+
+		//! strings, errors, big numbers and the text of verbatim strings
+		std::string_view string() const noexcept;
+
+		//! format of verbatim strings, like "txt"
+		std::string_view verbatim_format() const noexcept;
+
+		//! integers and booleans
+		boost::int64_t integer() const noexcept;
+
+		double number() const noexcept;
+
+		bool boolean() const noexcept;
+
+		//! @return number of elements in aggregates. Maps count keys and values separately
+		std::size_t size() const noexcept;
+
+		//! iterate the elements of an aggregate, skipping over nested ones
+		class const_iterator {
+
+			public:
+				using iterator_category = std::forward_iterator_tag;
+				using value_type        = ReplyView;
+				using difference_type   = std::ptrdiff_t;
+				using pointer           = const ReplyView *;
+				using reference         = ReplyView;
+
+				const_iterator(const TapeEntry *n_tape, const std::size_t n_index) noexcept
+						: m_tape{ n_tape }
+						, m_index{ n_index } {
+				}
+
+				ReplyView operator*() const noexcept { return ReplyView(m_tape, m_index); }
+				const_iterator &operator++() noexcept;
+				const_iterator operator++(int) noexcept { const_iterator ret{ *this }; ++(*this); return ret; }
+				bool operator==(const const_iterator &n_other) const noexcept { return m_index == n_other.m_index; }
+				bool operator!=(const const_iterator &n_other) const noexcept { return m_index != n_other.m_index; }
+
+			private:
+				const TapeEntry *m_tape;
+				std::size_t      m_index;
+		};
+
+		const_iterator begin() const noexcept;
+		const_iterator end() const noexcept;
+
+		//! @return the n-th element of an aggregate. Linear in n, prefer iteration
+		ReplyView operator[](const std::size_t n_index) const noexcept;
+
+		//! convert into the conventional variant, copying all strings
+		RedisMessage to_message() const;
+
+	private:
+		friend class RedisReply;
+
+		ReplyView(const TapeEntry *n_tape, const std::size_t n_index) noexcept;
+
+		const TapeEntry &entry() const noexcept;
+
+		const TapeEntry *m_tape;
+		std::size_t      m_index;
+};
+
+}
+}
+
@@ -0,0 +1,321 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "RespWriter.hpp"
+#include "RespTape.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace moose {
+namespace mredis {
+
+//! all two digit numbers, so we can write two at a time
+constexpr char c_digit_pairs[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+
+namespace {
+
+//! each thread stages its commands in slabs of this size
+constexpr std::size_t c_staging_slab_size = 64 * 1024;
+
+//! commands larger than that don't go into slabs but keep their own storage
+constexpr std::size_t c_max_staged_size = c_staging_slab_size / 8;
+
+//! shared by all threads
+SlabPool &staging_pool() {
+
+	static const std::shared_ptr<SlabPool> pool{ SlabPool::create(c_staging_slab_size, 32) };
+	return *pool;
+}
+
+//! the slab a thread is currently filling. Commands in it keep it alive until sent
+struct StagingSlab {
+	SlabPtr      m_slab;
+	std::size_t  m_used = 0;
+};
+
+thread_local StagingSlab t_staging_slab;
+
+//! append to n_buffers, merge with the last one if adjacent
+void append_piece(std::vector<boost::asio::const_buffer> &n_buffers, const char *n_data, const std::size_t n_size) {
+
+	if (!n_size) {
+		return;
+	}
+
+	if (!n_buffers.empty()) {
+		const boost::asio::const_buffer &last = n_buffers.back();
+		if ((static_cast<const char *>(last.data()) + last.size()) == n_data) {
+			n_buffers.back() = boost::asio::const_buffer(last.data(), last.size() + n_size);
+			return;
+		}
+	}
+
+	n_buffers.emplace_back(n_data, n_size);
+}
+
+//! copied bytes interleaved with the references
+void gather_pieces(std::vector<boost::asio::const_buffer> &n_buffers, const char *n_data, const std::size_t n_size,
+		const std::vector<CommandReference> &n_references) {
+
+	std::size_t copied = 0;
+	for (const CommandReference &r : n_references) {
+		append_piece(n_buffers, n_data + copied, r.m_offset - copied);
+		append_piece(n_buffers, r.m_data, r.m_size);
+		copied = r.m_offset;
+	}
+
+	append_piece(n_buffers, n_data + copied, n_size - copied);
+}
+
+}
+
+char *write_decimal(char *n_out, boost::uint64_t n_value) noexcept {
+
+	// Most of what we write are lengths of a few digits
+	if (n_value < 10) {
+		*n_out = static_cast<char>('0' + n_value);
+		return n_out + 1;
+	}
+
+	std::size_t digits = 1;
+	for (boost::uint64_t v = n_value; v >= 10; v /= 10) {
+		++digits;
+	}
+
+	// fill from the back
+	char *pos = n_out + digits;
+	while (n_value >= 100) {
+		const std::size_t pair = static_cast<std::size_t>(n_value % 100) * 2;
+		n_value /= 100;
+		*--pos = c_digit_pairs[pair + 1];
+		*--pos = c_digit_pairs[pair];
+	}
+
+	if (n_value >= 10) {
+		const std::size_t pair = static_cast<std::size_t>(n_value) * 2;
+		*--pos = c_digit_pairs[pair + 1];
+		*--pos = c_digit_pairs[pair];
+	} else {
+		*--pos = static_cast<char>('0' + n_value);
+	}
+
+	return n_out + digits;
+}
+
+char *write_decimal(char *n_out, const boost::int64_t n_value) noexcept {
+
+	if (n_value < 0) {
+		*n_out++ = '-';
+		// works for the smallest value as well, which has no positive counterpart
+		return write_decimal(n_out, static_cast<boost::uint64_t>(0) - static_cast<boost::uint64_t>(n_value));
+	}
+
+	return write_decimal(n_out, static_cast<boost::uint64_t>(n_value));
+}
+
+void CommandBuffer::set_reference_threshold(const std::size_t n_threshold) noexcept {
+
+	m_reference_threshold = n_threshold ? std::max(n_threshold, c_min_reference_size) : 0;
+}
+
+std::size_t CommandBuffer::reference_threshold() const noexcept {
+
+	return m_reference_threshold;
+}
+
+void CommandBuffer::array(const std::size_t n_elements) {
+
+	char header[24];
+	header[0] = '*';
+	char *pos = write_decimal(header + 1, static_cast<boost::uint64_t>(n_elements));
+	*pos++ = '\r';
+	*pos++ = '\n';
+	m_data.append(header, static_cast<std::size_t>(pos - header));
+}
+
+void CommandBuffer::bulk(const char *n_data, const std::size_t n_size) {
+
+	write_bulk(n_data, n_size, true);
+}
+
+void CommandBuffer::bulk_copy(const char *n_data, const std::size_t n_size) {
+
+	write_bulk(n_data, n_size, false);
+}
+
+void CommandBuffer::write_bulk(const char *n_data, const std::size_t n_size, const bool n_may_reference) {
+
+	char header[24];
+	header[0] = '$';
+	char *pos = write_decimal(header + 1, static_cast<boost::uint64_t>(n_size));
+	*pos++ = '\r';
+	*pos++ = '\n';
+
+	m_data.append(header, static_cast<std::size_t>(pos - header));
+
+	if (n_may_reference && m_reference_threshold && (n_size >= m_reference_threshold)) {
+		m_references.push_back(CommandReference{ m_data.size(), n_data, n_size });
+		m_referenced_size += n_size;
+	} else {
+		m_data.append(n_data, n_size);
+	}
+
+	m_data.append("\r\n", 2);
+}
+
+void CommandBuffer::bulk(const boost::int64_t n_value) {
+
+	char digits[24];
+	const char *end = write_decimal(digits, n_value);
+	bulk_copy(digits, static_cast<std::size_t>(end - digits));
+}
+
+void CommandBuffer::bulk(const double n_value) {
+
+	char digits[32];
+	const std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), n_value);
+	bulk_copy(digits, static_cast<std::size_t>(result.ptr - digits));
+}
+
+void CommandBuffer::append(const char *n_data, const std::size_t n_size) {
+
+	m_data.append(n_data, n_size);
+}
+
+const char *CommandBuffer::data() const noexcept {
+
+	return m_data.data();
+}
+
+std::size_t CommandBuffer::size() const noexcept {
+
+	return m_data.size() + m_referenced_size;
+}
+
+bool CommandBuffer::empty() const noexcept {
+
+	return m_data.empty();
+}
+
+void CommandBuffer::clear() noexcept {
+
+	m_data.clear();
+	m_references.clear();
+	m_referenced_size = 0;
+	m_buffers.clear();
+}
+
+bool CommandBuffer::scattered() const noexcept {
+
+	return !m_references.empty();
+}
+
+const std::vector<boost::asio::const_buffer> &CommandBuffer::buffers() {
+
+	m_buffers.clear();
+	gather_pieces(m_buffers, m_data.data(), m_data.size(), m_references);
+	return m_buffers;
+}
+
+EncodedCommand CommandBuffer::encode() {
+
+	EncodedCommand ret;
+	const std::size_t copied = m_data.size();
+
+	if (copied > c_max_staged_size) {
+		// too large to stage. It takes our storage along, we start from scratch
+		std::shared_ptr<std::string> spilled{ std::make_shared<std::string>(std::move(m_data)) };
+		ret.m_data = spilled->data();
+		ret.m_storage = std::move(spilled);
+	} else if (copied) {
+		StagingSlab &staging = t_staging_slab;
+		if (!staging.m_slab || ((staging.m_slab->capacity() - staging.m_used) < copied)) {
+			staging.m_slab = staging_pool().get();
+			staging.m_used = 0;
+		}
+
+		char *dest = staging.m_slab->data() + staging.m_used;
+		std::memcpy(dest, m_data.data(), copied);
+		staging.m_used += copied;
+		ret.m_data = dest;
+		ret.m_storage = staging.m_slab;
+	}
+
+	ret.m_size = copied;
+	ret.m_references.swap(m_references);
+	ret.m_referenced_size = m_referenced_size;
+	clear();
+	return ret;
+}
+
+std::size_t EncodedCommand::size() const noexcept {
+
+	return m_size + m_referenced_size;
+}
+
+bool EncodedCommand::empty() const noexcept {
+
+	return !size();
+}
+
+bool EncodedCommand::scattered() const noexcept {
+
+	return !m_references.empty();
+}
+
+std::string_view EncodedCommand::name() const noexcept {
+
+	// "*<n>\r\n$<length>\r\n<NAME>\r\n". Names are written as literals or with bulk_copy(), never referenced
+	const std::string_view bytes(m_data, m_size);
+	const std::size_t header_end = bytes.find("\r\n");
+	if ((header_end == std::string_view::npos) || (bytes.size() < header_end + 3) || (bytes[header_end + 2] != '$')) {
+		return std::string_view();
+	}
+
+	const std::size_t length_end = bytes.find("\r\n", header_end + 2);
+	if (length_end == std::string_view::npos) {
+		return std::string_view();
+	}
+
+	std::size_t length = 0;
+	for (std::size_t i = header_end + 3; i < length_end; ++i) {
+		if ((bytes[i] < '0') || (bytes[i] > '9')) {
+			return std::string_view();
+		}
+		length = length * 10 + static_cast<std::size_t>(bytes[i] - '0');
+	}
+
+	if (bytes.size() < length_end + 2 + length) {
+		return std::string_view();
+	}
+
+	return bytes.substr(length_end + 2, length);
+}
+
+const std::shared_ptr<const void> &EncodedCommand::storage() const noexcept {
+
+	return m_storage;
+}
+
+void EncodedCommand::gather(std::vector<boost::asio::const_buffer> &n_buffers) const {
+
+	gather_pieces(n_buffers, m_data, m_size, m_references);
+}
+
+}
+}
+
@@ -0,0 +1,301 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "MRedisConfig.hpp"
+
+#include <boost/asio/buffer.hpp>
+#include <boost/cstdint.hpp>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace moose {
+namespace mredis {
+
+/*! Writing commands without streams
+
+	Commands go straight into a contiguous CommandBuffer. What is known at compile
+	time, like "*2\r\n$3\r\nGET\r\n", is computed at compile time. At runtime there
+	are only lengths left to write and the arguments to copy, one memcpy each.
+
+	Large arguments are not copied at all if you set a reference threshold. The buffer
+	then only points to them and buffers() hands out a sequence for one gathering write.
+
+	The connection writes commands on the caller's thread and moves them out with
+	encode(). They wait in the calling thread's staging slab until they are sent.
+ */
+
+/*! @brief write n_value as decimal digits, no terminator
+	n_out must have room for 20 characters
+	@return behind the last digit written
+ */
+MREDIS_API char *write_decimal(char *n_out, boost::uint64_t n_value) noexcept;
+
+//! same for signed values, room for 21 characters
+MREDIS_API char *write_decimal(char *n_out, const boost::int64_t n_value) noexcept;
+
+/*! @brief a piece of protocol known at compile time
+	Use command_header() or command_name() to make one
+ */
+template <std::size_t Capacity>
+class RespLiteral {
+
+	public:
+		constexpr RespLiteral() noexcept
+				: m_data{ }
+				, m_size{ 0 } {
+		}
+
+		constexpr void append(const char *n_text, const std::size_t n_length) noexcept {
+
+			for (std::size_t i = 0; i < n_length; ++i) {
+				m_data[m_size++] = n_text[i];
+			}
+		}
+
+		constexpr void append_decimal(std::size_t n_value) noexcept {
+
+			char digits[20] = { };
+			std::size_t count = 0;
+			do {
+				digits[count++] = static_cast<char>('0' + (n_value % 10));
+				n_value /= 10;
+			} while (n_value);
+
+			while (count) {
+				m_data[m_size++] = digits[--count];
+			}
+		}
+
+		constexpr const char *data() const noexcept {
+
+			return m_data;
+		}
+
+		constexpr std::size_t size() const noexcept {
+
+			return m_size;
+		}
+
+	private:
+		char        m_data[Capacity];
+		std::size_t m_size;
+};
+
+//! "$<length>\r\n<NAME>\r\n", the command name as bulk string
+template <std::size_t N>
+constexpr RespLiteral<N + 24> command_name(const char (&n_name)[N]) noexcept {
+
+	RespLiteral<N + 24> ret;
+	ret.append("$", 1);
+	ret.append_decimal(N - 1);
+	ret.append("\r\n", 2);
+	ret.append(n_name, N - 1);
+	ret.append("\r\n", 2);
+	return ret;
+}
+
+//! "*<n_elements>\r\n$<length>\r\n<NAME>\r\n", n_elements counting the name itself
+template <std::size_t N>
+constexpr RespLiteral<N + 48> command_header(const char (&n_name)[N], const std::size_t n_elements) noexcept {
+
+	RespLiteral<N + 48> ret;
+	ret.append("*", 1);
+	ret.append_decimal(n_elements);
+	ret.append("\r\n", 2);
+
+	const RespLiteral<N + 24> name = command_name(n_name);
+	ret.append(name.data(), name.size());
+	return ret;
+}
+
+//! "*<n_elements>\r\n"
+constexpr RespLiteral<24> array_header(const std::size_t n_elements) noexcept {
+
+	RespLiteral<24> ret;
+	ret.append("*", 1);
+	ret.append_decimal(n_elements);
+	ret.append("\r\n", 2);
+	return ret;
+}
+
+//! an argument that was referenced instead of copied
+struct CommandReference {
+	std::size_t  m_offset;     //!< where in the copied bytes it would be
+	const char  *m_data;
+	std::size_t  m_size;
+};
+
+/*! @brief a finished command, waiting to be sent
+	Move only. The copied bytes are kept alive by this. Referenced arguments are not,
+	whoever referenced them has to keep them.
+ */
+class MREDIS_API EncodedCommand {
+
+	public:
+		EncodedCommand() = default;
+		EncodedCommand(EncodedCommand &&) = default;
+		EncodedCommand &operator=(EncodedCommand &&) = default;
+		EncodedCommand(const EncodedCommand &) = delete;
+		EncodedCommand &operator=(const EncodedCommand &) = delete;
+
+		//! all bytes, including referenced arguments
+		std::size_t size() const noexcept;
+		bool empty() const noexcept;
+
+		//! @return true if arguments are referenced
+		bool scattered() const noexcept;
+
+		//! the command's name, like "GET". Empty if it doesn't look like a command
+		std::string_view name() const noexcept;
+
+		//! what keeps the copied bytes alive. Commands staged one after another share it
+		const std::shared_ptr<const void> &storage() const noexcept;
+
+		/*! @brief append the command to a buffer sequence
+			Pieces adjacent in memory to the last buffer are merged into it, so commands
+			staged one after another go out as one piece
+		 */
+		void gather(std::vector<boost::asio::const_buffer> &n_buffers) const;
+
+	private:
+		friend class CommandBuffer;
+
+		std::shared_ptr<const void>    m_storage;              //!< staging slab or spilled string
+		const char                    *m_data = nullptr;
+		std::size_t                    m_size = 0;             //!< copied bytes
+		std::vector<CommandReference>  m_references;
+		std::size_t                    m_referenced_size = 0;
+};
+
+//! reference thresholds are raised to this. Numbers and command names are always shorter
+constexpr std::size_t c_min_reference_size = 64;
+
+/*! @brief commands are written into this before they go out
+	Contiguous, so it goes out in one write. Keeps its capacity when cleared.
+
+	Bulk arguments of at least reference_threshold() bytes are referenced rather than
+	copied. Those must stay valid until the buffer is cleared and the buffer is not
+	contiguous anymore. Use buffers() to write it then.
+ */
+class MREDIS_API CommandBuffer {
+
+	public:
+		CommandBuffer() = default;
+		CommandBuffer(const CommandBuffer &) = delete;
+		CommandBuffer &operator=(const CommandBuffer &) = delete;
+
+		/*! @brief reference bulk arguments from this size on instead of copying them
+			@param n_threshold 0 copies everything, which is the default. Anything else
+				is at least c_min_reference_size, smaller pieces aren't worth a buffer of their own
+		 */
+		void set_reference_threshold(const std::size_t n_threshold) noexcept;
+		std::size_t reference_threshold() const noexcept;
+
+		//! "*<n_elements>\r\n", for commands with a variable number of arguments
+		void array(const std::size_t n_elements);
+
+		//! one argument as bulk string
+		void bulk(const char *n_data, const std::size_t n_size);
+
+		//! same but always copied, for what may be gone before the command is written
+		void bulk_copy(const char *n_data, const std::size_t n_size);
+
+		void bulk(const std::string_view &n_value) {
+
+			bulk(n_value.data(), n_value.size());
+		}
+
+		//! numbers go as bulk strings as well. Redis wants them that way
+		void bulk(const boost::int64_t n_value);
+
+		//! shortest representation that reads back as the same double. Infinity is "inf"
+		void bulk(const double n_value);
+
+		template <std::size_t Capacity>
+		void literal(const RespLiteral<Capacity> &n_literal) {
+
+			m_data.append(n_literal.data(), n_literal.size());
+		}
+
+		//! raw bytes, nothing added
+		void append(const char *n_data, const std::size_t n_size);
+
+		//! the bytes copied into the buffer. All there is unless scattered()
+		const char *data() const noexcept;
+		//! all bytes, including referenced arguments
+		std::size_t size() const noexcept;
+		bool empty() const noexcept;
+		//! forget the content, including references
+		void clear() noexcept;
+
+		//! @return true if arguments are referenced and data() doesn't have everything
+		bool scattered() const noexcept;
+
+		/*! @brief the content as buffer sequence, copied and referenced parts in order
+			Valid until the buffer is changed
+		 */
+		const std::vector<boost::asio::const_buffer> &buffers();
+
+		/*! @brief move what was written into an EncodedCommand and start over
+			Small commands are copied into a staging slab of the calling thread, large ones
+			take the buffer's storage along.
+			@throw std::bad_alloc
+		 */
+		EncodedCommand encode();
+
+	private:
+		void write_bulk(const char *n_data, const std::size_t n_size, const bool n_may_reference);
+
+		std::string                             m_data;
+		std::vector<CommandReference>           m_references;
+		std::size_t                             m_referenced_size = 0;
+		std::size_t                             m_reference_threshold = 0;
+		std::vector<boost::asio::const_buffer>  m_buffers;
+};
+
+/*! @brief write one argument of any supported type
+	Strings and everything that converts to std::string_view as they are,
+	integers and floating point numbers as decimal text
+ */
+template <typename T>
+void write_argument(CommandBuffer &n_out, const T &n_argument) {
+
+	if constexpr (std::is_floating_point_v<T>) {
+		n_out.bulk(static_cast<double>(n_argument));
+	} else if constexpr (std::is_integral_v<T>) {
+		n_out.bulk(static_cast<boost::int64_t>(n_argument));
+	} else {
+		n_out.bulk(std::string_view(n_argument));
+	}
+}
+
+/*! @brief write any command with any arguments
+	The array header is computed at compile time, the name's length as well.
+	The name is always copied, EncodedCommand::name() finds it there.
+	format_command(out, "ZADD", key, 1.5, member) is as fast as a hand written format_zadd().
+ */
+template <std::size_t N, typename... Args>
+void format_command(CommandBuffer &n_out, const char (&n_name)[N], const Args &...n_arguments) {
+
+	static constexpr auto c_header = array_header(1 + sizeof...(Args));
+	n_out.literal(c_header);
+	n_out.bulk_copy(n_name, N - 1);
+	(write_argument(n_out, n_arguments), ...);
+}
+
+/*! @brief what to keep of an argument until it is written
+	Numbers as they are, strings and views of them as std::string
+ */
+template <typename T>
+using stored_argument_t = std::conditional_t<std::is_arithmetic_v<std::decay_t<T> >, std::decay_t<T>, std::string>;
+
+}
+}
+
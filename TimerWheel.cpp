@@ -0,0 +1,237 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "TimerWheel.hpp"
+
+#include "tools/Assert.hpp"
+
+#include <algorithm>
+
+namespace moose {
+namespace mredis {
+
+TimerWheel::TimerWheel(const Duration &n_resolution)
+		: m_epoch{ Clock::now() }
+		, m_resolution{ n_resolution }
+		, m_now{ 0 }
+		, m_nodes(1)
+		, m_free{ 0 }
+		, m_slots{ }
+		, m_occupied{ }
+		, m_size{ 0 } {
+
+	MOOSE_ASSERT(m_resolution > Duration::zero())
+}
+
+TimerWheel::Handle TimerWheel::schedule(const TimePoint &n_deadline, mrequest *n_request) {
+
+	Handle handle = m_free;
+	if (handle) {
+		m_free = m_nodes[handle].m_next;
+	} else {
+		handle = static_cast<Handle>(m_nodes.size());
+		m_nodes.emplace_back();
+	}
+
+	// Nothing was due for a while, the clock may be far ahead of us. Catch up
+	// so the new deadline doesn't have to trickle down through all the levels
+	if (!m_size) {
+		m_now = std::max(m_now, static_cast<std::uint64_t>((Clock::now() - m_epoch) / m_resolution));
+	}
+
+	Node &node = m_nodes[handle];
+	node.m_tick = std::max(to_tick(n_deadline), m_now + 1);
+	node.m_request = n_request;
+	link(handle);
+	++m_size;
+
+	return handle;
+}
+
+void TimerWheel::cancel(const Handle n_handle) noexcept {
+
+	if (!n_handle) {
+		return;
+	}
+
+	MOOSE_ASSERT(m_nodes[n_handle].m_request)
+
+	unlink(n_handle);
+	Node &node = m_nodes[n_handle];
+	node.m_request = nullptr;
+	node.m_next = m_free;
+	m_free = n_handle;
+	--m_size;
+}
+
+void TimerWheel::rebind(const Handle n_handle, mrequest *n_request) noexcept {
+
+	if (n_handle) {
+		m_nodes[n_handle].m_request = n_request;
+	}
+}
+
+std::size_t TimerWheel::expire(const TimePoint &n_now, std::vector<mrequest *> &n_expired) {
+
+	const std::uint64_t target = (n_now > m_epoch) ? static_cast<std::uint64_t>((n_now - m_epoch) / m_resolution) : 0;
+
+	std::size_t count = 0;
+	while (m_size) {
+		const std::uint64_t tick = next_tick();
+		if (tick > target) {
+			break;
+		}
+
+		m_now = tick;
+
+		// Higher levels first, they may fill lower slots that are due now as well
+		for (std::size_t level = LEVELS - 1; level > 0; --level) {
+			const unsigned int shift = SLOT_BITS * static_cast<unsigned int>(level);
+			if (!(m_now & ((std::uint64_t(1) << shift) - 1))) {
+				cascade(level * SLOTS + ((m_now >> shift) & (SLOTS - 1)));
+			}
+		}
+
+		const std::size_t slot = m_now & (SLOTS - 1);
+		while (const Handle handle = m_slots[slot]) {
+			n_expired.push_back(m_nodes[handle].m_request);
+			cancel(handle);
+			++count;
+		}
+	}
+
+	// Nothing is due until after target. Moving there doesn't change where anything belongs
+	m_now = std::max(m_now, target);
+
+	return count;
+}
+
+TimePoint TimerWheel::next_expiry() const noexcept {
+
+	if (!m_size) {
+		return TimePoint::max();
+	}
+
+	const std::uint64_t tick = next_tick();
+	if (tick >= static_cast<std::uint64_t>((TimePoint::max() - m_epoch) / m_resolution)) {
+		return TimePoint::max();
+	}
+
+	return m_epoch + m_resolution * tick;
+}
+
+std::size_t TimerWheel::size() const noexcept {
+
+	return m_size;
+}
+
+void TimerWheel::clear() noexcept {
+
+	m_nodes.resize(1);
+	m_free = 0;
+	m_slots.fill(0);
+	m_occupied.fill(0);
+	m_size = 0;
+}
+
+std::uint64_t TimerWheel::to_tick(const TimePoint &n_time) const noexcept {
+
+	if (n_time <= m_epoch) {
+		return 0;
+	}
+
+	const Duration since = n_time - m_epoch;
+	std::uint64_t ticks = static_cast<std::uint64_t>(since / m_resolution);
+	if ((since % m_resolution) != Duration::zero()) {
+		++ticks;
+	}
+
+	return ticks;
+}
+
+std::uint64_t TimerWheel::next_tick() const noexcept {
+
+	// The lowest level with something in it has what comes next. Everything
+	// above is in later rotations of it
+	for (std::size_t level = 0; level < LEVELS; ++level) {
+		std::uint64_t occupied = m_occupied[level];
+		if (!occupied) {
+			continue;
+		}
+
+		// link() only puts nodes into slots ahead of the current one,
+		// and the current slot of level 0 is emptied as soon as it's due
+		std::uint64_t slot = 0;
+		while (!(occupied & 1)) {
+			occupied >>= 1;
+			++slot;
+		}
+
+		const unsigned int shift = SLOT_BITS * static_cast<unsigned int>(level);
+		const unsigned int above = shift + SLOT_BITS;
+		const std::uint64_t rotation = (above >= 64) ? 0 : ((m_now >> above) << above);
+
+		return rotation | (slot << shift);
+	}
+
+	return ~std::uint64_t(0);
+}
+
+void TimerWheel::link(const Handle n_handle) noexcept {
+
+	Node &node = m_nodes[n_handle];
+
+	// The lowest level where the deadline is in the same rotation as we are
+	const std::uint64_t differs = node.m_tick ^ m_now;
+	std::size_t level = 0;
+	while ((level + 1 < LEVELS) && (differs >> (SLOT_BITS * (level + 1)))) {
+		++level;
+	}
+
+	const std::size_t slot = level * SLOTS + ((node.m_tick >> (SLOT_BITS * level)) & (SLOTS - 1));
+	node.m_slot = static_cast<std::uint16_t>(slot);
+	node.m_prev = 0;
+	node.m_next = m_slots[slot];
+	if (node.m_next) {
+		m_nodes[node.m_next].m_prev = n_handle;
+	}
+	m_slots[slot] = n_handle;
+	m_occupied[level] |= std::uint64_t(1) << (slot % SLOTS);
+}
+
+void TimerWheel::unlink(const Handle n_handle) noexcept {
+
+	const Node &node = m_nodes[n_handle];
+
+	if (node.m_prev) {
+		m_nodes[node.m_prev].m_next = node.m_next;
+	} else {
+		m_slots[node.m_slot] = node.m_next;
+	}
+
+	if (node.m_next) {
+		m_nodes[node.m_next].m_prev = node.m_prev;
+	}
+
+	if (!m_slots[node.m_slot]) {
+		m_occupied[node.m_slot / SLOTS] &= ~(std::uint64_t(1) << (node.m_slot % SLOTS));
+	}
+}
+
+void TimerWheel::cascade(const std::size_t n_slot) noexcept {
+
+	Handle handle = m_slots[n_slot];
+	m_slots[n_slot] = 0;
+	m_occupied[n_slot / SLOTS] &= ~(std::uint64_t(1) << (n_slot % SLOTS));
+
+	while (handle) {
+		const Handle next = m_nodes[handle].m_next;
+		link(handle);
+		handle = next;
+	}
+}
+
+}
+}
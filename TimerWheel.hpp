@@ -0,0 +1,105 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "MRedisConfig.hpp"
+#include "MRedisResult.hpp"
+#include "MRedisTypes.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace moose {
+namespace mredis {
+
+/*! @brief request deadlines of one connection, in a hierarchical timing wheel
+	Time is cut into ticks of a fixed resolution. Every level has 64 slots, each slot
+	of a level covers 64 slots of the one below. A deadline goes into the lowest level
+	where it is in the current rotation. Whenever a slot of a higher level comes up,
+	what's in there is spread over the lower ones. Scheduling and cancelling is constant
+	time, no matter how many deadlines there are. Expiring costs one step per slot
+	that has something in it, empty stretches are skipped.
+
+	Deadlines are rounded up to the next tick, they never expire early.
+	Not thread safe. Use it in the connection's strand only.
+ */
+class MREDIS_API TimerWheel {
+
+	public:
+		//! where a deadline is kept. 0 is none
+		using Handle = std::uint32_t;
+
+		//! @param n_resolution length of one tick
+		explicit TimerWheel(const Duration &n_resolution);
+		TimerWheel(const TimerWheel &) = delete;
+		TimerWheel &operator=(const TimerWheel &) = delete;
+
+		/*! @brief expire n_request at n_deadline
+			@return handle to cancel or rebind it. Deadlines in the past expire with the next tick
+			@throw std::bad_alloc
+		 */
+		Handle schedule(const TimePoint &n_deadline, mrequest *n_request);
+
+		//! forget about that deadline. 0 is ignored
+		void cancel(const Handle n_handle) noexcept;
+
+		//! the request has moved. 0 is ignored
+		void rebind(const Handle n_handle, mrequest *n_request) noexcept;
+
+		/*! @brief take out what has expired by n_now, earliest first
+			The handles are freed. Don't cancel them anymore
+			@return number of requests appended to n_expired
+		 */
+		std::size_t expire(const TimePoint &n_now, std::vector<mrequest *> &n_expired);
+
+		//! @return when to call expire() next. TimePoint::max() if there are no deadlines
+		TimePoint next_expiry() const noexcept;
+
+		//! @return how many deadlines there are
+		std::size_t size() const noexcept;
+
+		//! forget all deadlines
+		void clear() noexcept;
+
+	private:
+		enum { SLOT_BITS = 6 };
+		enum { SLOTS     = 1 << SLOT_BITS };
+		enum { LEVELS    = (64 + SLOT_BITS - 1) / SLOT_BITS };   //!< enough for any 64 bit tick, nothing ever overflows
+
+		struct Node {
+			std::uint64_t  m_tick;      //!< deadline
+			mrequest      *m_request;
+			Handle         m_prev;      //!< in the slot's list. Free nodes only use m_next
+			Handle         m_next;
+			std::uint16_t  m_slot;      //!< index into m_slots
+		};
+
+		//! ticks since m_epoch, rounded up
+		std::uint64_t to_tick(const TimePoint &n_time) const noexcept;
+
+		//! the tick of the next slot that has something to expire or spread out
+		std::uint64_t next_tick() const noexcept;
+
+		//! put the node where its tick belongs, relative to m_now
+		void link(const Handle n_handle) noexcept;
+
+		void unlink(const Handle n_handle) noexcept;
+
+		//! spread what's in n_slot over the lower levels
+		void cascade(const std::size_t n_slot) noexcept;
+
+		const TimePoint                           m_epoch;
+		const Duration                            m_resolution;
+		std::uint64_t                             m_now;        //!< the tick we have processed, all before that are empty
+		std::vector<Node>                         m_nodes;      //!< index 0 is not used, so 0 can mean none
+		Handle                                    m_free;       //!< list of unused nodes
+		std::array<Handle, LEVELS * SLOTS>        m_slots;      //!< first node in each slot
+		std::array<std::uint64_t, LEVELS>         m_occupied;   //!< a bit per slot that is not empty
+		std::size_t                               m_size;
+};
+
+}
+}
@@ -316,6 +316,28 @@ bool test_hincr_by() {
 		expect_string_result(n_response, "moep");
 	});
 
+	// decoded right into what we want
+	if (client.hget<std::string>("redistest:myhash", "testfield").get() != "moep") {
+		BOOST_THROW_EXCEPTION(redis_error() << error_message("Unexpected typed hget response"));
+	}
+
+	const std::map<std::string, std::string> hash = client.hgetall<std::map<std::string, std::string> >("redistest:myhash").get();
+	if ((hash.size() != 2) || (hash.at("field") != "14")) {
+		BOOST_THROW_EXCEPTION(redis_error() << error_message("Unexpected typed hgetall response")
+				<< error_argument(hash.size()));
+	}
+
+	if (client.get<std::optional<std::string> >("redistest:not_there").get()) {
+		BOOST_THROW_EXCEPTION(redis_error() << error_message("Unexpected typed get response"));
+	}
+
+	// commands we have no function for
+	expect_int_result(client.command("ZADD", "redistest:myzset", 1.5, "one", 2, std::string("two")), 2);
+	if (client.command<double>("ZSCORE", "redistest:myzset", "one").get() != 1.5) {
+		BOOST_THROW_EXCEPTION(redis_error() << error_message("Unexpected generic command response"));
+	}
+	expect_some_result(client.command("DEL", "redistest:myzset"));
+
 	boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
 	expect_some_result(client.set("redistest:myval:437!:test_key", "This is my Test!"));
 
@@ -0,0 +1,164 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../MRedisCommands.hpp"
+#include "../RespWriter.hpp"
+
+#include <boost/asio/streambuf.hpp>
+#include <boost/spirit/include/karma.hpp>
+#include <boost/spirit/include/karma_format.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace moose::mredis;
+
+/* Serializes commands over and over and reports the rate. Compares the command
+   writer with what we did before, Karma generators on a std::ostream into a streambuf.
+   Not a test, there is nothing to pass or fail. Run with an optional number of 
+   million commands as argument.
+ */
+
+namespace karma = boost::spirit::karma;
+
+//! how format_get() used to work
+void karma_get(std::ostream &n_os, const std::string &n_key) {
+
+	n_os << karma::format_delimited(
+		karma::lit("*2") << karma::lit("$3") << karma::lit("GET") <<
+		karma::no_delimit['$'] << karma::uint_ << karma::string
+		, "\r\n", n_key.size(), n_key);
+}
+
+//! how format_set() used to work, without expiry
+void karma_set(std::ostream &n_os, const std::string &n_key, const std::string &n_value) {
+
+	n_os << karma::format_delimited(
+		karma::no_delimit['*'] << karma::uint_ << karma::lit("$3") << karma::lit("SET") <<
+		karma::no_delimit['$'] << karma::uint_ << karma::string <<
+		karma::no_delimit['$'] << karma::uint_ << karma::string
+		, "\r\n", 3, n_key.size(), n_key, n_value.size(), n_value);
+}
+
+//! we send in batches, like a pipelining connection would
+constexpr std::size_t c_batch = 256;
+
+void run(const char *n_name, const std::size_t n_commands, const std::function<std::size_t()> &n_batch) {
+
+	std::size_t bytes = 0;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < n_commands; i += c_batch) {
+		bytes += n_batch();
+	}
+	const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	const double seconds = std::chrono::duration<double>(end - start).count();
+	std::cout << std::left << std::setw(28) << n_name << std::right << std::fixed << std::setprecision(1)
+		<< std::setw(10) << (n_commands / seconds / 1000000) << " M cmds/s"
+		<< std::setw(10) << (bytes / seconds / (1024 * 1024)) << " MB/s" << std::endl;
+}
+
+int main(int argc, char **argv) {
+
+	const std::size_t commands = ((argc > 1) ? static_cast<std::size_t>(std::atoi(argv[1])) : 10) * 1000000;
+
+	const std::string key("mredis:bench:some_key:1234");
+	const std::string small_value(100, 'v');
+	const std::string large_value(16 * 1024, 'v');
+	const std::string huge_value(1024 * 1024, 'v');
+
+	boost::asio::streambuf streambuf;
+	CommandBuffer buffer;
+
+	run("GET, karma ostream", commands, [&] {
+		{
+			std::ostream os(&streambuf);
+			for (std::size_t i = 0; i < c_batch; ++i) {
+				karma_get(os, key);
+			}
+		}
+		const std::size_t size = streambuf.size();
+		streambuf.consume(size);
+		return size;
+	});
+
+	run("GET, command writer", commands, [&] {
+		for (std::size_t i = 0; i < c_batch; ++i) {
+			format_get(buffer, key);
+		}
+		const std::size_t size = buffer.size();
+		buffer.clear();
+		return size;
+	});
+
+	run("SET 100 B, karma ostream", commands, [&] {
+		{
+			std::ostream os(&streambuf);
+			for (std::size_t i = 0; i < c_batch; ++i) {
+				karma_set(os, key, small_value);
+			}
+		}
+		const std::size_t size = streambuf.size();
+		streambuf.consume(size);
+		return size;
+	});
+
+	run("SET 100 B, command writer", commands, [&] {
+		for (std::size_t i = 0; i < c_batch; ++i) {
+			format_set(buffer, key, small_value, c_invalid_duration, SetCondition::NONE);
+		}
+		const std::size_t size = buffer.size();
+		buffer.clear();
+		return size;
+	});
+
+	run("SET 16 KB, karma ostream", commands / 100, [&] {
+		{
+			std::ostream os(&streambuf);
+			for (std::size_t i = 0; i < c_batch; ++i) {
+				karma_set(os, key, large_value);
+			}
+		}
+		const std::size_t size = streambuf.size();
+		streambuf.consume(size);
+		return size;
+	});
+
+	run("SET 16 KB, command writer", commands / 100, [&] {
+		for (std::size_t i = 0; i < c_batch; ++i) {
+			format_set(buffer, key, large_value, c_invalid_duration, SetCondition::NONE);
+		}
+		const std::size_t size = buffer.size();
+		buffer.clear();
+		return size;
+	});
+
+	run("SET 1 MB, copied", commands / 10000, [&] {
+		for (std::size_t i = 0; i < c_batch; ++i) {
+			format_set(buffer, key, huge_value, c_invalid_duration, SetCondition::NONE);
+		}
+		const std::size_t size = buffer.size();
+		buffer.clear();
+		return size;
+	});
+
+	// what the connection does by default
+	buffer.set_reference_threshold(16 * 1024);
+	run("SET 1 MB, referenced", commands / 10000, [&] {
+		for (std::size_t i = 0; i < c_batch; ++i) {
+			format_set(buffer, key, huge_value, c_invalid_duration, SetCondition::NONE);
+		}
+		const std::size_t size = boost::asio::buffer_size(buffer.buffers());
+		buffer.clear();
+		return size;
+	});
+
+	return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,125 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../RequestQueue.hpp"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+using namespace moose::mredis;
+
+/* Many threads hand requests to one io thread, the way the connection does it.
+   Compares what we did before, a mutex, a deque and one post per request, with the
+   lock-free queue that only posts when it was empty. Reports how long a push takes
+   on the producer's side and how many handlers the io thread had to run.
+   Not a test, there is nothing to pass or fail. Run with optional numbers of
+   producer threads and thousand requests per thread as arguments.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+//! the io thread's side: what it has taken and how often it was woken up for it
+struct Consumer {
+	std::deque<mrequest>  m_taken;
+	std::size_t           m_handlers = 0;
+};
+
+//! one implementation of the producer's side. Called from many threads
+using Push = std::function<void(boost::asio::io_context &n_io, Consumer &n_consumer, mrequest &&n_request)>;
+
+void run(const char *n_name, const std::size_t n_producers, const std::size_t n_requests, const Push &n_push) {
+
+	boost::asio::io_context io;
+	Consumer consumer;
+
+	// keep the io thread running until all is taken
+	auto work = boost::asio::make_work_guard(io);
+	boost::thread io_thread([&io] { io.run(); });
+
+	std::vector<std::vector<Clock::duration> > latencies(n_producers);
+	boost::thread_group producers;
+	for (std::size_t p = 0; p < n_producers; ++p) {
+		latencies[p].reserve(n_requests);
+		producers.create_thread([&, p] {
+			for (std::size_t i = 0; i < n_requests; ++i) {
+				const Clock::time_point start = Clock::now();
+				n_push(io, consumer, mrequest{ nullptr, [](const RedisMessage &) {} });
+				latencies[p].push_back(Clock::now() - start);
+			}
+		});
+	}
+	producers.join_all();
+
+	// whatever is still queued is taken before we stop
+	boost::asio::post(io, [&work] { work.reset(); });
+	io_thread.join();
+
+	std::vector<Clock::duration> all;
+	for (const std::vector<Clock::duration> &l : latencies) {
+		all.insert(all.end(), l.begin(), l.end());
+	}
+	std::sort(all.begin(), all.end());
+
+	const auto ns = [](const Clock::duration n_duration) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(n_duration).count();
+	};
+
+	std::cout << std::left << std::setw(24) << n_name << std::right
+		<< std::setw(10) << ns(all[all.size() / 2]) << " ns p50"
+		<< std::setw(10) << ns(all[all.size() * 99 / 100]) << " ns p99"
+		<< std::setw(10) << ns(all[all.size() * 999 / 1000]) << " ns p99.9"
+		<< std::setw(12) << consumer.m_handlers << " handlers for "
+		<< consumer.m_taken.size() << " requests" << std::endl;
+}
+
+int main(int argc, char **argv) {
+
+	const std::size_t producers = (argc > 1) ? static_cast<std::size_t>(std::atoi(argv[1])) : 32;
+	const std::size_t requests = ((argc > 2) ? static_cast<std::size_t>(std::atoi(argv[2])) : 100) * 1000;
+
+	boost::mutex lock;
+	std::deque<mrequest> locked_queue;
+
+	// how MRedisConnection::send() used to work
+	run("mutex, post each", producers, requests, [&](boost::asio::io_context &n_io, Consumer &n_consumer, mrequest &&n_request) {
+		{
+			boost::unique_lock<boost::mutex> slock(lock);
+			locked_queue.emplace_back(std::move(n_request));
+		}
+
+		boost::asio::post(n_io, [&] {
+			++n_consumer.m_handlers;
+			boost::unique_lock<boost::mutex> slock(lock);
+			for (mrequest &req : locked_queue) {
+				n_consumer.m_taken.emplace_back(std::move(req));
+			}
+			locked_queue.clear();
+		});
+	});
+
+	RequestQueue queue;
+	run("lock-free, coalesced", producers, requests, [&](boost::asio::io_context &n_io, Consumer &n_consumer, mrequest &&n_request) {
+		if (queue.push(std::move(n_request))) {
+			boost::asio::post(n_io, [&] {
+				++n_consumer.m_handlers;
+				queue.drain(n_consumer.m_taken);
+			});
+		}
+	});
+
+	return EXIT_SUCCESS;
+}
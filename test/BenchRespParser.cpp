@@ -0,0 +1,125 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../RESP.hpp"
+#include "../RespScanner.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace moose::mredis;
+
+/* Feeds typical reply mixes through the parser and reports throughput.
+   Not a test, there is nothing to pass or fail. Run with an optional
+   number of rounds as argument.
+ */
+
+//! the size a buffer of replies should roughly have. Large enough to leave the cache
+constexpr std::size_t c_buffer_size = 16 * 1024 * 1024;
+
+std::string bulk(const std::size_t n_length) {
+
+	return "$" + std::to_string(n_length) + "\r\n" + std::string(n_length, 'x') + "\r\n";
+}
+
+//! repeat a reply pattern until the buffer has c_buffer_size
+std::string fill(const std::function<std::string(std::size_t)> &n_pattern, std::size_t &n_messages) {
+
+	std::string buffer;
+	buffer.reserve(c_buffer_size + 1024 * 1024);
+	n_messages = 0;
+	while (buffer.size() < c_buffer_size) {
+		buffer += n_pattern(n_messages++);
+	}
+	return buffer;
+}
+
+void run(const char *n_name, const std::function<std::string(std::size_t)> &n_pattern, const unsigned int n_rounds) {
+
+	std::size_t messages = 0;
+	const std::string buffer = fill(n_pattern, messages);
+
+	RespParser parser;
+	RedisMessage msg;
+	std::size_t parsed = 0;
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int round = 0; round < n_rounds; ++round) {
+		const char *pos = buffer.data();
+		const char *end = pos + buffer.size();
+		while (pos < end) {
+			bool complete = false;
+			pos += parser.feed(pos, end, msg, complete);
+			if (parser.failed()) {
+				std::cerr << n_name << ": parser failed" << std::endl;
+				return;
+			}
+			if (complete) {
+				++parsed;
+			}
+		}
+	}
+	const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	const double seconds = std::chrono::duration<double>(end - start).count();
+	const double bytes = static_cast<double>(buffer.size()) * n_rounds;
+
+	std::cout << std::left << std::setw(28) << n_name << std::right << std::fixed << std::setprecision(1)
+		<< std::setw(10) << (bytes / seconds / (1024 * 1024)) << " MB/s"
+		<< std::setw(12) << (parsed / seconds / 1000000) << " M msgs/s" << std::endl;
+
+	if (parsed != messages * n_rounds) {
+		std::cerr << n_name << ": expected " << messages * n_rounds << " messages, got " << parsed << std::endl;
+	}
+}
+
+int main(int argc, char **argv) {
+
+	const unsigned int rounds = (argc > 1) ? static_cast<unsigned int>(std::atoi(argv[1])) : 5;
+
+	std::cout << "Line end kernel: " << scan_kernel_name() << ", " << rounds << " rounds" << std::endl;
+
+	run("status +OK", [](std::size_t) { return std::string("+OK\r\n"); }, rounds);
+	run("integers", [](std::size_t n_index) { return ":" + std::to_string(n_index) + "\r\n"; }, rounds);
+	run("bulk 16 bytes", [](std::size_t) { return bulk(16); }, rounds);
+	run("bulk 1 KB", [](std::size_t) { return bulk(1024); }, rounds);
+	run("bulk 64 KB", [](std::size_t) { return bulk(64 * 1024); }, rounds);
+
+	// like MGET of 100 small values
+	run("array of 100 x 32 bytes", [](std::size_t) {
+		std::string reply("*100\r\n");
+		for (int i = 0; i < 100; ++i) {
+			reply += bulk(32);
+		}
+		return reply;
+	}, rounds);
+
+	// like HGETALL or a SCAN page
+	run("nested scan page", [](std::size_t n_index) {
+		std::string reply("*2\r\n$" + std::to_string(std::to_string(n_index).size()) + "\r\n" + std::to_string(n_index) + "\r\n*10\r\n");
+		for (int i = 0; i < 10; ++i) {
+			reply += bulk(24);
+		}
+		return reply;
+	}, rounds);
+
+	// what a pipelining client typically sees
+	run("mixed", [](std::size_t n_index) {
+		switch (n_index % 4) {
+			default:
+			case 0: return std::string("+OK\r\n");
+			case 1: return ":" + std::to_string(n_index) + "\r\n";
+			case 2: return bulk(64);
+			case 3: return std::string("$-1\r\n");
+		}
+	}, rounds);
+
+	return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,184 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../AsyncClient.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace moose::mredis;
+
+/* Pipelines GETs through the client to a stand-in server on loopback and reports
+   requests per second and CPU time per request. Build once as is and once with
+   MREDIS_IO_URING to compare epoll with io_uring. The server runs in this process
+   and on the same backend, so the CPU time is both sides together.
+   Not a test, there is nothing to pass or fail. Run with optional numbers of
+   thousand requests and connections as arguments.
+ */
+
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+
+//! answers PING with PONG and everything else with a null. All we need to see the client's I/O path
+class NullServer {
+
+	public:
+		NullServer() : m_acceptor{ m_io_context, tcp::endpoint(asio::ip::address_v4::loopback(), 0) } {
+
+			accept();
+			m_thread = boost::thread([this] { m_io_context.run(); });
+		}
+
+		~NullServer() {
+
+			m_io_context.stop();
+			m_thread.join();
+		}
+
+		boost::uint16_t port() const {
+
+			return m_acceptor.local_endpoint().port();
+		}
+
+	private:
+		struct Session {
+
+			explicit Session(asio::io_context &n_io_context) : m_socket{ n_io_context } {}
+
+			tcp::socket m_socket;
+			char        m_chunk[64 * 1024];
+			std::string m_input;
+			std::string m_output;
+		};
+
+		void accept() {
+
+			std::shared_ptr<Session> session = std::make_shared<Session>(m_io_context);
+			m_acceptor.async_accept(session->m_socket, [this, session](const boost::system::error_code &n_errc) {
+
+				if (!n_errc) {
+					read(session);
+					accept();
+				}
+			});
+		}
+
+		void read(std::shared_ptr<Session> n_session) {
+
+			n_session->m_socket.async_read_some(asio::buffer(n_session->m_chunk),
+				[this, n_session](const boost::system::error_code &n_errc, const std::size_t n_bytes) {
+
+					if (n_errc) {
+						return;
+					}
+
+					n_session->m_input.append(n_session->m_chunk, n_bytes);
+					n_session->m_output.clear();
+					answer(n_session->m_input, n_session->m_output);
+
+					boost::system::error_code ignored_error;
+					asio::write(n_session->m_socket, asio::buffer(n_session->m_output), ignored_error);
+					read(n_session);
+			});
+		}
+
+		//! answer and remove complete arrays of bulk strings
+		static void answer(std::string &n_input, std::string &n_output) {
+
+			static const std::string c_ping("*1\r\n$4\r\nPING\r\n");
+
+			std::size_t pos = 0;
+			while (pos < n_input.size()) {
+				std::size_t cursor = n_input.find("\r\n", pos);
+				if (cursor == std::string::npos) {
+					break;
+				}
+
+				std::size_t elements = std::strtoul(n_input.c_str() + pos + 1, nullptr, 10);
+				cursor += 2;
+				bool complete = true;
+				while (elements--) {
+					const std::size_t end = n_input.find("\r\n", cursor);
+					if (end == std::string::npos) {
+						complete = false;
+						break;
+					}
+					cursor = end + 2 + std::strtoul(n_input.c_str() + cursor + 1, nullptr, 10) + 2;
+					if (cursor > n_input.size()) {
+						complete = false;
+						break;
+					}
+				}
+
+				if (!complete) {
+					break;
+				}
+
+				n_output.append((n_input.compare(pos, cursor - pos, c_ping) == 0) ? "+PONG\r\n" : "$-1\r\n");
+				pos = cursor;
+			}
+
+			n_input.erase(0, pos);
+		}
+
+		asio::io_context m_io_context;
+		tcp::acceptor    m_acceptor;
+		boost::thread    m_thread;
+};
+
+//! keep that many requests in flight at a time
+constexpr std::size_t c_window = 4096;
+
+int main(int argc, char **argv) {
+
+	const std::size_t requests = ((argc > 1) ? static_cast<std::size_t>(std::atoi(argv[1])) : 1000) * 1000;
+	const std::size_t connections = (argc > 2) ? static_cast<std::size_t>(std::atoi(argv[2])) : 1;
+
+	NullServer server;
+	AsyncClient client("127.0.0.1", server.port(), static_cast<unsigned int>(connections));
+	client.set_connections(connections);
+	client.connect();
+
+#if defined(BOOST_ASIO_HAS_IO_URING)
+	const char *backend = "io_uring";
+#else
+	const char *backend = "epoll";
+#endif
+
+	std::atomic<std::size_t> answered{ 0 };
+	const std::clock_t cpu_start = std::clock();
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (std::size_t sent = 0; sent < requests; ++sent) {
+		while (sent - answered.load(std::memory_order_relaxed) >= c_window) {
+			boost::this_thread::yield();
+		}
+		client.get("mredis:bench:key", [&answered](const RedisMessage &) { answered.fetch_add(1, std::memory_order_relaxed); });
+	}
+	while (answered.load() < requests) {
+		boost::this_thread::yield();
+	}
+
+	const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	const std::clock_t cpu_end = std::clock();
+
+	const double seconds = std::chrono::duration<double>(end - start).count();
+	const double cpu_seconds = static_cast<double>(cpu_end - cpu_start) / CLOCKS_PER_SEC;
+	std::cout << std::left << std::setw(10) << backend << std::right << std::fixed << std::setprecision(2)
+		<< std::setw(10) << (requests / seconds / 1000000) << " M req/s"
+		<< std::setw(10) << (cpu_seconds * 1000000000 / requests) << " ns CPU/req"
+		<< "  (" << connections << " connections)" << std::endl;
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,975 @@
+
+//  Copyright 2018 Stephan Menzel. Distributed under the Boost
+//  Software License, Version 1.0. (See accompanying file
+//  LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#define BOOST_TEST_MODULE ConnectionTest
+#include <boost/test/unit_test.hpp>
+
+#include "../AsyncClient.hpp"
+#include "../MRedisConnection.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace moose::mredis;
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+namespace {
+
+namespace asio = boost::asio;
+using local = asio::local::stream_protocol;
+
+/* A stand-in for redis on a unix domain socket. Knows just enough commands to see
+   the client through connect, pipelining and pubsub. Runs in a thread of its own.
+ */
+class FakeServer {
+
+	public:
+		FakeServer()
+				: FakeServer{ (std::filesystem::temp_directory_path() / ("mredis_test_" + std::to_string(std::rand()) + ".sock")).string() } {
+		}
+
+		//! listen on n_path, to come back where an earlier one was
+		explicit FakeServer(const std::string &n_path)
+				: m_path{ n_path }
+				, m_acceptor{ m_io_context } {
+
+			std::remove(m_path.c_str());
+			m_acceptor.open(local());
+			m_acceptor.bind(local::endpoint(m_path));
+			m_acceptor.listen();
+			accept();
+			m_thread = boost::thread([this] { m_io_context.run(); });
+		}
+
+		~FakeServer() {
+
+			asio::post(m_io_context, [this] {
+				boost::system::error_code ignored_error;
+				m_acceptor.close(ignored_error);
+				for (const std::shared_ptr<Session> &s : m_sessions) {
+					s->m_socket.close(ignored_error);
+				}
+				m_sessions.clear();
+			});
+			m_thread.join();
+			std::remove(m_path.c_str());
+		}
+
+		const std::string &path() const noexcept {
+
+			return m_path;
+		}
+
+		//! connections accepted so far
+		std::size_t accepted() const noexcept {
+
+			return m_accepted;
+		}
+
+		//! keep executing commands but hold the replies back until false. Then they go out
+		void hold_replies(const bool n_hold) {
+
+			asio::post(m_io_context, [this, n_hold] {
+				m_hold = n_hold;
+				if (!m_hold) {
+					for (const std::shared_ptr<Session> &s : m_sessions) {
+						send(s, std::move(s->m_held));
+						s->m_held.clear();
+					}
+				}
+			});
+		}
+
+		//! commands taken so far, answered or not
+		std::size_t received() const noexcept {
+
+			return m_received;
+		}
+
+		//! close all client connections as if the server went away for a moment
+		void drop_connections() {
+
+			asio::post(m_io_context, [this] {
+				boost::system::error_code ignored_error;
+				for (const std::shared_ptr<Session> &s : m_sessions) {
+					s->m_socket.close(ignored_error);
+				}
+				m_sessions.clear();
+			});
+		}
+
+	private:
+		struct Session {
+
+			explicit Session(asio::io_context &n_io_context) : m_socket{ n_io_context } {}
+
+			local::socket         m_socket;
+			char                  m_chunk[4096];
+			std::string           m_input;
+			std::string           m_held;    //!< replies while we hold them
+			std::set<std::string> m_channels;
+			bool                  m_resp3 = false;  //!< said HELLO 3. Pubsub goes out as push
+		};
+
+		void accept() {
+
+			std::shared_ptr<Session> session = std::make_shared<Session>(m_io_context);
+			m_acceptor.async_accept(session->m_socket, [this, session](const boost::system::error_code &n_errc) {
+
+				if (n_errc) {
+					return;
+				}
+
+				m_sessions.insert(session);
+				++m_accepted;
+				read(session);
+				accept();
+			});
+		}
+
+		void read(std::shared_ptr<Session> n_session) {
+
+			n_session->m_socket.async_read_some(asio::buffer(n_session->m_chunk),
+				[this, n_session](const boost::system::error_code &n_errc, const std::size_t n_bytes) {
+
+					if (n_errc) {
+						m_sessions.erase(n_session);
+						return;
+					}
+
+					n_session->m_input.append(n_session->m_chunk, n_bytes);
+
+					std::vector<std::string> command;
+					// counted before the reply goes out, whoever got it sees the count
+					while (take_command(n_session->m_input, command)) {
+						++m_received;
+						execute(n_session, command);
+					}
+
+					read(n_session);
+			});
+		}
+
+		//! only arrays of bulk strings, which is all the client sends
+		static bool take_command(std::string &n_input, std::vector<std::string> &n_command) {
+
+			n_command.clear();
+			if (n_input.empty() || (n_input[0] != '*')) {
+				return false;
+			}
+
+			std::size_t pos = n_input.find("\r\n");
+			if (pos == std::string::npos) {
+				return false;
+			}
+
+			const std::size_t elements = boost::lexical_cast<std::size_t>(n_input.substr(1, pos - 1));
+			pos += 2;
+			for (std::size_t i = 0; i < elements; ++i) {
+				const std::size_t end = n_input.find("\r\n", pos);
+				if (end == std::string::npos) {
+					return false;
+				}
+				const std::size_t length = boost::lexical_cast<std::size_t>(n_input.substr(pos + 1, end - pos - 1));
+				if (n_input.size() < end + 2 + length + 2) {
+					return false;
+				}
+				n_command.push_back(n_input.substr(end + 2, length));
+				pos = end + 2 + length + 2;
+			}
+
+			n_input.erase(0, pos);
+			return true;
+		}
+
+		static std::string bulk(const std::string &n_value) {
+
+			return "$" + std::to_string(n_value.size()) + "\r\n" + n_value + "\r\n";
+		}
+
+		//! header of a pubsub message, a push in RESP3
+		static std::string pubsub(const std::shared_ptr<Session> &n_session) {
+
+			return n_session->m_resp3 ? ">3\r\n" : "*3\r\n";
+		}
+
+		void execute(const std::shared_ptr<Session> &n_session, const std::vector<std::string> &n_command) {
+
+			const std::string &name = n_command.front();
+			if (name == "PING") {
+				send(n_session, "+PONG\r\n");
+			} else if (name == "HELLO") {
+				n_session->m_resp3 = (n_command.size() > 1) && (n_command[1] == "3");
+				send(n_session, "%1\r\n" + bulk("proto") + ":" + (n_session->m_resp3 ? "3" : "2") + "\r\n");
+			} else if (name == "SET") {
+				m_values[n_command[1]] = n_command[2];
+				send(n_session, "+OK\r\n");
+			} else if (name == "GET") {
+				const auto v = m_values.find(n_command[1]);
+				send(n_session, (v == m_values.end()) ? std::string("$-1\r\n") : bulk(v->second));
+			} else if (name == "INCR") {
+				std::string &v = m_values[n_command[1]];
+				v = std::to_string((v.empty() ? 0 : boost::lexical_cast<long long>(v)) + 1);
+				send(n_session, ":" + v + "\r\n");
+			} else if (name == "SADD") {
+				std::set<std::string> &members = m_sets[n_command[1]];
+				const std::size_t before = members.size();
+				members.insert(n_command.begin() + 2, n_command.end());
+				send(n_session, ":" + std::to_string(members.size() - before) + "\r\n");
+			} else if (name == "SMEMBERS") {
+				const std::set<std::string> &members = m_sets[n_command[1]];
+				std::string reply = "*" + std::to_string(members.size()) + "\r\n";
+				for (const std::string &m : members) {
+					reply += bulk(m);
+				}
+				send(n_session, std::move(reply));
+			} else if (name == "SUBSCRIBE") {
+				for (std::size_t i = 1; i < n_command.size(); ++i) {
+					n_session->m_channels.insert(n_command[i]);
+					send(n_session, pubsub(n_session) + bulk("subscribe") + bulk(n_command[i]) + ":" + std::to_string(n_session->m_channels.size()) + "\r\n");
+				}
+			} else if (name == "UNSUBSCRIBE") {
+				for (std::size_t i = 1; i < n_command.size(); ++i) {
+					n_session->m_channels.erase(n_command[i]);
+					send(n_session, pubsub(n_session) + bulk("unsubscribe") + bulk(n_command[i]) + ":" + std::to_string(n_session->m_channels.size()) + "\r\n");
+				}
+			} else if (name == "PUBLISH") {
+				std::size_t receivers = 0;
+				for (const std::shared_ptr<Session> &s : m_sessions) {
+					if (s->m_channels.count(n_command[1])) {
+						send(s, pubsub(s) + bulk("message") + bulk(n_command[1]) + bulk(n_command[2]));
+						++receivers;
+					}
+				}
+				send(n_session, ":" + std::to_string(receivers) + "\r\n");
+			} else {
+				send(n_session, "-ERR unknown command '" + name + "'\r\n");
+			}
+		}
+
+		void send(const std::shared_ptr<Session> &n_session, std::string &&n_response) {
+
+			if (m_hold) {
+				n_session->m_held.append(n_response);
+				return;
+			}
+
+			// good enough for a test. We're the only thread and writes to a local socket complete
+			boost::system::error_code ignored_error;
+			asio::write(n_session->m_socket, asio::buffer(n_response), ignored_error);
+		}
+
+		const std::string                   m_path;
+		asio::io_context                    m_io_context;
+		local::acceptor                     m_acceptor;
+		boost::thread                       m_thread;
+		std::set<std::shared_ptr<Session> > m_sessions;
+		std::map<std::string, std::string>  m_values;
+		std::map<std::string, std::set<std::string> >
+		                                    m_sets;
+		bool                                m_hold{ false };
+		std::atomic<std::size_t>            m_received{ 0 };
+		std::atomic<std::size_t>            m_accepted{ 0 };
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(UnixSocketPipelining) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.connect();
+
+	client.set("answer", "42");
+	const RedisMessage answer = client.get("answer").get();
+	BOOST_REQUIRE(is_string(answer));
+	BOOST_CHECK_EQUAL(boost::get<std::string>(answer), "42");
+
+	std::vector<future_response> increments;
+	for (int i = 0; i < 1000; ++i) {
+		increments.push_back(client.incr("counter"));
+	}
+	for (int i = 0; i < 1000; ++i) {
+		const RedisMessage r = increments[i].get();
+		BOOST_REQUIRE(is_int(r));
+		BOOST_CHECK_EQUAL(boost::get<boost::int64_t>(r), i + 1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(EmptyCallback) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.connect();
+
+	client.set("answer", "42");
+
+	// Nobody wants this reply but it comes anyway. It must not go to the next one
+	client.incr("counter", Callback());
+	const RedisMessage answer = client.get("answer").get();
+	BOOST_REQUIRE(is_string(answer));
+	BOOST_CHECK_EQUAL(boost::get<std::string>(answer), "42");
+
+	const RedisMessage counter = client.get("counter").get();
+	BOOST_REQUIRE(is_string(counter));
+	BOOST_CHECK_EQUAL(boost::get<std::string>(counter), "1");
+	BOOST_CHECK_EQUAL(client.pending(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(UnixSocketPubsub) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.connect();
+
+	boost::promise<std::string> received;
+	client.subscribe("news", [&received](const std::string &n_message) { received.set_value(n_message); });
+
+	const RedisMessage receivers = client.publish("news", "hello").get();
+	BOOST_REQUIRE(is_int(receivers));
+	BOOST_CHECK_EQUAL(boost::get<boost::int64_t>(receivers), 1);
+
+	boost::unique_future<std::string> message = received.get_future();
+	BOOST_REQUIRE(message.wait_for(boost::chrono::seconds(2)) == boost::future_status::ready);
+	BOOST_CHECK_EQUAL(message.get(), "hello");
+}
+
+BOOST_AUTO_TEST_CASE(Resp3Resubscribe) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.connect(RespVersion::RESP3);
+
+	std::atomic<int> received{ 0 };
+	client.subscribe("news", [&received](const std::string &) { ++received; });
+
+	const RedisMessage receivers = client.publish("news", "hello").get();
+	BOOST_REQUIRE(is_int(receivers));
+	BOOST_CHECK_EQUAL(boost::get<boost::int64_t>(receivers), 1);
+
+	// Nothing else is sent on it. It reconnects on its own and subscribes again
+	server.drop_connections();
+	boost::int64_t count = 0;
+	for (int i = 0; (i < 200) && (count != 1); ++i) {
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+		try {
+			// May have gone out on the old connection
+			const RedisMessage r = client.publish("news", "again").get();
+			BOOST_REQUIRE(is_int(r));
+			count = boost::get<boost::int64_t>(r);
+		} catch (const redis_error &) {
+		}
+	}
+	BOOST_CHECK_EQUAL(count, 1);
+
+	for (int i = 0; (i < 200) && (received < 2); ++i) {
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+	}
+	BOOST_CHECK_EQUAL(received, 2);
+}
+
+BOOST_AUTO_TEST_CASE(Resp3ThrowingHandler) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.connect(RespVersion::RESP3);
+
+	std::atomic<int> received{ 0 };
+	client.subscribe("news", [](const std::string &) { throw std::runtime_error("not my day"); });
+	client.subscribe("news", [&received](const std::string &) { ++received; });
+
+	// Both messages arrive at once. The one after the exception is parsed all the same
+	server.hold_replies(true);
+	const std::size_t before = server.received();
+	future_response first = client.publish("news", "one");
+	future_response second = client.publish("news", "two");
+	for (int i = 0; (i < 200) && (server.received() < before + 2); ++i) {
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+	}
+	server.hold_replies(false);
+
+	BOOST_REQUIRE(second.wait_for(boost::chrono::seconds(5)) == boost::future_status::ready);
+	for (int i = 0; (i < 200) && (received < 2); ++i) {
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+	}
+	BOOST_CHECK_EQUAL(received, 2);
+}
+
+BOOST_AUTO_TEST_CASE(DoubleBufferedWrites) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.connect();
+
+	// Large values keep one batch on the wire while the next fills up. Both go out in order
+	const std::string padding(64 * 1024, 'p');
+	std::vector<future_response> reads;
+	for (int i = 0; i < 200; ++i) {
+		client.set("value", padding + std::to_string(i));
+		reads.push_back(client.get("value"));
+	}
+
+	for (int i = 0; i < 200; ++i) {
+		const RedisMessage r = reads[i].get();
+		BOOST_REQUIRE(is_string(r));
+		BOOST_CHECK(boost::get<std::string>(r) == padding + std::to_string(i));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(PoolKeyAffinity) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.set_connections(4);
+	client.set_key_affinity(true);
+	client.connect();
+
+	// and one for pubsub
+	for (int i = 0; (i < 100) && (server.accepted() < 5); ++i) {
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+	}
+	BOOST_CHECK_EQUAL(server.accepted(), 5);
+
+	// Nothing waits in between. Requests for one key take the same connection and stay in order
+	std::vector<future_response> reads;
+	for (int i = 0; i < 1000; ++i) {
+		const std::string key = "key" + std::to_string(i % 10);
+		client.set(key, std::to_string(i));
+		reads.push_back(client.get(key));
+	}
+
+	for (int i = 0; i < 1000; ++i) {
+		const RedisMessage r = reads[i].get();
+		BOOST_REQUIRE(is_string(r));
+		BOOST_CHECK_EQUAL(boost::get<std::string>(r), std::to_string(i));
+	}
+
+	// Generic commands go by their first argument, along with the others
+	reads.clear();
+	for (int i = 0; i < 1000; ++i) {
+		const std::string key = "key" + std::to_string(i % 10);
+		client.command("SET", key, i);
+		reads.push_back((i % 2) ? client.get(key) : client.command("GET", std::string_view(key)));
+	}
+
+	for (int i = 0; i < 1000; ++i) {
+		const RedisMessage r = reads[i].get();
+		BOOST_REQUIRE(is_string(r));
+		BOOST_CHECK_EQUAL(boost::get<std::string>(r), std::to_string(i));
+	}
+
+	// Without a key they are spread out. All of them are answered
+	std::vector<future_response> published;
+	for (int i = 0; i < 1000; ++i) {
+		published.push_back(client.publish("nobody", "listens"));
+	}
+	for (future_response &p : published) {
+		BOOST_CHECK(is_int(p.get()));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(SeveralIoThreads) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() }, 4);
+	client.set_connections(4);
+	client.connect();
+
+	// Several producers, several io threads. Every callback is called once
+	std::atomic<int> answered{ 0 };
+	boost::thread_group producers;
+	for (int t = 0; t < 4; ++t) {
+		producers.create_thread([&client, &answered] {
+			for (int i = 0; i < 500; ++i) {
+				client.incr("counter", [&answered](const RedisMessage &n_response) {
+					if (is_int(n_response)) {
+						++answered;
+					}
+				});
+			}
+		});
+	}
+	producers.join_all();
+
+	for (int i = 0; (i < 500) && (answered < 2000); ++i) {
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+	}
+	BOOST_CHECK_EQUAL(answered, 2000);
+
+	const RedisMessage counter = client.get("counter").get();
+	BOOST_REQUIRE(is_string(counter));
+	BOOST_CHECK_EQUAL(boost::get<std::string>(counter), "2000");
+}
+
+BOOST_AUTO_TEST_CASE(ExternalIoContext) {
+
+	FakeServer server;
+	asio::io_context io;
+	asio::executor_work_guard<asio::io_context::executor_type> work = asio::make_work_guard(io);
+	boost::thread runner([&io] { io.run(); });
+
+	future_response late;
+	{
+		AsyncClient client(io, UnixSocket{ server.path() });
+		client.connect();
+
+		client.set("answer", "42");
+
+		// Callbacks run in our thread
+		boost::promise<boost::thread::id> called;
+		client.get("answer", [&called](const RedisMessage &) { called.set_value(boost::this_thread::get_id()); });
+		BOOST_CHECK(called.get_future().get() == runner.get_id());
+
+		// Still waiting for its answer when the client goes
+		server.hold_replies(true);
+		late = client.get("answer");
+	}
+
+	// It failed, the io_context is still ours and runs on
+	BOOST_REQUIRE(late.wait_for(boost::chrono::seconds(2)) == boost::future_status::ready);
+	BOOST_CHECK_THROW(late.get(), redis_error);
+
+	boost::promise<bool> ran;
+	asio::post(io, [&ran] { ran.set_value(true); });
+	BOOST_CHECK(ran.get_future().get());
+
+	work.reset();
+	runner.join();
+}
+
+BOOST_AUTO_TEST_CASE(LargeValues) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.connect();
+
+	// Several times the receive slab. They don't fit and are received on their own
+	const std::string large(3 * 1024 * 1024 + 17, 'l');
+	client.set("large", large);
+	client.set("small", "s");
+
+	for (int i = 0; i < 3; ++i) {
+		future_response value = client.get("large");
+		future_response small = client.get("small");
+		const RedisMessage v = value.get();
+		BOOST_REQUIRE(is_string(v));
+		BOOST_CHECK(boost::get<std::string>(v) == large);
+		BOOST_CHECK_EQUAL(boost::get<std::string>(small.get()), "s");
+	}
+
+	boost::promise<std::size_t> copied;
+	client.get("large", [&copied](const RedisReply &n_reply) {
+		copied.set_value(n_reply.root().string().size());
+	});
+	BOOST_CHECK_EQUAL(copied.get_future().get(), large.size());
+
+	// Same for pubsub messages
+	boost::promise<std::string> received;
+	client.subscribe("blobs", [&received](const std::string &n_message) { received.set_value(n_message); });
+	client.publish("blobs", large).get();
+
+	boost::unique_future<std::string> message = received.get_future();
+	BOOST_REQUIRE(message.wait_for(boost::chrono::seconds(5)) == boost::future_status::ready);
+	BOOST_CHECK(message.get() == large);
+}
+
+BOOST_AUTO_TEST_CASE(UnresolvableHost) {
+
+	// .invalid never resolves. The lookup fails in the background, the caller only learns of it
+	AsyncClient client("mredis.invalid");
+	BOOST_CHECK_THROW(client.connect(), moose::tools::network_error);
+
+	boost::shared_future<bool> connected = client.async_connect();
+	BOOST_REQUIRE(connected.wait_for(boost::chrono::seconds(5)) == boost::future_status::ready);
+	BOOST_CHECK(connected.has_exception());
+}
+
+BOOST_AUTO_TEST_CASE(ReplayReadsAfterReconnect) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.connect();
+
+	client.set("answer", "42").get();
+
+	// The server takes them all but the connection drops before it answers
+	server.hold_replies(true);
+	const std::size_t before = server.received();
+	std::vector<future_response> reads;
+	for (int i = 0; i < 100; ++i) {
+		reads.push_back(client.get("answer"));
+	}
+	future_response increment = client.incr("counter");
+
+	for (int i = 0; (i < 200) && (server.received() < before + 101); ++i) {
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+	}
+	BOOST_REQUIRE_EQUAL(server.received(), before + 101);
+
+	server.drop_connections();
+	server.hold_replies(false);
+
+	// Reads went out again on the new connection
+	for (future_response &r : reads) {
+		BOOST_REQUIRE(r.wait_for(boost::chrono::seconds(5)) == boost::future_status::ready);
+		const RedisMessage answer = r.get();
+		BOOST_REQUIRE(is_string(answer));
+		BOOST_CHECK_EQUAL(boost::get<std::string>(answer), "42");
+	}
+
+	// The increment may have happened, so it fails instead. Here it did, once
+	BOOST_REQUIRE(increment.wait_for(boost::chrono::seconds(5)) == boost::future_status::ready);
+	BOOST_CHECK_THROW(increment.get(), redis_error);
+
+	const RedisMessage counter = client.get("counter").get();
+	BOOST_REQUIRE(is_string(counter));
+	BOOST_CHECK_EQUAL(boost::get<std::string>(counter), "1");
+}
+
+BOOST_AUTO_TEST_CASE(StreamNotReplayed) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.connect();
+
+	client.command("SADD", "colors", "red", "green").get();
+
+	// The stream is sent but the connection drops before it's answered
+	server.hold_replies(true);
+	const std::size_t before = server.received();
+	boost::promise<std::string> failed;
+	boost::unique_future<std::string> failure = failed.get_future();
+	ReplyStream stream;
+	stream.m_element = [&failed](const RedisMessage &n_element) {
+		if (is_error(n_element)) {
+			failed.set_value(boost::get<redis_error>(n_element).server_message());
+		}
+	};
+	client.smembers("colors", std::move(stream));
+
+	for (int i = 0; (i < 200) && (server.received() < before + 1); ++i) {
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+	}
+	BOOST_REQUIRE_EQUAL(server.received(), before + 1);
+
+	server.drop_connections();
+	server.hold_replies(false);
+
+	// Elements may have been handed out already. It fails instead of going again
+	BOOST_REQUIRE(failure.wait_for(boost::chrono::seconds(5)) == boost::future_status::ready);
+	BOOST_CHECK_EQUAL(failure.get(), "connection lost, command may have been executed");
+	BOOST_CHECK_EQUAL(server.received(), before + 1);
+}
+
+BOOST_AUTO_TEST_CASE(UnwrittenAfterReconnect) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	FlushPolicy policy;
+	policy.m_max_linger = std::chrono::seconds(5);
+	policy.m_adaptive = true;
+	client.set_flush_policy(policy);
+	client.connect();
+
+	client.set("answer", "42").get();
+
+	// The read goes out as nothing else waits. The increment lingers behind it
+	server.hold_replies(true);
+	const std::size_t before = server.received();
+	future_response read = client.get("answer");
+	for (int i = 0; (i < 200) && (server.received() < before + 1); ++i) {
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+	}
+	BOOST_REQUIRE_EQUAL(server.received(), before + 1);
+
+	future_response increment = client.incr("counter");
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+	BOOST_REQUIRE_EQUAL(server.received(), before + 1);
+
+	server.drop_connections();
+	server.hold_replies(false);
+
+	// The increment was never written, so it goes on the new connection
+	BOOST_REQUIRE(read.wait_for(boost::chrono::seconds(5)) == boost::future_status::ready);
+	const RedisMessage answer = read.get();
+	BOOST_REQUIRE(is_string(answer));
+	BOOST_CHECK_EQUAL(boost::get<std::string>(answer), "42");
+
+	BOOST_REQUIRE(increment.wait_for(boost::chrono::seconds(5)) == boost::future_status::ready);
+	const RedisMessage counter = increment.get();
+	BOOST_REQUIRE(is_int(counter));
+	BOOST_CHECK_EQUAL(boost::get<boost::int64_t>(counter), 1);
+}
+
+BOOST_AUTO_TEST_CASE(CircuitBreaker) {
+
+	std::unique_ptr<FakeServer> server{ new FakeServer };
+	const std::string path = server->path();
+
+	ReconnectPolicy policy;
+	policy.m_initial_pause = std::chrono::milliseconds(10);
+	policy.m_max_pause = std::chrono::milliseconds(50);
+	policy.m_open_after = std::chrono::milliseconds(200);
+
+	AsyncClient client(UnixSocket{ path });
+	client.set_reconnect_policy(policy);
+	client.connect();
+
+	client.set("answer", "42").get();
+
+	// The server is gone. The request waits for a while, then the circuit opens
+	server.reset();
+	future_response waiting = client.get("answer");
+	BOOST_REQUIRE(waiting.wait_for(boost::chrono::seconds(5)) == boost::future_status::ready);
+	BOOST_CHECK_THROW(waiting.get(), redis_error);
+
+	// Now they don't wait at all
+	for (int i = 0; i < 10; ++i) {
+		future_response rejected = client.get("answer");
+		BOOST_REQUIRE(rejected.wait_for(boost::chrono::milliseconds(100)) == boost::future_status::ready);
+		BOOST_CHECK_THROW(rejected.get(), redis_error);
+	}
+
+	// Attempts went on in the background. The first that gets through closes the circuit
+	server.reset(new FakeServer(path));
+	bool closed = false;
+	for (int i = 0; (i < 100) && !closed; ++i) {
+		try {
+			client.set("answer", "43").get();
+			closed = true;
+		} catch (const redis_error &) {
+			boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+		}
+	}
+	BOOST_REQUIRE(closed);
+
+	const RedisMessage answer = client.get("answer").get();
+	BOOST_REQUIRE(is_string(answer));
+	BOOST_CHECK_EQUAL(boost::get<std::string>(answer), "43");
+}
+
+BOOST_AUTO_TEST_CASE(RequestDeadline) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.set_request_timeout(std::chrono::seconds(5));
+	client.connect();
+
+	client.set("answer", "42").get();
+
+	// No answer in time. It fails at its deadline, not the client's
+	server.hold_replies(true);
+	future_response late;
+	{
+		ScopedTimeout deadline(std::chrono::milliseconds(50));
+		late = client.get("answer");
+	}
+	BOOST_REQUIRE(late.wait_for(boost::chrono::seconds(2)) == boost::future_status::ready);
+	BOOST_CHECK_THROW(late.get(), redis_error);
+
+	// When the answer comes after all, it goes nowhere. The connection is still good
+	server.hold_replies(false);
+	const RedisMessage answer = client.get("answer").get();
+	BOOST_REQUIRE(is_string(answer));
+	BOOST_CHECK_EQUAL(boost::get<std::string>(answer), "42");
+}
+
+BOOST_AUTO_TEST_CASE(DeadlinePastReadTimeout) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.connect();
+
+	client.set("answer", "42").get();
+	const std::size_t accepted = server.accepted();
+
+	// The server keeps quiet for longer than the read timeout
+	server.hold_replies(true);
+	future_response expired;
+	future_response patient;
+	{
+		ScopedTimeout deadline(std::chrono::milliseconds(50));
+		expired = client.get("answer");
+	}
+	{
+		ScopedTimeout deadline(std::chrono::seconds(MRedisConnection::MREDIS_READ_TIMEOUT + 3));
+		patient = client.get("answer");
+	}
+	BOOST_REQUIRE(expired.wait_for(boost::chrono::seconds(2)) == boost::future_status::ready);
+	BOOST_CHECK_THROW(expired.get(), redis_error);
+
+	// Neither the one that timed out nor the one that may wait longer tear the connection down
+	boost::this_thread::sleep_for(boost::chrono::seconds(MRedisConnection::MREDIS_READ_TIMEOUT + 1));
+	BOOST_CHECK(!patient.is_ready());
+	server.hold_replies(false);
+
+	BOOST_REQUIRE(patient.wait_for(boost::chrono::seconds(2)) == boost::future_status::ready);
+	const RedisMessage answer = patient.get();
+	BOOST_REQUIRE(is_string(answer));
+	BOOST_CHECK_EQUAL(boost::get<std::string>(answer), "42");
+	BOOST_CHECK_EQUAL(server.accepted(), accepted);
+}
+
+BOOST_AUTO_TEST_CASE(BackpressureFail) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.set_backpressure(10);
+	client.connect();
+
+	client.set("answer", "42").get();
+	BOOST_CHECK_EQUAL(client.pending(), 0u);
+
+	server.hold_replies(true);
+	std::vector<future_response> reads;
+	for (int i = 0; i < 20; ++i) {
+		reads.push_back(client.get("answer"));
+	}
+	BOOST_CHECK_EQUAL(client.pending(), 10u);
+
+	// the ones over the limit fail right away, the others when they're answered
+	for (int i = 10; i < 20; ++i) {
+		BOOST_REQUIRE(reads[i].wait_for(boost::chrono::seconds(2)) == boost::future_status::ready);
+		BOOST_CHECK_THROW(reads[i].get(), redis_error);
+	}
+
+	server.hold_replies(false);
+	for (int i = 0; i < 10; ++i) {
+		const RedisMessage answer = reads[i].get();
+		BOOST_REQUIRE(is_string(answer));
+		BOOST_CHECK_EQUAL(boost::get<std::string>(answer), "42");
+	}
+
+	BOOST_CHECK_EQUAL(client.pending(), 0u);
+	BOOST_CHECK_EQUAL(client.queued_bytes(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(BackpressureBlock) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	client.set_backpressure(10, 0, Backpressure::Block);
+	client.connect();
+
+	client.set("answer", "42").get();
+	BOOST_CHECK_EQUAL(client.pending(), 0u);
+
+	server.hold_replies(true);
+	const std::size_t before = server.received();
+	std::vector<future_response> reads;
+	boost::thread sender([&client, &reads] {
+		for (int i = 0; i < 20; ++i) {
+			reads.push_back(client.get("answer"));
+		}
+	});
+
+	for (int i = 0; (i < 200) && (server.received() < before + 10); ++i) {
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+	}
+
+	// it waits for room and nothing more goes out
+	BOOST_CHECK(!sender.try_join_for(boost::chrono::milliseconds(50)));
+	BOOST_CHECK_EQUAL(server.received(), before + 10);
+	BOOST_CHECK_EQUAL(client.pending(), 10u);
+
+	server.hold_replies(false);
+	BOOST_REQUIRE(sender.try_join_for(boost::chrono::seconds(5)));
+	for (future_response &r : reads) {
+		const RedisMessage answer = r.get();
+		BOOST_REQUIRE(is_string(answer));
+		BOOST_CHECK_EQUAL(boost::get<std::string>(answer), "42");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(BackpressureGiveUp) {
+
+	std::unique_ptr<FakeServer> server{ new FakeServer };
+
+	ReconnectPolicy policy;
+	policy.m_initial_pause = std::chrono::milliseconds(10);
+	policy.m_max_pause = std::chrono::milliseconds(50);
+	policy.m_open_after = std::chrono::milliseconds(200);
+
+	// No yield function, so it blocks instead of spinning
+	AsyncClient client(UnixSocket{ server->path() });
+	client.set_backpressure(1, 0, Backpressure::Yield);
+	client.set_reconnect_policy(policy);
+	client.connect();
+
+	client.set("answer", "42").get();
+
+	server->hold_replies(true);
+	future_response first = client.get("answer");
+	future_response second;
+	boost::thread sender([&client, &second] {
+		second = client.get("answer");
+	});
+	BOOST_CHECK(!sender.try_join_for(boost::chrono::milliseconds(50)));
+
+	// Nothing will make room. Once the circuit opens it stops waiting
+	server.reset();
+	BOOST_REQUIRE(sender.try_join_for(boost::chrono::seconds(5)));
+	BOOST_REQUIRE(second.wait_for(boost::chrono::seconds(1)) == boost::future_status::ready);
+	BOOST_CHECK_THROW(second.get(), redis_error);
+	BOOST_REQUIRE(first.wait_for(boost::chrono::seconds(1)) == boost::future_status::ready);
+	BOOST_CHECK_THROW(first.get(), redis_error);
+}
+
+BOOST_AUTO_TEST_CASE(WriteCoalescing) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	FlushPolicy policy;
+	policy.m_max_bytes = 256;
+	policy.m_max_linger = std::chrono::milliseconds(500);
+	policy.m_adaptive = true;
+	client.set_flush_policy(policy);
+	client.connect();
+
+	// Nothing else waits for an answer, it doesn't linger
+	const TimePoint start = Clock::now();
+	client.set("answer", "42").get();
+	BOOST_CHECK(Clock::now() - start < std::chrono::milliseconds(250));
+
+	// Many small writes, answered in order
+	std::vector<future_response> reads;
+	for (int i = 0; i < 500; ++i) {
+		reads.push_back(client.get("answer"));
+	}
+
+	for (future_response &r : reads) {
+		const RedisMessage answer = r.get();
+		BOOST_REQUIRE(is_string(answer));
+		BOOST_CHECK_EQUAL(boost::get<std::string>(answer), "42");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(WriteLinger) {
+
+	FakeServer server;
+	AsyncClient client(UnixSocket{ server.path() });
+	FlushPolicy policy;
+	policy.m_max_linger = std::chrono::milliseconds(100);
+	client.set_flush_policy(policy);
+	client.connect();
+
+	// Without adaptive, it waits for more even when idle
+	const TimePoint start = Clock::now();
+	client.set("answer", "42").get();
+	BOOST_CHECK(Clock::now() - start >= std::chrono::milliseconds(100));
+}
+
+#endif
@@ -7,12 +7,27 @@
 #include <boost/test/unit_test.hpp>
 
 #include "../RESP.hpp"
+#include "../RespScanner.hpp"
+#include "../ReplyDecoder.hpp"
+#include "../RespWriter.hpp"
+#include "../MRedisCommands.hpp"
+#include "../RequestQueue.hpp"
+#include "../TimerWheel.hpp"
 
 #include <boost/iostreams/stream.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/asio/streambuf.hpp>
+#include <boost/thread/thread.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <random>
+#include <limits>
+#include <sstream>
 #include <string>
 
 using namespace moose::mredis;
@@ -192,3 +207,957 @@ BOOST_AUTO_TEST_CASE(ArraySerialize) {
 	}
 }
 
+
+BOOST_AUTO_TEST_CASE(Incremental) {
+
+	// a reply arriving in many small reads must be assembled across all of them
+	const std::string reply("*3\r\n$5\r\nHello\r\n:42\r\n$-1\r\n");
+
+	boost::asio::streambuf sb;
+	RespParser parser;
+	RedisMessage msg;
+
+	for (std::size_t i = 0; i < reply.size(); ++i) {
+		{
+			std::ostream os(&sb);
+			os.put(reply[i]);
+		}
+
+		const bool complete = parse_from_streambuf(parser, sb, msg);
+		BOOST_CHECK(!parser.failed());
+
+		// everything the parser has seen is consumed right away
+		BOOST_CHECK(sb.size() == 0);
+
+		if (i < reply.size() - 1) {
+			BOOST_REQUIRE(!complete);
+		} else {
+			BOOST_REQUIRE(complete);
+		}
+	}
+
+	BOOST_REQUIRE(is_array(msg));
+	const std::vector<RedisMessage> res = boost::get<std::vector<RedisMessage> >(msg);
+
+	BOOST_REQUIRE(res.size() == 3);
+	BOOST_CHECK(boost::get<std::string>(res[0]) == "Hello");
+	BOOST_CHECK(boost::get<boost::int64_t>(res[1]) == 42);
+	BOOST_CHECK(is_null(res[2]));
+	BOOST_CHECK(!parser.busy());
+}
+
+BOOST_AUTO_TEST_CASE(Pipelined) {
+
+	// several responses in one read come out one after the other
+	boost::asio::streambuf sb;
+	{
+		std::ostream os(&sb);
+		os << "+OK\r\n:-7\r\n$3\r\nfoo\r\n*0\r\n";
+	}
+
+	RespParser parser;
+	RedisMessage msg;
+
+	BOOST_REQUIRE(parse_from_streambuf(parser, sb, msg));
+	BOOST_CHECK(boost::get<std::string>(msg) == "OK");
+
+	BOOST_REQUIRE(parse_from_streambuf(parser, sb, msg));
+	BOOST_CHECK(boost::get<boost::int64_t>(msg) == -7);
+
+	BOOST_REQUIRE(parse_from_streambuf(parser, sb, msg));
+	BOOST_CHECK(boost::get<std::string>(msg) == "foo");
+
+	BOOST_REQUIRE(parse_from_streambuf(parser, sb, msg));
+	BOOST_REQUIRE(is_array(msg));
+	BOOST_CHECK(boost::get<std::vector<RedisMessage> >(msg).empty());
+
+	BOOST_CHECK(sb.size() == 0);
+	BOOST_CHECK(!parse_from_streambuf(parser, sb, msg));
+}
+
+BOOST_AUTO_TEST_CASE(BulkSpill) {
+
+	// a bulk string larger than one read goes into a buffer of its own, the rest may be received right into it
+	const std::string payload(100000, 'x');
+	const std::string head = "$" + std::to_string(payload.size()) + "\r\n" + payload.substr(0, 1000);
+
+	RespParser parser;
+	RedisMessage msg;
+	bool complete = false;
+
+	BOOST_CHECK(parser.bulk_tail().size() == 0);
+	BOOST_CHECK_EQUAL(parser.feed(head.data(), head.data() + head.size(), msg, complete), head.size());
+	BOOST_REQUIRE(!complete);
+
+	const boost::asio::mutable_buffer tail = parser.bulk_tail();
+	BOOST_REQUIRE_EQUAL(tail.size(), payload.size() - 1000);
+	std::memcpy(tail.data(), payload.data() + 1000, 50000);
+	parser.bulk_received(50000);
+	BOOST_CHECK_EQUAL(parser.bulk_tail().size(), payload.size() - 51000);
+
+	// and the rest through the input as usual
+	const std::string rest = payload.substr(51000) + "\r\n+OK\r\n";
+	const std::size_t consumed = parser.feed(rest.data(), rest.data() + rest.size(), msg, complete);
+	BOOST_REQUIRE(complete);
+	BOOST_CHECK_EQUAL(consumed, rest.size() - 5);
+	BOOST_REQUIRE(is_string(msg));
+	BOOST_CHECK(boost::get<std::string>(msg) == payload);
+	BOOST_CHECK(parser.bulk_tail().size() == 0);
+	BOOST_CHECK(!parser.busy());
+}
+
+BOOST_AUTO_TEST_CASE(ProtocolError) {
+
+	RedisMessage msg;
+
+	BOOST_CHECK(!parse("?what\r\n", msg));
+	BOOST_CHECK(!parse(":12a\r\n", msg));
+	BOOST_CHECK(!parse("$3\r\nfooX\r\n", msg));
+	BOOST_CHECK(!parse("+no crlf\n", msg));
+
+	RespParser parser;
+	bool complete = false;
+	const std::string garbage("$x\r\n");
+	parser.feed(garbage.data(), garbage.data() + garbage.size(), msg, complete);
+	BOOST_CHECK(!complete);
+	BOOST_CHECK(parser.failed());
+
+	// and recovers after a reset
+	parser.reset();
+	const std::string good("+PONG\r\n");
+	BOOST_CHECK(parser.feed(good.data(), good.data() + good.size(), msg, complete) == good.size());
+	BOOST_CHECK(complete);
+	BOOST_CHECK(boost::get<std::string>(msg) == "PONG");
+}
+
+BOOST_AUTO_TEST_CASE(LineTooLong) {
+
+	// A line that never ends doesn't grow the parser's buffer forever
+	RespParser parser;
+	RedisMessage msg;
+	bool complete = false;
+	const std::string start("-ERR ");
+	parser.feed(start.data(), start.data() + start.size(), msg, complete);
+	const std::string chunk(4096, 'x');
+	for (int i = 0; (i < 100) && !parser.failed(); ++i) {
+		parser.feed(chunk.data(), chunk.data() + chunk.size(), msg, complete);
+	}
+	BOOST_CHECK(!complete);
+	BOOST_CHECK(parser.failed());
+
+	// nor does one that came in at once
+	BOOST_CHECK(!parse("+" + std::string(100 * 1024, 'x') + "\r\n", msg));
+}
+
+BOOST_AUTO_TEST_CASE(NestedArray) {
+
+	// looks like a SCAN reply followed by an EXEC reply with one failed command
+	const std::string reply("*2\r\n$1\r\n0\r\n*2\r\n$1\r\na\r\n*1\r\n*0\r\n"
+	                        "*3\r\n+OK\r\n-ERR wrong type\r\n*1\r\n:1\r\n");
+
+	boost::asio::streambuf sb;
+	{
+		std::ostream os(&sb);
+		os << reply;
+	}
+
+	RespParser parser;
+	RedisMessage msg;
+
+	BOOST_REQUIRE(parse_from_streambuf(parser, sb, msg));
+	BOOST_REQUIRE(is_array(msg));
+	{
+		const std::vector<RedisMessage> &scan = boost::get<std::vector<RedisMessage> >(msg);
+		BOOST_REQUIRE(scan.size() == 2);
+		BOOST_CHECK(boost::get<std::string>(scan[0]) == "0");
+		BOOST_REQUIRE(is_array(scan[1]));
+
+		const std::vector<RedisMessage> &keys = boost::get<std::vector<RedisMessage> >(scan[1]);
+		BOOST_REQUIRE(keys.size() == 2);
+		BOOST_CHECK(boost::get<std::string>(keys[0]) == "a");
+		BOOST_REQUIRE(is_array(keys[1]));
+		BOOST_REQUIRE(boost::get<std::vector<RedisMessage> >(keys[1]).size() == 1);
+		BOOST_CHECK(is_array(boost::get<std::vector<RedisMessage> >(keys[1])[0]));
+	}
+
+	BOOST_REQUIRE(parse_from_streambuf(parser, sb, msg));
+	BOOST_REQUIRE(is_array(msg));
+	{
+		const std::vector<RedisMessage> &exec = boost::get<std::vector<RedisMessage> >(msg);
+		BOOST_REQUIRE(exec.size() == 3);
+		BOOST_CHECK(boost::get<std::string>(exec[0]) == "OK");
+		BOOST_REQUIRE(is_error(exec[1]));
+		BOOST_CHECK(boost::get<redis_error>(exec[1]).server_message() == "ERR wrong type");
+		BOOST_REQUIRE(is_array(exec[2]));
+	}
+
+	BOOST_CHECK(sb.size() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(NestingDepth) {
+
+	RedisMessage msg;
+
+	// reasonably deep is fine
+	std::string deep;
+	for (int i = 0; i < 100; ++i) {
+		deep += "*1\r\n";
+	}
+	deep += ":1\r\n";
+	BOOST_CHECK(parse(deep, msg));
+
+	// hostile depth is refused before it can hurt
+	std::string hostile;
+	for (int i = 0; i < 100000; ++i) {
+		hostile += "*1\r\n";
+	}
+	hostile += ":1\r\n";
+	BOOST_CHECK(!parse(hostile, msg));
+}
+
+BOOST_AUTO_TEST_CASE(NestedArraySerialize) {
+
+	boost::asio::streambuf sb;
+
+	std::vector<RedisMessage> inner;
+	inner.push_back("inner");
+	inner.push_back(23);
+
+	std::vector<RedisMessage> outer;
+	outer.push_back("outer");
+	outer.push_back(inner);
+	outer.push_back(null_result());
+
+	{
+		std::ostream os(&sb);
+		BOOST_CHECK_NO_THROW(generate_to_stream(os, outer));
+	}
+	{
+		std::istream is(&sb);
+		RedisMessage msg;
+		BOOST_REQUIRE(parse_from_stream(is, msg));
+
+		BOOST_REQUIRE(is_array(msg));
+		const std::vector<RedisMessage> res = boost::get<std::vector<RedisMessage> >(msg);
+		BOOST_REQUIRE(res.size() == 3);
+		BOOST_REQUIRE(is_array(res[1]));
+
+		const std::vector<RedisMessage> res_inner = boost::get<std::vector<RedisMessage> >(res[1]);
+		BOOST_REQUIRE(res_inner.size() == 2);
+		BOOST_CHECK(boost::get<std::string>(res_inner[0]) == "inner");
+		BOOST_CHECK(boost::get<boost::int64_t>(res_inner[1]) == 23);
+		BOOST_CHECK(is_null(res[2]));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Resp3Map) {
+
+	RedisMessage msg;
+	BOOST_REQUIRE(parse("%2\r\n+server\r\n$5\r\nredis\r\n+proto\r\n:3\r\n", msg));
+	BOOST_REQUIRE(is_map(msg));
+
+	const RedisMap &map = boost::get<RedisMap>(msg);
+	BOOST_REQUIRE(map.m_entries.size() == 2);
+	BOOST_CHECK(boost::get<std::string>(map.m_entries[0].first) == "server");
+	BOOST_CHECK(boost::get<std::string>(map.m_entries[0].second) == "redis");
+	BOOST_CHECK(boost::get<std::string>(map.m_entries[1].first) == "proto");
+	BOOST_CHECK(boost::get<boost::int64_t>(map.m_entries[1].second) == 3);
+
+	BOOST_REQUIRE(parse("%0\r\n", msg));
+	BOOST_REQUIRE(is_map(msg));
+	BOOST_CHECK(boost::get<RedisMap>(msg).m_entries.empty());
+}
+
+BOOST_AUTO_TEST_CASE(Resp3Scalars) {
+
+	RedisMessage msg;
+
+	BOOST_REQUIRE(parse("_\r\n", msg));
+	BOOST_CHECK(is_null(msg));
+
+	BOOST_REQUIRE(parse(",3.25\r\n", msg));
+	BOOST_REQUIRE(is_double(msg));
+	BOOST_CHECK(boost::get<double_result>(msg).m_value == 3.25);
+
+	BOOST_REQUIRE(parse(",-inf\r\n", msg));
+	BOOST_REQUIRE(is_double(msg));
+	BOOST_CHECK(std::isinf(boost::get<double_result>(msg).m_value));
+
+	BOOST_REQUIRE(parse("#t\r\n", msg));
+	BOOST_REQUIRE(is_boolean(msg));
+	BOOST_CHECK(boost::get<boolean_result>(msg).m_value);
+
+	BOOST_REQUIRE(parse("#f\r\n", msg));
+	BOOST_REQUIRE(is_boolean(msg));
+	BOOST_CHECK(!boost::get<boolean_result>(msg).m_value);
+	BOOST_CHECK(!parse("#x\r\n", msg));
+
+	BOOST_REQUIRE(parse("(3492890328409238509324850943850943825024385\r\n", msg));
+	BOOST_REQUIRE(is_big_number(msg));
+	BOOST_CHECK(boost::get<big_number_result>(msg).m_value == "3492890328409238509324850943850943825024385");
+
+	BOOST_REQUIRE(parse("=15\r\ntxt:Some string\r\n", msg));
+	BOOST_REQUIRE(is_verbatim(msg));
+	BOOST_CHECK(boost::get<verbatim_result>(msg).m_format == "txt");
+	BOOST_CHECK(boost::get<verbatim_result>(msg).m_value == "Some string");
+
+	BOOST_REQUIRE(parse("!21\r\nSYNTAX invalid syntax\r\n", msg));
+	BOOST_REQUIRE(is_error(msg));
+	BOOST_CHECK(boost::get<redis_error>(msg).server_message() == "SYNTAX invalid syntax");
+}
+
+BOOST_AUTO_TEST_CASE(Resp3SetAndPush) {
+
+	RedisMessage msg;
+
+	BOOST_REQUIRE(parse("~3\r\n+a\r\n+b\r\n:1\r\n", msg));
+	BOOST_REQUIRE(is_set(msg));
+	BOOST_CHECK(boost::get<RedisSet>(msg).m_elements.size() == 3);
+
+	BOOST_REQUIRE(parse(">3\r\n$7\r\nmessage\r\n$4\r\nchan\r\n$5\r\nhello\r\n", msg));
+	BOOST_REQUIRE(is_push(msg));
+	const RedisPush &push = boost::get<RedisPush>(msg);
+	BOOST_REQUIRE(push.m_elements.size() == 3);
+	BOOST_CHECK(boost::get<std::string>(push.m_elements[0]) == "message");
+	BOOST_CHECK(boost::get<std::string>(push.m_elements[2]) == "hello");
+
+	// attributes are auxiliary, the value they annotate is what we get
+	BOOST_REQUIRE(parse("|1\r\n+ttl\r\n:3600\r\n:42\r\n", msg));
+	BOOST_REQUIRE(is_int(msg));
+	BOOST_CHECK(boost::get<boost::int64_t>(msg) == 42);
+
+	// also inside aggregates
+	BOOST_REQUIRE(parse("*2\r\n|1\r\n+a\r\n+b\r\n:1\r\n:2\r\n", msg));
+	BOOST_REQUIRE(is_array(msg));
+	BOOST_CHECK(boost::get<std::vector<RedisMessage> >(msg).size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(ScanLineEnd) {
+
+	BOOST_TEST_MESSAGE("Line end kernel: " << scan_kernel_name());
+
+	// every position across and beyond the vector widths
+	for (std::size_t length = 0; length < 100; ++length) {
+		for (std::size_t lf = 0; lf <= length; ++lf) {
+			std::string line(length, 'a');
+			if (lf < length) {
+				line[lf] = '\n';
+			}
+			const char *found = find_line_end(line.data(), line.data() + length);
+			BOOST_REQUIRE(found == line.data() + lf);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(ScanDecimal) {
+
+	auto decode = [](const std::string &n_input, boost::int64_t &n_value) {
+		return parse_decimal(n_input.data(), n_input.data() + n_input.size(), n_value);
+	};
+
+	boost::int64_t value = 0;
+	BOOST_CHECK(decode("0", value) && (value == 0));
+	BOOST_CHECK(decode("7", value) && (value == 7));
+	BOOST_CHECK(decode("-1", value) && (value == -1));
+	BOOST_CHECK(decode("1234", value) && (value == 1234));
+	BOOST_CHECK(decode("12345678", value) && (value == 12345678));
+	BOOST_CHECK(decode("-99999999", value) && (value == -99999999));
+	BOOST_CHECK(decode("123456789", value) && (value == 123456789));
+	BOOST_CHECK(decode("9223372036854775807", value) && (value == 9223372036854775807LL));
+
+	BOOST_CHECK(!decode("", value));
+	BOOST_CHECK(!decode("-", value));
+	BOOST_CHECK(!decode("12a4", value));
+	BOOST_CHECK(!decode("1 2", value));
+	BOOST_CHECK(!decode("+12", value));
+	BOOST_CHECK(!decode("--1", value));
+	BOOST_CHECK(!decode("123456789a", value));
+	BOOST_CHECK(!decode("99999999999999999999", value));
+}
+
+BOOST_AUTO_TEST_CASE(TapeZeroCopy) {
+
+	std::shared_ptr<SlabPool> pool = SlabPool::create(64);
+	SlabPtr slab = pool->get();
+
+	const std::string input("$5\r\nhello\r\n$11\r\nhello");
+	std::memcpy(slab->data(), input.data(), input.size());
+
+	RespTapeParser parser;
+	RedisReply reply;
+	bool complete = false;
+	const char *begin = slab->data();
+	const char *end = slab->data() + input.size();
+
+	begin += parser.feed(slab, begin, end, reply, complete);
+	BOOST_REQUIRE(complete);
+	BOOST_CHECK(reply.root().is_string());
+	BOOST_CHECK(reply.root().string() == "hello");
+
+	// no copy, it points right into the slab
+	BOOST_CHECK(reply.root().string().data() == slab->data() + 4);
+
+	// the second one is split across slabs, so it can't point into either
+	begin += parser.feed(slab, begin, end, reply, complete);
+	BOOST_CHECK(!complete);
+	BOOST_CHECK(parser.busy());
+
+	SlabPtr next = pool->get();
+	const std::string rest(" world\r\n");
+	std::memcpy(next->data(), rest.data(), rest.size());
+	parser.feed(next, next->data(), next->data() + rest.size(), reply, complete);
+	BOOST_REQUIRE(complete);
+
+	// the reply owns its bytes and must survive the slabs being overwritten
+	std::memset(slab->data(), 'x', slab->capacity());
+	std::memset(next->data(), 'x', next->capacity());
+	BOOST_CHECK(reply.root().string() == "hello world");
+}
+
+BOOST_AUTO_TEST_CASE(TapeNested) {
+
+	std::shared_ptr<SlabPool> pool = SlabPool::create(256);
+	SlabPtr slab = pool->get();
+
+	// an attribute, then [1, [a, b], %{k: v}, _, #t] 
+	const std::string input("|1\r\n+ttl\r\n:5\r\n*5\r\n:1\r\n*2\r\n$1\r\na\r\n+b\r\n%1\r\n+k\r\n$1\r\nv\r\n_\r\n#t\r\n");
+	std::memcpy(slab->data(), input.data(), input.size());
+
+	RespTapeParser parser;
+	RedisReply reply;
+	bool complete = false;
+	const std::size_t consumed = parser.feed(slab, slab->data(), slab->data() + input.size(), reply, complete);
+	BOOST_REQUIRE(complete);
+	BOOST_CHECK_EQUAL(consumed, input.size());
+
+	const ReplyView root = reply.root();
+	BOOST_REQUIRE(root.type() == ReplyType::Array);
+	BOOST_REQUIRE_EQUAL(root.size(), 5);
+
+	BOOST_CHECK_EQUAL(root[0].integer(), 1);
+	BOOST_REQUIRE_EQUAL(root[1].size(), 2);
+	BOOST_CHECK(root[1][0].string() == "a");
+	BOOST_CHECK(root[1][1].string() == "b");
+	BOOST_REQUIRE(root[2].type() == ReplyType::Map);
+	BOOST_CHECK(root[2][0].string() == "k");
+	BOOST_CHECK(root[2][1].string() == "v");
+	BOOST_CHECK(root[3].is_null());
+	BOOST_CHECK(root[4].boolean());
+
+	// iteration skips nested aggregates
+	std::size_t elements = 0;
+	for (const ReplyView element : root) {
+		BOOST_CHECK(!element.is_error());
+		++elements;
+	}
+	BOOST_CHECK_EQUAL(elements, 5);
+
+	// same result as the conventional parser
+	RespParser conventional;
+	RedisMessage message;
+	conventional.feed(input.data(), input.data() + input.size(), message, complete);
+	BOOST_REQUIRE(complete);
+
+	std::ostringstream expected;
+	std::ostringstream converted;
+	generate_to_stream(expected, message);
+	generate_to_stream(converted, reply.to_message());
+	BOOST_CHECK_EQUAL(converted.str(), expected.str());
+
+	// and back
+	std::ostringstream roundtrip;
+	generate_to_stream(roundtrip, RedisReply::from_message(message).to_message());
+	BOOST_CHECK_EQUAL(roundtrip.str(), expected.str());
+}
+
+BOOST_AUTO_TEST_CASE(SlabRecycling) {
+
+	std::shared_ptr<SlabPool> pool = SlabPool::create(64, 2);
+	BOOST_CHECK_EQUAL(pool->idle(), 0);
+
+	RedisReply reply;
+	const char *first_data = nullptr;
+	{
+		SlabPtr slab = pool->get();
+		first_data = slab->data();
+		const std::string input("+OK\r\n");
+		std::memcpy(slab->data(), input.data(), input.size());
+
+		RespTapeParser parser;
+		bool complete = false;
+		parser.feed(slab, slab->data(), slab->data() + input.size(), reply, complete);
+		BOOST_REQUIRE(complete);
+	}
+
+	// the reply still holds it
+	BOOST_CHECK_EQUAL(pool->idle(), 0);
+	BOOST_CHECK(reply.root().string() == "OK");
+
+	reply = RedisReply();
+	BOOST_CHECK_EQUAL(pool->idle(), 1);
+
+	// and we get the same one back
+	SlabPtr again = pool->get();
+	BOOST_CHECK(again->data() == first_data);
+	BOOST_CHECK_EQUAL(pool->idle(), 0);
+
+	// no more than two are kept
+	{
+		SlabPtr a = pool->get();
+		SlabPtr b = pool->get();
+		SlabPtr c = pool->get();
+	}
+	BOOST_CHECK_EQUAL(pool->idle(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(StreamElements) {
+
+	std::vector<std::string> events;
+	bool done = false;
+
+	ReplyStream stream;
+	stream.m_begin = [&events](const ReplyType n_type, const std::size_t n_size) {
+		events.push_back(std::string(n_type == ReplyType::Set ? "set" : "begin") + std::to_string(n_size));
+	};
+	stream.m_element = [&events](const RedisMessage &n_element) {
+		events.push_back(is_string(n_element) ? boost::get<std::string>(n_element) : std::string("other"));
+	};
+	stream.m_end = [&events](const ReplyType) {
+		events.push_back("end");
+	};
+
+	// an attribute, then a set with a nested array. Fed one byte at a time
+	const std::string input("|1\r\n+ttl\r\n:5\r\n~3\r\n$1\r\na\r\n*2\r\n+b\r\n:1\r\n$3\r\ncde\r\n");
+
+	RespStreamParser parser;
+	RedisMessage push;
+	for (std::size_t i = 0; i < input.size(); ++i) {
+		bool complete = false;
+		BOOST_REQUIRE_EQUAL(parser.feed(stream, input.data() + i, input.data() + i + 1, push, complete), 1);
+		BOOST_REQUIRE(!parser.failed());
+		if (complete) {
+			BOOST_CHECK_EQUAL(i, input.size() - 1);
+			done = true;
+		}
+	}
+
+	BOOST_CHECK(done);
+	BOOST_CHECK(is_null(push));
+
+	const std::vector<std::string> expected{ "set3", "a", "begin2", "b", "other", "end", "cde", "end" };
+	BOOST_CHECK_EQUAL_COLLECTIONS(events.begin(), events.end(), expected.begin(), expected.end());
+
+	// Pushes don't go to the stream but come out whole
+	events.clear();
+	const std::string message(">3\r\n+message\r\n+chan\r\n+hello\r\n");
+	bool complete = false;
+	parser.feed(stream, message.data(), message.data() + message.size(), push, complete);
+	BOOST_REQUIRE(complete);
+	BOOST_CHECK(events.empty());
+	BOOST_REQUIRE(is_push(push));
+	BOOST_CHECK_EQUAL(boost::get<RedisPush>(push).m_elements.size(), 3);
+
+	// a plain scalar reply is one element
+	const std::string scalar("$-1\r\n");
+	parser.feed(stream, scalar.data(), scalar.data() + scalar.size(), push, complete);
+	BOOST_REQUIRE(complete);
+	BOOST_REQUIRE_EQUAL(events.size(), 1);
+	BOOST_CHECK_EQUAL(events[0], "other");
+}
+
+BOOST_AUTO_TEST_CASE(TypedDecode) {
+
+	auto reply = [](const std::string &n_input) {
+		RedisReply ret;
+		bool complete = false;
+		RespTapeParser parser;
+		parser.feed(n_input.data(), n_input.data() + n_input.size(), ret, complete);
+		BOOST_REQUIRE(complete);
+		return ret;
+	};
+
+	BOOST_CHECK_EQUAL(decode<std::string>(reply("$5\r\nhello\r\n").root()), "hello");
+	BOOST_CHECK(!decode<std::optional<std::string> >(reply("$-1\r\n").root()));
+	BOOST_CHECK_EQUAL(*decode<std::optional<std::string> >(reply("+OK\r\n").root()), "OK");
+	BOOST_CHECK_EQUAL(decode<boost::int64_t>(reply(":-42\r\n").root()), -42);
+	BOOST_CHECK_EQUAL(decode<int>(reply("$3\r\n123\r\n").root()), 123);
+	BOOST_CHECK_EQUAL(decode<double>(reply(",1.5\r\n").root()), 1.5);
+	BOOST_CHECK_EQUAL(decode<double>(reply("$4\r\n2.25\r\n").root()), 2.25);
+	BOOST_CHECK(decode<bool>(reply(":1\r\n").root()));
+	BOOST_CHECK(!decode<bool>(reply("#f\r\n").root()));
+
+	const std::vector<std::optional<std::string> > values = 
+			decode<std::vector<std::optional<std::string> > >(reply("*3\r\n$1\r\na\r\n$-1\r\n$1\r\nc\r\n").root());
+	BOOST_REQUIRE_EQUAL(values.size(), 3);
+	BOOST_CHECK_EQUAL(*values[0], "a");
+	BOOST_CHECK(!values[1]);
+	BOOST_CHECK_EQUAL(*values[2], "c");
+
+	// HGETALL in RESP2 and RESP3
+	typedef std::unordered_map<std::string, int> Hash;
+	const Hash resp2 = decode<Hash>(reply("*4\r\n$1\r\na\r\n$1\r\n1\r\n$1\r\nb\r\n$1\r\n2\r\n").root());
+	const Hash resp3 = decode<Hash>(reply("%2\r\n$1\r\na\r\n:1\r\n$1\r\nb\r\n:2\r\n").root());
+	BOOST_CHECK_EQUAL(resp2.size(), 2);
+	BOOST_CHECK(resp2 == resp3);
+	BOOST_CHECK_EQUAL(resp3.at("b"), 2);
+
+	const std::set<std::string> members = decode<std::set<std::string> >(reply("~2\r\n+x\r\n+y\r\n").root());
+	BOOST_CHECK(members == std::set<std::string>({ "x", "y" }));
+
+	// errors and mismatches throw
+	BOOST_CHECK_THROW(decode<std::string>(reply("-ERR wrong\r\n").root()), redis_error);
+	BOOST_CHECK_THROW(decode<std::string>(reply(":1\r\n").root()), redis_error);
+	BOOST_CHECK_THROW(decode<int>(reply("$3\r\nabc\r\n").root()), redis_error);
+	BOOST_CHECK_THROW(decode<Hash>(reply("*1\r\n$1\r\na\r\n").root()), redis_error);
+
+	// and land in the future as exception
+	std::shared_ptr<boost::promise<int> > promise = std::make_shared<boost::promise<int> >();
+	boost::unique_future<int> future = promise->get_future();
+	decoding_responder(promise)(reply("-ERR no\r\n"));
+	BOOST_CHECK_THROW(future.get(), redis_error);
+}
+
+BOOST_AUTO_TEST_CASE(WriteDecimal) {
+
+	auto decimal = [](const boost::int64_t n_value) {
+		char buffer[24];
+		return std::string(buffer, write_decimal(buffer, n_value));
+	};
+
+	BOOST_CHECK_EQUAL(decimal(0), "0");
+	BOOST_CHECK_EQUAL(decimal(7), "7");
+	BOOST_CHECK_EQUAL(decimal(10), "10");
+	BOOST_CHECK_EQUAL(decimal(99), "99");
+	BOOST_CHECK_EQUAL(decimal(100), "100");
+	BOOST_CHECK_EQUAL(decimal(12345), "12345");
+	BOOST_CHECK_EQUAL(decimal(-1), "-1");
+	BOOST_CHECK_EQUAL(decimal(std::numeric_limits<boost::int64_t>::max()), "9223372036854775807");
+	BOOST_CHECK_EQUAL(decimal(std::numeric_limits<boost::int64_t>::min()), "-9223372036854775808");
+
+	for (boost::int64_t i = -1000; i < 100000; i += 7) {
+		BOOST_REQUIRE_EQUAL(decimal(i), std::to_string(i));
+	}
+
+	char buffer[24];
+	BOOST_CHECK_EQUAL(std::string(buffer, write_decimal(buffer, std::numeric_limits<boost::uint64_t>::max())), "18446744073709551615");
+}
+
+BOOST_AUTO_TEST_CASE(CommandWriter) {
+
+	// headers are done by the compiler
+	constexpr auto header = command_header("GET", 2);
+	static_assert(header.size() == 13, "*2\\r\\n$3\\r\\nGET\\r\\n");
+	BOOST_CHECK_EQUAL(std::string(header.data(), header.size()), "*2\r\n$3\r\nGET\r\n");
+
+	CommandBuffer buffer;
+	format_get(buffer, std::string("k\0y", 3));
+	BOOST_CHECK_EQUAL(std::string(buffer.data(), buffer.size()), std::string("*2\r\n$3\r\nGET\r\n$3\r\nk\0y\r\n", 22));
+
+	buffer.clear();
+	format_set(buffer, "key", "value", std::chrono::seconds(60), SetCondition::NX);
+	BOOST_CHECK_EQUAL(std::string(buffer.data(), buffer.size()),
+			"*6\r\n$3\r\nSET\r\n$3\r\nkey\r\n$5\r\nvalue\r\n$2\r\nEX\r\n$2\r\n60\r\n$2\r\nNX\r\n");
+
+	// what we write, we can parse
+	buffer.clear();
+	format_mget(buffer, { "a", "bb", std::string(300, 'c') });
+
+	RedisMessage r;
+	BOOST_REQUIRE(parse(std::string(buffer.data(), buffer.size()), r));
+	BOOST_REQUIRE(is_array(r));
+	const std::vector<RedisMessage> &elements = boost::get<std::vector<RedisMessage> >(r);
+	BOOST_REQUIRE_EQUAL(elements.size(), 4);
+	BOOST_CHECK_EQUAL(boost::get<std::string>(elements[0]), "MGET");
+	BOOST_CHECK_EQUAL(boost::get<std::string>(elements[3]), std::string(300, 'c'));
+
+	buffer.clear();
+	format_eval(buffer, "return 1", { "k" }, { "a1", "a2" });
+	BOOST_REQUIRE(parse(std::string(buffer.data(), buffer.size()), r));
+	BOOST_REQUIRE(is_array(r));
+	BOOST_CHECK_EQUAL(boost::get<std::vector<RedisMessage> >(r).size(), 6);
+	BOOST_CHECK_EQUAL(boost::get<std::string>(boost::get<std::vector<RedisMessage> >(r)[2]), "1");
+}
+
+BOOST_AUTO_TEST_CASE(GenericCommand) {
+
+	constexpr auto header = array_header(4);
+	BOOST_CHECK_EQUAL(std::string(header.data(), header.size()), "*4\r\n");
+
+	CommandBuffer buffer;
+	const std::string member("two");
+	format_command(buffer, "ZADD", std::string_view("scores"), 1.5, "one", 2, member, -7L, 0.1);
+	BOOST_CHECK_EQUAL(std::string(buffer.data(), buffer.size()),
+			"*8\r\n$4\r\nZADD\r\n$6\r\nscores\r\n$3\r\n1.5\r\n$3\r\none\r\n$1\r\n2\r\n$3\r\ntwo\r\n$2\r\n-7\r\n$3\r\n0.1\r\n");
+
+	// same as the hand written ones
+	CommandBuffer expected;
+	format_get(expected, "key");
+	buffer.clear();
+	format_command(buffer, "GET", "key");
+	BOOST_CHECK_EQUAL(std::string(buffer.data(), buffer.size()), std::string(expected.data(), expected.size()));
+
+	buffer.clear();
+	format_command(buffer, "PING");
+	BOOST_CHECK_EQUAL(std::string(buffer.data(), buffer.size()), "*1\r\n$4\r\nPING\r\n");
+
+	// The name is copied, whatever the threshold. Replays go by it
+	buffer.clear();
+	buffer.set_reference_threshold(1);
+	const std::string name(100, 'N');
+	format_command(buffer, "NNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNN", "key");
+	BOOST_CHECK(!buffer.scattered());
+	BOOST_CHECK(buffer.encode().name() == name);
+
+	static_assert(std::is_same_v<stored_argument_t<const char (&)[4]>, std::string>, "literals are kept as strings");
+	static_assert(std::is_same_v<stored_argument_t<std::string_view>, std::string>, "views are kept as strings");
+	static_assert(std::is_same_v<stored_argument_t<const int &>, int>, "numbers are kept as they are");
+}
+
+BOOST_AUTO_TEST_CASE(StagedCommands) {
+
+	CommandBuffer buffer;
+	buffer.set_reference_threshold(16 * 1024);
+
+	format_get(buffer, "a");
+	EncodedCommand first = buffer.encode();
+	BOOST_CHECK(buffer.empty());
+	format_get(buffer, "b");
+	EncodedCommand second = buffer.encode();
+
+	// staged one after another in this thread's slab, so they go out as one piece
+	BOOST_CHECK(first.storage() == second.storage());
+	std::vector<boost::asio::const_buffer> buffers;
+	first.gather(buffers);
+	second.gather(buffers);
+	BOOST_REQUIRE_EQUAL(buffers.size(), 1);
+	BOOST_CHECK_EQUAL(std::string(static_cast<const char *>(buffers[0].data()), buffers[0].size()),
+			"*2\r\n$3\r\nGET\r\n$1\r\na\r\n*2\r\n$3\r\nGET\r\n$1\r\nb\r\n");
+
+	// large ones keep their own storage
+	format_mget(buffer, std::vector<std::string>(1000, "some_key"));
+	EncodedCommand large = buffer.encode();
+	BOOST_CHECK(large.storage() != second.storage());
+	BOOST_CHECK_EQUAL(large.size(), 7 + 10 + 1000 * 14);
+
+	// referenced arguments stay where they are
+	const std::string value(100000, 'v');
+	format_set(buffer, "key", value, c_invalid_duration, SetCondition::NONE);
+	EncodedCommand scattered = buffer.encode();
+	BOOST_CHECK(scattered.scattered());
+	buffers.clear();
+	scattered.gather(buffers);
+	BOOST_REQUIRE_EQUAL(buffers.size(), 3);
+	BOOST_CHECK_EQUAL(buffers[1].data(), static_cast<const void *>(value.data()));
+	BOOST_CHECK_EQUAL(boost::asio::buffer_size(buffers), scattered.size());
+}
+
+BOOST_AUTO_TEST_CASE(ScatteredWrite) {
+
+	CommandBuffer buffer;
+	buffer.set_reference_threshold(1024);
+
+	// the large value is referenced, not copied
+	const std::string value(100000, 'v');
+	format_set(buffer, "key", value, c_invalid_duration, SetCondition::NONE);
+	BOOST_CHECK(buffer.scattered());
+	BOOST_CHECK_EQUAL(buffer.size(), 100000 + std::string("*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$100000\r\n\r\n").size());
+
+	const std::vector<boost::asio::const_buffer> &buffers = buffer.buffers();
+	BOOST_REQUIRE_EQUAL(buffers.size(), 3);
+	BOOST_CHECK_EQUAL(buffers[1].data(), static_cast<const void *>(value.data()));
+	BOOST_CHECK_EQUAL(boost::asio::buffer_size(buffers), buffer.size());
+
+	std::string gathered(buffer.size(), '\0');
+	boost::asio::buffer_copy(boost::asio::buffer(gathered), buffers);
+
+	RedisMessage r;
+	BOOST_REQUIRE(parse(gathered, r));
+	BOOST_REQUIRE(is_array(r));
+	BOOST_REQUIRE_EQUAL(boost::get<std::vector<RedisMessage> >(r).size(), 3);
+	BOOST_CHECK(boost::get<std::string>(boost::get<std::vector<RedisMessage> >(r)[2]) == value);
+
+	// small ones are still copied
+	buffer.clear();
+	format_get(buffer, "key");
+	BOOST_CHECK(!buffer.scattered());
+	BOOST_REQUIRE_EQUAL(buffer.buffers().size(), 1);
+	BOOST_CHECK_EQUAL(std::string(buffer.data(), buffer.size()), "*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n");
+
+	// Numbers are formatted on the stack, they are gone before the write. However low
+	// the threshold, they are copied. So is what the caller says won't last
+	buffer.clear();
+	buffer.set_reference_threshold(1);
+	BOOST_CHECK_EQUAL(buffer.reference_threshold(), c_min_reference_size);
+	buffer.bulk(static_cast<boost::int64_t>(1234567890123456789));
+	buffer.bulk(0.1);
+	buffer.bulk_copy(value.data(), value.size());
+	BOOST_CHECK(!buffer.scattered());
+}
+
+BOOST_AUTO_TEST_CASE(RequestQueueOrder) {
+
+	RequestQueue queue;
+	BOOST_CHECK(queue.empty());
+
+	// only the first push has to wake the consumer up
+	int called = 0;
+	BOOST_CHECK(queue.push(mrequest{ nullptr, [&called](const RedisMessage &) { called = 1; } }));
+	BOOST_CHECK(!queue.push(mrequest{ nullptr, [&called](const RedisMessage &) { called = 2; } }));
+	BOOST_CHECK(!queue.push(mrequest{ nullptr, [&called](const RedisMessage &) { called = 3; } }));
+	BOOST_CHECK(!queue.empty());
+
+	std::deque<mrequest> taken;
+	BOOST_REQUIRE_EQUAL(queue.drain(taken), 3);
+	BOOST_CHECK(queue.empty());
+	for (int i = 1; i <= 3; ++i) {
+		taken[i - 1].m_callback(RedisMessage());
+		BOOST_CHECK_EQUAL(called, i);
+	}
+
+	// empty again, so the next one wakes up again
+	BOOST_CHECK_EQUAL(queue.drain(taken), 0);
+	BOOST_CHECK(queue.push(mrequest{}));
+}
+
+BOOST_AUTO_TEST_CASE(RequestQueueProducers) {
+
+	RequestQueue queue;
+	const int producers = 8;
+	const int per_producer = 10000;
+
+	// callbacks tell us who pushed them, in which order
+	int last_id = -1;
+
+	std::atomic<bool> done{ false };
+	std::deque<mrequest> taken;
+	boost::thread consumer([&queue, &taken, &done] {
+		while (!done) {
+			queue.drain(taken);
+		}
+		queue.drain(taken);
+	});
+
+	boost::thread_group threads;
+	for (int p = 0; p < producers; ++p) {
+		threads.create_thread([&queue, &last_id, p] {
+			for (int i = 0; i < per_producer; ++i) {
+				const int id = p * per_producer + i;
+				queue.push(mrequest{ nullptr, [&last_id, id](const RedisMessage &) { last_id = id; } });
+			}
+		});
+	}
+	threads.join_all();
+	done = true;
+	consumer.join();
+
+	BOOST_REQUIRE_EQUAL(taken.size(), static_cast<std::size_t>(producers * per_producer));
+	BOOST_CHECK(queue.empty());
+
+	// each producer's requests come out in the order it pushed them
+	std::vector<int> next(producers, 0);
+	for (const mrequest &req : taken) {
+		req.m_callback(RedisMessage());
+		const int p = last_id / per_producer;
+		BOOST_CHECK_EQUAL(last_id % per_producer, next[p]);
+		++next[p];
+	}
+}
+
+BOOST_AUTO_TEST_CASE(TimerWheelExpiry) {
+
+	TimerWheel wheel(std::chrono::milliseconds(1));
+	const TimePoint start = Clock::now();
+
+	// from right away to days ahead, so all levels are used
+	std::mt19937 random(42);
+	std::deque<mrequest> requests(2000);
+	std::vector<TimerWheel::Handle> handles;
+	for (mrequest &req : requests) {
+		const int magnitude = random() % 8;
+		req.m_deadline = start + std::chrono::microseconds(random() % (std::int64_t(1) << (magnitude * 5 + 2)));
+		handles.push_back(wheel.schedule(req.m_deadline, &req));
+	}
+
+	// and some change their mind
+	for (std::size_t i = 0; i < requests.size(); i += 3) {
+		wheel.cancel(handles[i]);
+		requests[i].m_expired = true;
+	}
+	BOOST_CHECK_EQUAL(wheel.size(), requests.size() - (requests.size() + 2) / 3);
+
+	// the others by deadline. Those behind the cursor are checked already
+	std::vector<const mrequest *> due;
+	for (const mrequest &req : requests) {
+		if (!req.m_expired) {
+			due.push_back(&req);
+		}
+	}
+	std::sort(due.begin(), due.end(), [](const mrequest *n_lhs, const mrequest *n_rhs) {
+		return n_lhs->m_deadline < n_rhs->m_deadline;
+	});
+	std::vector<const mrequest *>::const_iterator cursor = due.begin();
+
+	std::vector<mrequest *> expired;
+	TimePoint now = start;
+	while (wheel.size()) {
+		const TimePoint next = wheel.next_expiry();
+		BOOST_REQUIRE(next > now);
+		now = next;
+
+		// may also be when a later deadline moves down a level, then nothing is due
+		expired.clear();
+		wheel.expire(now, expired);
+		for (mrequest *req : expired) {
+			// never early, never twice
+			BOOST_CHECK(req->m_deadline <= now);
+			BOOST_CHECK(!req->m_expired);
+			req->m_expired = true;
+		}
+
+		// not late either
+		for (; (cursor != due.end()) && ((*cursor)->m_deadline <= now - std::chrono::milliseconds(1)); ++cursor) {
+			BOOST_CHECK((*cursor)->m_expired);
+		}
+	}
+
+	for (const mrequest &req : requests) {
+		BOOST_CHECK(req.m_expired);
+	}
+	BOOST_CHECK(wheel.next_expiry() == TimePoint::max());
+}
+
+BOOST_AUTO_TEST_CASE(TimerWheelReuse) {
+
+	TimerWheel wheel(std::chrono::microseconds(100));
+	const TimePoint start = Clock::now();
+
+	mrequest first;
+	mrequest second;
+	const TimerWheel::Handle h1 = wheel.schedule(start + std::chrono::milliseconds(5), &first);
+	wheel.schedule(start + std::chrono::hours(30), &first);
+
+	// the request moved
+	wheel.rebind(h1, &second);
+
+	// a deadline in the past is due with the next tick
+	mrequest late;
+	wheel.schedule(start - std::chrono::seconds(1), &late);
+
+	std::vector<mrequest *> expired;
+	BOOST_CHECK_EQUAL(wheel.expire(start + std::chrono::milliseconds(1), expired), 1u);
+	BOOST_CHECK_EQUAL(expired.back(), &late);
+	// rounded up to the next tick. We don't know where start is in it
+	BOOST_CHECK_EQUAL(wheel.expire(start + std::chrono::milliseconds(4), expired), 0u);
+	BOOST_CHECK_EQUAL(wheel.expire(start + std::chrono::microseconds(5100), expired), 1u);
+	BOOST_CHECK_EQUAL(expired.back(), &second);
+	BOOST_CHECK_EQUAL(wheel.expire(start + std::chrono::hours(29), expired), 0u);
+	BOOST_CHECK_EQUAL(wheel.expire(start + std::chrono::hours(31), expired), 1u);
+	BOOST_CHECK_EQUAL(expired.back(), &first);
+
+	// the freed nodes are used again
+	wheel.schedule(start + std::chrono::hours(32), &first);
+	BOOST_CHECK_EQUAL(wheel.size(), 1u);
+	wheel.clear();
+	BOOST_CHECK_EQUAL(wheel.size(), 0u);
+	BOOST_CHECK_EQUAL(wheel.expire(start + std::chrono::hours(33), expired), 0u);
+}